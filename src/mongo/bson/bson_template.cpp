@@ -0,0 +1,240 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/bson/bson_template.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "mongo/base/data_view.h"
+#include "mongo/bson/bsonobjiterator.h"
+#include "mongo/util/assert_util.h"
+#include "mongo/util/mongoutils/str.h"
+
+namespace mongo {
+
+    namespace {
+
+        bool isFixedSize(BSONType type) {
+            switch (type) {
+            case NumberDouble:
+            case NumberInt:
+            case NumberLong:
+            case Bool:
+            case mongo::Date:
+            case Timestamp:
+            case jstOID:
+            case jstNULL:
+            case Undefined:
+            case MinKey:
+            case MaxKey:
+                return true;
+            default:
+                return false;
+            }
+        }
+
+    } // namespace
+
+    BSONTemplate::BSONTemplate(const BSONObj& prototype)
+        : _prototype(prototype.getOwned()) {
+
+        BSONObjIterator it(_prototype);
+        while (it.more()) {
+            const BSONElement e = it.next();
+            Field field;
+            field.type = e.type();
+            field.valueOffset = e.value() - _prototype.objdata();
+            field.valueSize = e.valuesize();
+            field.fixedSize = isFixedSize(e.type());
+            _fields.push_back(field);
+        }
+    }
+
+    size_t BSONTemplate::fieldIndex(const StringData& name) const {
+        size_t index = 0;
+        BSONObjIterator it(_prototype);
+        while (it.more()) {
+            if (name == it.next().fieldName())
+                return index;
+            ++index;
+        }
+        uasserted(18748, str::stream() << "no field " << name << " in BSON template "
+                                       << _prototype);
+        return 0;
+    }
+
+    void BSONTemplate::_checkField(size_t index, BSONType type) const {
+        uassert(18749, str::stream() << "BSON template has no field " << index,
+                index < _fields.size());
+        uassert(18750, str::stream() << "field " << index << " of BSON template is of type "
+                                     << typeName(_fields[index].type) << ", not "
+                                     << typeName(type),
+                _fields[index].type == type);
+    }
+
+    BSONTemplate::Filler::Filler(const BSONTemplate& t)
+        : _template(t)
+        , _values(t.nFields()) {
+        reset();
+    }
+
+    void BSONTemplate::Filler::reset() {
+        for (size_t i = 0; i < _values.size(); ++i)
+            _values[i].set = false;
+    }
+
+    BSONTemplate::Filler::Value& BSONTemplate::Filler::_fixed(size_t field, BSONType type) {
+        _template._checkField(field, type);
+        _values[field].set = true;
+        return _values[field];
+    }
+
+    BSONTemplate::Filler& BSONTemplate::Filler::setInt(size_t field, int value) {
+        DataView(_fixed(field, NumberInt).fixed).writeLE<int32_t>(value);
+        return *this;
+    }
+
+    BSONTemplate::Filler& BSONTemplate::Filler::setLong(size_t field, long long value) {
+        DataView(_fixed(field, NumberLong).fixed).writeLE<int64_t>(value);
+        return *this;
+    }
+
+    BSONTemplate::Filler& BSONTemplate::Filler::setDouble(size_t field, double value) {
+        DataView(_fixed(field, NumberDouble).fixed).writeLE<double>(value);
+        return *this;
+    }
+
+    BSONTemplate::Filler& BSONTemplate::Filler::setBool(size_t field, bool value) {
+        _fixed(field, Bool).fixed[0] = value ? 1 : 0;
+        return *this;
+    }
+
+    BSONTemplate::Filler& BSONTemplate::Filler::setDate(size_t field, Date_t value) {
+        DataView(_fixed(field, mongo::Date).fixed).writeLE<int64_t>(value.millis);
+        return *this;
+    }
+
+    BSONTemplate::Filler& BSONTemplate::Filler::setOID(size_t field, const OID& value) {
+        std::memcpy(_fixed(field, jstOID).fixed, value.view().view(), OID::kOIDSize);
+        return *this;
+    }
+
+    BSONTemplate::Filler& BSONTemplate::Filler::setString(size_t field,
+                                                          const StringData& value) {
+        _template._checkField(field, String);
+        _values[field].set = true;
+        _values[field].data = value.rawData();
+        _values[field].size = value.size();
+        return *this;
+    }
+
+    BSONTemplate::Filler& BSONTemplate::Filler::setObject(size_t field, const BSONObj& value) {
+        _template._checkField(field, Object);
+        _values[field].set = true;
+        _values[field].data = value.objdata();
+        _values[field].size = value.objsize();
+        return *this;
+    }
+
+    BSONTemplate::Filler& BSONTemplate::Filler::setArray(size_t field, const BSONArray& value) {
+        _template._checkField(field, Array);
+        _values[field].set = true;
+        _values[field].data = value.objdata();
+        _values[field].size = value.objsize();
+        return *this;
+    }
+
+    int BSONTemplate::Filler::objsize() const {
+        int size = _template._prototype.objsize();
+        for (size_t i = 0; i < _values.size(); ++i) {
+            const Field& field = _template._fields[i];
+            if (field.fixedSize || !_values[i].set)
+                continue;
+            const int valueSize = field.type == String ? 4 + _values[i].size + 1
+                                                       : _values[i].size;
+            size += valueSize - field.valueSize;
+        }
+        return size;
+    }
+
+    BSONObj BSONTemplate::Filler::obj() const {
+        const int size = objsize();
+        char* const buf = static_cast<char*>(std::malloc(sizeof(BSONObj::Holder) + size));
+        if (buf == NULL)
+            msgasserted(18751, "out of memory BSONTemplate::Filler::obj");
+        _write(buf + sizeof(BSONObj::Holder));
+        return BSONObj::takeOwnership(buf);
+    }
+
+    void BSONTemplate::Filler::appendTo(BufBuilder* b) const {
+        const int size = objsize();
+        _write(b->skip(size));
+    }
+
+    void BSONTemplate::Filler::_write(char* out) const {
+        const char* const skeleton = _template._prototype.objdata();
+        char* const start = out;
+        int copiedTo = 0;   // in the skeleton
+
+        for (size_t i = 0; i < _values.size(); ++i) {
+            const Field& field = _template._fields[i];
+            const Value& value = _values[i];
+            if (field.fixedSize || !value.set)
+                continue;
+
+            // The skeleton up to this value, then the value itself.
+            const int runSize = field.valueOffset - copiedTo;
+            std::memcpy(out, skeleton + copiedTo, runSize);
+            out += runSize;
+
+            if (field.type == String) {
+                DataView(out).writeLE<int32_t>(value.size + 1);
+                std::memcpy(out + 4, value.data, value.size);
+                out[4 + value.size] = '\0';
+                out += 4 + value.size + 1;
+            }
+            else {
+                std::memcpy(out, value.data, value.size);
+                out += value.size;
+            }
+            copiedTo = field.valueOffset + field.valueSize;
+        }
+
+        const int restSize = _template._prototype.objsize() - copiedTo;
+        std::memcpy(out, skeleton + copiedTo, restSize);
+        out += restSize;
+
+        // Patches the fixed-size values and the length, now that everything is in place.
+        const int size = out - start;
+        DataView(start).writeLE<int32_t>(size);
+        int shift = 0;      // how far the fields have moved from their place in the skeleton
+        for (size_t i = 0; i < _values.size(); ++i) {
+            const Field& field = _template._fields[i];
+            const Value& value = _values[i];
+            if (field.fixedSize) {
+                if (value.set)
+                    std::memcpy(start + field.valueOffset + shift, value.fixed, field.valueSize);
+            }
+            else if (value.set) {
+                shift += (field.type == String ? 4 + value.size + 1 : value.size)
+                         - field.valueSize;
+            }
+        }
+    }
+
+} // namespace mongo
@@ -0,0 +1,131 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "mongo/base/string_data.h"
+#include "mongo/bson/bsonobj.h"
+#include "mongo/bson/bsontypes.h"
+#include "mongo/bson/oid.h"
+#include "mongo/bson/util/builder.h"
+#include "mongo/client/export_macros.h"
+#include "mongo/platform/cstdint.h"
+#include "mongo/util/time_support.h"
+
+namespace mongo {
+
+    /**
+     * A precomputed layout for documents that always have the same fields, in the same order,
+     * such as the commands a client sends over and over:
+     *
+     *   // once
+     *   static const BSONTemplate kFind(BSON("find" << "" << "filter" << BSONObj()
+     *                                        << "limit" << 0));
+     *
+     *   // per command
+     *   BSONTemplate::Filler cmd(kFind);
+     *   cmd.setString(0, collection);
+     *   cmd.setObject(1, filter);
+     *   cmd.setInt(2, limit);
+     *   BSONObj obj = cmd.obj();
+     *
+     * The prototype document passed to the constructor provides the field names, types and
+     * default values. Its bytes are the skeleton every document is copied from: a run of
+     * fields with fixed-size values (numbers, booleans, dates, ObjectIds, null) is copied in
+     * one memcpy and then has the values that were set patched in, and variable-size values
+     * (strings, objects, arrays) are copied in between. Nothing is encoded or bounds-checked
+     * field by field as with BSONObjBuilder.
+     *
+     * Fields are addressed by their position in the prototype; fieldIndex() looks one up by
+     * name. A value must have the type of the prototype's value. A template is immutable and
+     * may be shared between threads; a Filler may be reused, but not shared.
+     */
+    class MONGO_CLIENT_API BSONTemplate {
+    public:
+        class Filler;
+
+        explicit BSONTemplate(const BSONObj& prototype);
+
+        size_t nFields() const { return _fields.size(); }
+
+        /** The position of the field called 'name'. @throws UserException if there is none. */
+        size_t fieldIndex(const StringData& name) const;
+
+        const BSONObj& prototype() const { return _prototype; }
+
+    private:
+        struct Field {
+            BSONType type;
+            int valueOffset;        // in the prototype
+            int valueSize;
+            bool fixedSize;
+        };
+
+        void _checkField(size_t index, BSONType type) const;
+
+        BSONObj _prototype;
+        std::vector<Field> _fields;
+    };
+
+    /** The values of one document made from a template. */
+    class MONGO_CLIENT_API BSONTemplate::Filler {
+    public:
+        explicit Filler(const BSONTemplate& t);
+
+        /** Goes back to the prototype's values. */
+        void reset();
+
+        Filler& setInt(size_t field, int value);
+        Filler& setLong(size_t field, long long value);
+        Filler& setDouble(size_t field, double value);
+        Filler& setBool(size_t field, bool value);
+        Filler& setDate(size_t field, Date_t value);
+        Filler& setOID(size_t field, const OID& value);
+
+        // The values are not copied: they must stay valid until the document is made.
+        Filler& setString(size_t field, const StringData& value);
+        Filler& setObject(size_t field, const BSONObj& value);
+        Filler& setArray(size_t field, const BSONArray& value);
+
+        /** The size of the document. */
+        int objsize() const;
+
+        /** The document, in a single allocation. */
+        BSONObj obj() const;
+
+        /** Appends the document to 'b', as BSONObj::appendSelfToBufBuilder() would. */
+        void appendTo(BufBuilder* b) const;
+
+    private:
+        struct Value {
+            bool set;
+            char fixed[OID::kOIDSize];      // the encoded value of a fixed-size field
+            const char* data;               // of a variable-size field: the value...
+            int size;                       // ...or, for a string, its size without the NUL
+        };
+
+        Value& _fixed(size_t field, BSONType type);
+
+        // Writes the document, of objsize() bytes, at 'out'.
+        void _write(char* out) const;
+
+        const BSONTemplate& _template;
+        std::vector<Value> _values;
+    };
+
+} // namespace mongo
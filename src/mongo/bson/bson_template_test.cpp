@@ -0,0 +1,111 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/bson/bson_template.h"
+
+#include "mongo/db/jsobj.h"
+#include "mongo/unittest/unittest.h"
+
+namespace {
+
+    using namespace mongo;
+
+    BSONObj prototype() {
+        return BSON("find" << "" << "limit" << 0 << "filter" << BSONObj()
+                    << "skip" << 0LL << "ratio" << 0.0 << "tailable" << false
+                    << "when" << Date_t(0) << "id" << OID() << "tags" << BSONArray());
+    }
+
+    TEST(BSONTemplate, UnsetFieldsKeepPrototypeValues) {
+        const BSONTemplate t(prototype());
+        BSONTemplate::Filler filler(t);
+        ASSERT_EQUALS(prototype(), filler.obj());
+        ASSERT_EQUALS(prototype().objsize(), filler.objsize());
+    }
+
+    TEST(BSONTemplate, MatchesBSONObjBuilder) {
+        const BSONTemplate t(prototype());
+        const OID id = OID::gen();
+        const BSONObj filter = BSON("a" << 1 << "b" << "x");
+        const BSONArray tags = BSON_ARRAY("p" << "q");
+
+        BSONTemplate::Filler filler(t);
+        filler.setString(0, "collection")
+              .setInt(1, 42)
+              .setObject(2, filter)
+              .setLong(3, 1LL << 40)
+              .setDouble(4, 0.5)
+              .setBool(5, true)
+              .setDate(6, Date_t(1234567))
+              .setOID(7, id)
+              .setArray(8, tags);
+
+        const BSONObj expected =
+            BSON("find" << "collection" << "limit" << 42 << "filter" << filter
+                 << "skip" << (1LL << 40) << "ratio" << 0.5 << "tailable" << true
+                 << "when" << Date_t(1234567) << "id" << id << "tags" << tags);
+
+        const BSONObj obj = filler.obj();
+        ASSERT_EQUALS(expected.objsize(), obj.objsize());
+        ASSERT_EQUALS(0, memcmp(expected.objdata(), obj.objdata(), obj.objsize()));
+        ASSERT_TRUE(obj.valid());
+    }
+
+    TEST(BSONTemplate, FillerIsReusable) {
+        const BSONTemplate t(BSON("insert" << "" << "ordered" << true));
+        BSONTemplate::Filler filler(t);
+
+        filler.setString(0, "a-much-longer-collection-name").setBool(1, false);
+        ASSERT_EQUALS(BSON("insert" << "a-much-longer-collection-name" << "ordered" << false),
+                      filler.obj());
+
+        filler.setString(0, "c");
+        ASSERT_EQUALS(BSON("insert" << "c" << "ordered" << false), filler.obj());
+
+        filler.reset();
+        ASSERT_EQUALS(BSON("insert" << "" << "ordered" << true), filler.obj());
+    }
+
+    TEST(BSONTemplate, AppendTo) {
+        const BSONTemplate t(BSON("count" << "" << "limit" << 0));
+        BSONTemplate::Filler filler(t);
+        filler.setString(0, "things").setInt(1, 7);
+
+        BufBuilder b;
+        b.appendNum(static_cast<int>(0xdeadbeef));
+        filler.appendTo(&b);
+        ASSERT_EQUALS(static_cast<int>(4 + filler.objsize()), b.len());
+        ASSERT_EQUALS(BSON("count" << "things" << "limit" << 7), BSONObj(b.buf() + 4));
+    }
+
+    TEST(BSONTemplate, FieldIndex) {
+        const BSONTemplate t(prototype());
+        ASSERT_EQUALS(9U, t.nFields());
+        ASSERT_EQUALS(0U, t.fieldIndex("find"));
+        ASSERT_EQUALS(8U, t.fieldIndex("tags"));
+        ASSERT_THROWS(t.fieldIndex("nope"), UserException);
+    }
+
+    TEST(BSONTemplate, WrongTypeIsRejected) {
+        const BSONTemplate t(prototype());
+        BSONTemplate::Filler filler(t);
+        ASSERT_THROWS(filler.setString(1, "x"), UserException);
+        ASSERT_THROWS(filler.setInt(3, 1), UserException);
+        ASSERT_THROWS(filler.setInt(9, 1), UserException);
+    }
+
+} // namespace
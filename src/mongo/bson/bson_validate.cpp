@@ -16,12 +16,13 @@
  */
 
 #include <cstring>
-#include <deque>
+#include <vector>
 
 #include "mongo/base/data_view.h"
 #include "mongo/bson/bson_validate.h"
 #include "mongo/bson/oid.h"
 #include "mongo/db/jsobj.h"
+#include "mongo/util/text.h"
 
 namespace mongo {
 
@@ -43,8 +44,9 @@ namespace mongo {
 
         class Buffer {
         public:
-            Buffer( const char* buffer, uint64_t maxLength )
-                : _buffer( buffer ), _position( 0 ), _maxLength( maxLength ) {
+            Buffer( const char* buffer, uint64_t maxLength, bool checkUTF8 )
+                : _buffer( buffer ), _position( 0 ), _maxLength( maxLength )
+                , _checkUTF8( checkUTF8 ) {
             }
 
             template<typename N>
@@ -59,12 +61,16 @@ namespace mongo {
             }
 
             Status readCString( StringData* out ) {
+                // memchr is vectorized by the C library, which picks the widest kernel the CPU
+                // supports at load time.
                 const void* x = memchr( _buffer + _position, 0, _maxLength - _position );
                 if ( !x )
                     return makeError("no end of c-string", _idElem);
                 uint64_t len = static_cast<uint64_t>( static_cast<const char*>(x) - ( _buffer + _position ) );
 
                 StringData data( _buffer + _position, len );
+                if ( _checkUTF8 && !isValidUTF8( data ) )
+                    return makeError("invalid UTF-8 in c-string", _idElem);
                 _position += len + 1;
 
                 if ( out ) {
@@ -78,8 +84,13 @@ namespace mongo {
                 if ( !readNumber<int>( &sz ) )
                     return makeError("invalid bson", _idElem);
 
+                // The size counts the terminating NUL.
+                if ( sz <= 0 )
+                    return makeError("invalid bson", _idElem);
+
+                const StringData data( _buffer + _position, sz - 1 );
                 if ( out ) {
-                    *out = StringData( _buffer + _position, sz );
+                    *out = data;
                 }
 
                 if ( !skip( sz - 1 ) )
@@ -92,6 +103,9 @@ namespace mongo {
                 if ( c != 0 )
                     return makeError("not null terminated string", _idElem);
 
+                if ( _checkUTF8 && !isValidUTF8( data ) )
+                    return makeError("invalid UTF-8 string", _idElem);
+
                 return Status::OK();
             }
 
@@ -119,6 +133,7 @@ namespace mongo {
             const char* _buffer;
             uint64_t _position;
             uint64_t _maxLength;
+            bool _checkUTF8;
             BSONElement _idElem;
         };
 
@@ -155,6 +170,43 @@ namespace mongo {
             int _startPosition;
         };
 
+        /**
+         * The frames of the objects being validated. Documents rarely nest deeply, so the first
+         * frames are kept inline: validating a document then allocates nothing.
+         */
+        class ValidationFrameStack {
+        public:
+            ValidationFrameStack() : _size(0) {}
+
+            bool empty() const { return _size == 0; }
+            size_t size() const { return _size; }
+
+            ValidationObjectFrame& push() {
+                if (_size++ < kInlineFrames) {
+                    _inline[_size - 1] = ValidationObjectFrame();
+                    return _inline[_size - 1];
+                }
+                _spilled.push_back(ValidationObjectFrame());
+                return _spilled.back();
+            }
+
+            void pop() {
+                if (--_size >= kInlineFrames)
+                    _spilled.pop_back();
+            }
+
+            ValidationObjectFrame& back() {
+                return _size <= kInlineFrames ? _inline[_size - 1] : _spilled.back();
+            }
+
+        private:
+            static const size_t kInlineFrames = 32;
+
+            ValidationObjectFrame _inline[kInlineFrames];
+            std::vector<ValidationObjectFrame> _spilled;
+            size_t _size;
+        };
+
         /**
          * WARNING: only pass in a non-EOO idElem if it has been fully validated already!
          */
@@ -255,7 +307,7 @@ namespace mongo {
         }
 
         Status validateBSONIterative(Buffer* buffer) {
-            std::deque<ValidationObjectFrame> frames;
+            ValidationFrameStack frames;
             ValidationObjectFrame* curr = NULL;
             ValidationState::State state = ValidationState::BeginObj;
 
@@ -265,8 +317,7 @@ namespace mongo {
             while (state != ValidationState::Done) {
                 switch (state) {
                 case ValidationState::BeginObj:
-                    frames.push_back(ValidationObjectFrame());
-                    curr = &frames.back();
+                    curr = &frames.push();
                     curr->setStartPosition(buffer->position());
                     curr->setIsCodeWithScope(false);
                     if (!buffer->readNumber<int>(&curr->expectedSize)) {
@@ -305,7 +356,7 @@ namespace mongo {
                     if ( actualLength != curr->expectedSize ) {
                         return makeError("bson length doesn't match what we found", idElem);
                     }
-                    frames.pop_back();
+                    frames.pop();
                     if (frames.empty()) {
                         state = ValidationState::Done;
                     }
@@ -319,8 +370,7 @@ namespace mongo {
                     break;
                 }
                 case ValidationState::BeginCodeWScope: {
-                    frames.push_back(ValidationObjectFrame());
-                    curr = &frames.back();
+                    curr = &frames.push();
                     curr->setStartPosition(buffer->position());
                     curr->setIsCodeWithScope(true);
                     if ( !buffer->readNumber<int>( &curr->expectedSize ) )
@@ -337,7 +387,7 @@ namespace mongo {
                         return makeError("bson length for CodeWScope doesn't match what we found",
                                          idElem);
                     }
-                    frames.pop_back();
+                    frames.pop();
                     if (frames.empty())
                         return makeError("unnested CodeWScope", idElem);
                     curr = &frames.back();
@@ -354,12 +404,12 @@ namespace mongo {
 
     }  // namespace
 
-    Status validateBSON( const char* originalBuffer, uint64_t maxLength ) {
+    Status validateBSON( const char* originalBuffer, uint64_t maxLength, bool checkUTF8 ) {
         if ( maxLength < 5 ) {
             return Status( ErrorCodes::InvalidBSON, "bson data has to be at least 5 bytes" );
         }
 
-        Buffer buf( originalBuffer, maxLength );
+        Buffer buf( originalBuffer, maxLength, checkUTF8 );
         return validateBSONIterative( &buf );
     }
 
@@ -28,8 +28,9 @@ namespace mongo {
      * @param buf - bson data
      * @param maxLength - maxLength of buffer
      *                    this is NOT the bson size, but how far we know the buffer is valid
+     * @param checkUTF8 - also require field names and strings to be valid UTF-8
      */
-    Status validateBSON( const char* buf, uint64_t maxLength );
+    Status validateBSON( const char* buf, uint64_t maxLength, bool checkUTF8 = false );
 
 }
 
@@ -279,4 +279,65 @@ namespace {
         ASSERT_NOT_OK(status);
         ASSERT_EQUALS(status.reason(), "not null terminated string in object with unknown _id");
     }
+
+    TEST(BSONValidateFast, DeeplyNested) {
+        BSONObj x = BSON("a" << 1);
+        for (int i = 0; i < 100; ++i) {
+            x = BSON("o" << x << "b" << i);
+        }
+        ASSERT_OK(validateBSON(x.objdata(), x.objsize()));
+        ASSERT_NOT_OK(validateBSON(x.objdata(), x.objsize() - 1));
+    }
+
+    TEST(BSONValidateFast, NonPositiveStringSize) {
+        for (int size = -1; size <= 0; ++size) {
+            BufBuilder bb;
+            BSONObjBuilder ob(bb);
+            bb.appendChar(String);
+            bb.appendStr("s", /*withNUL*/true);
+            bb.appendNum(size);
+            bb.appendChar('\0');
+            const BSONObj x = ob.done();
+            ASSERT_NOT_OK(validateBSON(x.objdata(), x.objsize()));
+        }
+    }
+
+    TEST(BSONValidateFast, UTF8) {
+        // Long enough to go through the block-at-a-time ASCII checks.
+        const std::string ascii(100, 'a');
+        const std::string multiByte = ascii + "\xc3\xa9t\xc3\xa9 \xe2\x82\xac \xf0\x9f\x8d\x83";
+
+        const BSONObj valid = BSON("s" << multiByte << "\xc3\xa9" << ascii);
+        ASSERT_OK(validateBSON(valid.objdata(), valid.objsize(), true));
+
+        const char* invalid[] = {
+            "\xff",             // not UTF-8 at all
+            "\x80",             // unexpected continuation byte
+            "\xc3",             // truncated codepoint
+            "\xc3t",            // missing continuation byte
+            "\xc0\xaf",         // overlong
+            "\xf5\x80\x80\x80", // beyond U+10FFFF
+        };
+        for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+            for (size_t at = 0; at < ascii.size(); at += 33) {
+                std::string bad = ascii;
+                bad.insert(at, invalid[i]);
+
+                const BSONObj inValue = BSON("s" << bad);
+                ASSERT_OK(validateBSON(inValue.objdata(), inValue.objsize()));
+                ASSERT_NOT_OK(validateBSON(inValue.objdata(), inValue.objsize(), true));
+
+                const BSONObj inName = BSON(bad << 1);
+                ASSERT_OK(validateBSON(inName.objdata(), inName.objsize()));
+                ASSERT_NOT_OK(validateBSON(inName.objdata(), inName.objsize(), true));
+            }
+        }
+    }
+
+    TEST(BSONValidateFast, UTF8AllowsEmbeddedNul) {
+        BSONObjBuilder b;
+        b.append("s", mongo::StringData("a\0b", 3));
+        const BSONObj x = b.obj();
+        ASSERT_OK(validateBSON(x.objdata(), x.objsize(), true));
+    }
 }
@@ -32,36 +32,144 @@ namespace mongo {
 
     namespace str = mongoutils::str;
 
-    // need to move to bson/, but has dependency on base64 so move that to bson/util/ first.
+    namespace {
+
+        const char kHexDigits[] = "0123456789abcdef";
+
+        void appendHex(StringBuilder& s, const char* data, int len) {
+            for (int i = 0; i < len; ++i) {
+                const unsigned char c = data[i];
+                s << kHexDigits[c >> 4] << kHexDigits[c & 0xF];
+            }
+        }
+
+        void appendInteger(StringBuilder& s, long long x) {
+            char buf[24];
+            char* const end = buf + sizeof(buf);
+            char* p = end;
+            unsigned long long u = x < 0 ? 0ULL - static_cast<unsigned long long>(x) : x;
+            do {
+                *--p = static_cast<char>('0' + u % 10);
+                u /= 10;
+            } while (u);
+            if (x < 0)
+                *--p = '-';
+            s.write(p, end - p);
+        }
+
+        // Appends 'x' as a std::ostream with precision 16 would, that is, as "%.16g" does.
+        void appendDouble(StringBuilder& s, double x) {
+            // "%.16g" prints integers below 1e16 in full, so these need no printf. Zero does,
+            // for the sign of -0.
+            if (x != 0 && x >= -1e15 && x <= 1e15 &&
+                x == static_cast<double>(static_cast<long long>(x))) {
+                appendInteger(s, static_cast<long long>(x));
+                return;
+            }
+            char buf[32];
+            const int len = snprintf(buf, sizeof(buf), "%.16g", x);
+            s.write(buf, len);
+        }
+
+        void appendEscaped(StringBuilder& s, const StringData& str, bool escapeSlash = false) {
+            // Characters that need no escaping are copied a run at a time.
+            const char* run = str.rawData();
+            const char* const end = run + str.size();
+            for (const char* p = run; p != end; ++p) {
+                const unsigned char c = *p;
+                if (c > 0x1f && c != '"' && c != '\\' && c != '/')
+                    continue;
+                s.write(run, p - run);
+                run = p + 1;
+                switch (c) {
+                case '"':
+                    s << "\\\"";
+                    break;
+                case '\\':
+                    s << "\\\\";
+                    break;
+                case '/':
+                    s << (escapeSlash ? "\\/" : "/");
+                    break;
+                case '\b':
+                    s << "\\b";
+                    break;
+                case '\f':
+                    s << "\\f";
+                    break;
+                case '\n':
+                    s << "\\n";
+                    break;
+                case '\r':
+                    s << "\\r";
+                    break;
+                case '\t':
+                    s << "\\t";
+                    break;
+                default:
+                    //TODO: these should be utf16 code-units not bytes
+                    s << "\\u00";
+                    appendHex(s, p, 1);
+                }
+            }
+            s.write(run, end - run);
+        }
+
+        // Appends the date as a quoted ISO 8601 string in the local time zone.
+        void appendISODate(StringBuilder& s, Date_t d) {
+            char buf[kISODateStringMaxSize];
+            s << '"';
+            s.write(buf, outputDateAsISOStringLocal(buf, d));
+            s << '"';
+        }
+
+    } // namespace
+
     string BSONElement::jsonString( JsonStringFormat format, bool includeFieldNames, int pretty ) const {
+        StringBuilder s;
+        jsonString( s, format, includeFieldNames, pretty );
+        return s.str();
+    }
+
+    // need to move to bson/, but has dependency on base64 so move that to bson/util/ first.
+    void BSONElement::jsonString( StringBuilder& s, JsonStringFormat format, bool includeFieldNames, int pretty ) const {
         int sign;
 
-        stringstream s;
-        if ( includeFieldNames )
-            s << '"' << escape( fieldName() ) << "\" : ";
+        if ( includeFieldNames ) {
+            s << '"';
+            appendEscaped( s, fieldName() );
+            s << "\" : ";
+        }
         switch ( type() ) {
         case mongo::String:
         case Symbol:
-            s << '"' << escape( string(valuestr(), valuestrsize()-1) ) << '"';
+            s << '"';
+            appendEscaped( s, StringData( valuestr(), valuestrsize()-1 ) );
+            s << '"';
             break;
         case NumberLong:
             if (format == TenGen) {
-                s << "NumberLong(" << _numberLong() << ")";
+                s << "NumberLong(";
+                appendInteger( s, _numberLong() );
+                s << ")";
             }
             else {
-                s << "{ \"$numberLong\" : \"" << _numberLong() << "\" }";
+                s << "{ \"$numberLong\" : \"";
+                appendInteger( s, _numberLong() );
+                s << "\" }";
             }
             break;
         case NumberInt:
             if(format == JS) {
-                s << "NumberInt(" << _numberInt() << ")";
+                s << "NumberInt(";
+                appendInteger( s, _numberInt() );
+                s << ")";
                 break;
             }
         case NumberDouble:
             if ( number() >= -numeric_limits< double >::max() &&
                     number() <= numeric_limits< double >::max() ) {
-                s.precision( 16 );
-                s << number();
+                appendDouble( s, number() );
             }
             // This is not valid JSON, but according to RFC-4627, "Numeric values that cannot be
             // represented as sequences of digits (such as Infinity and NaN) are not permitted." so
@@ -94,7 +202,7 @@ namespace mongo {
             }
             break;
         case Object:
-            s << embeddedObject().jsonString( format, pretty );
+            embeddedObject().jsonString( s, format, pretty );
             break;
         case mongo::Array: {
             if ( embeddedObject().isEmpty() ) {
@@ -117,7 +225,7 @@ namespace mongo {
                         s << "undefined";
                     }
                     else {
-                        s << e.jsonString( format, false, pretty?pretty+1:0 );
+                        e.jsonString( s, format, false, pretty?pretty+1:0 );
                         e = i.next();
                     }
                     count++;
@@ -137,7 +245,9 @@ namespace mongo {
             s << '"' << valuestr() << "\", ";
             if ( format != TenGen )
                 s << "\"$id\" : ";
-            s << '"' << mongo::OID::from(valuestr() + valuestrsize()) << "\" ";
+            s << '"';
+            appendHex( s, valuestr() + valuestrsize(), OID::kOIDSize );
+            s << "\" ";
             if ( format == TenGen )
                 s << ')';
             else
@@ -151,7 +261,9 @@ namespace mongo {
             else {
                 s << "{ \"$oid\" : ";
             }
-            s << '"' << __oid() << '"';
+            s << '"';
+            appendHex( s, value(), OID::kOIDSize );
+            s << '"';
             if ( format == TenGen ) {
                 s << " )";
             }
@@ -162,14 +274,12 @@ namespace mongo {
         case BinData: {
             ConstDataCursor reader( value() );
             const int len = reader.readLEAndAdvance<int>();
-            BinDataType type = static_cast<BinDataType>(reader.readLEAndAdvance<uint8_t>());
+            const char type = reader.readLEAndAdvance<uint8_t>();
 
             s << "{ \"$binary\" : \"";
             base64::encode( s , reader.view() , len );
-            s << "\", \"$type\" : \"" << hex;
-            s.width( 2 );
-            s.fill( '0' );
-            s << type << dec;
+            s << "\", \"$type\" : \"";
+            appendHex( s, &type, 1 );
             s << "\" }";
             break;
         }
@@ -184,10 +294,12 @@ namespace mongo {
                 // handles both the case where Date_t::millis is too large, and the case where
                 // Date_t::millis is negative (before the epoch).
                 if (d.isFormatable()) {
-                    s << "\"" << dateToISOStringLocal(date()) << "\"";
+                    appendISODate(s, d);
                 }
                 else {
-                    s << "{ \"$numberLong\" : \"" << static_cast<long long>(d.millis) << "\" }";
+                    s << "{ \"$numberLong\" : \"";
+                    appendInteger( s, static_cast<long long>(d.millis) );
+                    s << "\" }";
                 }
                 s << " }";
             }
@@ -202,7 +314,7 @@ namespace mongo {
                     // (SERVER-8573), this check handles both the case where Date_t::millis is too
                     // large, and the case where Date_t::millis is negative (before the epoch).
                     if (d.isFormatable()) {
-                        s << "\"" << dateToISOStringLocal(date()) << "\"";
+                        appendISODate(s, d);
                     }
                     else {
                         // FIXME: This is not parseable by the shell, since it may not fit in a
@@ -211,18 +323,21 @@ namespace mongo {
                     }
                 }
                 else {
-                    s << date().asInt64();
+                    appendInteger( s, date().asInt64() );
                 }
                 s << " )";
             }
             break;
         case RegEx:
             if ( format == Strict ) {
-                s << "{ \"$regex\" : \"" << escape( regex() );
+                s << "{ \"$regex\" : \"";
+                appendEscaped( s, regex() );
                 s << "\", \"$options\" : \"" << regexFlags() << "\" }";
             }
             else {
-                s << "/" << escape( regex() , true ) << "/";
+                s << "/";
+                appendEscaped( s, regex(), true );
+                s << "/";
                 // FIXME Worry about alpha order?
                 for ( const char *f = regexFlags(); *f; ++f ) {
                     switch ( *f ) {
@@ -240,23 +355,42 @@ namespace mongo {
         case CodeWScope: {
             BSONObj scope = codeWScopeObject();
             if ( ! scope.isEmpty() ) {
-                s << "{ \"$code\" : \"" << escape(_asCode()) << "\" , "
-                  << "\"$scope\" : " << scope.jsonString() << " }";
+                s << "{ \"$code\" : \"";
+                appendEscaped( s, StringData( codeWScopeCode(),
+                                              ConstDataView(valuestr()).readLE<int>() - 1 ) );
+                s << "\" , " << "\"$scope\" : ";
+                scope.jsonString( s );
+                s << " }";
                 break;
             }
+            s << "\"";
+            appendEscaped( s, StringData( codeWScopeCode(),
+                                          ConstDataView(valuestr()).readLE<int>() - 1 ) );
+            s << "\"";
+            break;
         }
 
         case Code:
-            s << "\"" << escape(_asCode()) << "\"";
+            s << "\"";
+            appendEscaped( s, StringData( valuestr(), valuestrsize()-1 ) );
+            s << "\"";
             break;
 
         case mongo::Timestamp: {
             Timestamp_t ts = timestamp();
             if ( format == TenGen ) {
-                s << "Timestamp( " << ts.seconds() << ", " << ts.increment() << " )";
+                s << "Timestamp( ";
+                appendInteger( s, ts.seconds() );
+                s << ", ";
+                appendInteger( s, ts.increment() );
+                s << " )";
             }
             else {
-                s << "{ \"$timestamp\" : { \"t\" : " << ts.seconds() << ", \"i\" : " << ts.increment() << " } }";
+                s << "{ \"$timestamp\" : { \"t\" : ";
+                appendInteger( s, ts.seconds() );
+                s << ", \"i\" : ";
+                appendInteger( s, ts.increment() );
+                s << " } }";
             }
             break;
         }
@@ -275,7 +409,6 @@ namespace mongo {
             string message = ss.str();
             massert( 10312 ,  message.c_str(), false );
         }
-        return s.str();
     }
 
     int BSONElement::getGtLtOp( int def ) const {
@@ -767,43 +900,7 @@ namespace mongo {
     // used by jsonString()
     std::string escape( const std::string& s , bool escape_slash) {
         StringBuilder ret;
-        for ( std::string::const_iterator i = s.begin(); i != s.end(); ++i ) {
-            switch ( *i ) {
-            case '"':
-                ret << "\\\"";
-                break;
-            case '\\':
-                ret << "\\\\";
-                break;
-            case '/':
-                ret << (escape_slash ? "\\/" : "/");
-                break;
-            case '\b':
-                ret << "\\b";
-                break;
-            case '\f':
-                ret << "\\f";
-                break;
-            case '\n':
-                ret << "\\n";
-                break;
-            case '\r':
-                ret << "\\r";
-                break;
-            case '\t':
-                ret << "\\t";
-                break;
-            default:
-                if ( *i >= 0 && *i <= 0x1f ) {
-                    //TODO: these should be utf16 code-units not bytes
-                    char c = *i;
-                    ret << "\\u00" << toHexLower(&c, 1);
-                }
-                else {
-                    ret << *i;
-                }
-            }
-        }
+        appendEscaped( ret, s, escape_slash );
         return ret.str();
     }
 
@@ -81,16 +81,30 @@ namespace mongo {
     }
 
     string BSONObj::jsonString( JsonStringFormat format, int pretty, bool isArray ) const {
+        StringBuilder s;
+        jsonString( s, format, pretty, isArray );
+        return s.str();
+    }
 
-        if ( isEmpty() ) return isArray ? "[]" : "{}";
-
+    void BSONObj::jsonString( std::ostream& out, JsonStringFormat format, int pretty, bool isArray ) const {
         StringBuilder s;
+        jsonString( s, format, pretty, isArray );
+        out.write( s.stringData().rawData(), s.len() );
+    }
+
+    void BSONObj::jsonString( StringBuilder& s, JsonStringFormat format, int pretty, bool isArray ) const {
+
+        if ( isEmpty() ) {
+            s << (isArray ? "[]" : "{}");
+            return;
+        }
+
         s << (isArray ?  "[ " : "{ ");
         BSONObjIterator i(*this);
         BSONElement e = i.next();
         if ( !e.eoo() )
             while ( 1 ) {
-                s << e.jsonString( format, !isArray, pretty?pretty+1:0 );
+                e.jsonString( s, format, !isArray, pretty?pretty+1:0 );
                 e = i.next();
                 if ( e.eoo() )
                     break;
@@ -105,7 +119,6 @@ namespace mongo {
                 }
             }
         s << (isArray ? " ]" : " }");
-        return s.str();
     }
 
     bool BSONObj::valid() const {
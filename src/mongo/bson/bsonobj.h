@@ -179,6 +179,25 @@ namespace mongo {
             bool isArray = false
         ) const;
 
+        /** Like jsonString() above, but appends to 's'. Nothing is allocated except as 's'
+            grows, so a builder that is reset() and reused between objects soon stops
+            allocating at all.
+        */
+        void jsonString(
+            StringBuilder& s,
+            JsonStringFormat format = Strict,
+            int pretty = 0,
+            bool isArray = false
+        ) const;
+
+        /** Like jsonString() above, but writes to 'out' in one go. */
+        void jsonString(
+            std::ostream& out,
+            JsonStringFormat format = Strict,
+            int pretty = 0,
+            bool isArray = false
+        ) const;
+
         /** note: addFields always adds _id even if not specified */
         int addFields(BSONObj& from, std::set<std::string>& fields); /* returns n added */
 
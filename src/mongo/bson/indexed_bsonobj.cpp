@@ -0,0 +1,93 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/bson/indexed_bsonobj.h"
+
+#include "mongo/bson/bsonobjiterator.h"
+
+namespace mongo {
+
+    namespace {
+
+        uint32_t hashFieldName(const StringData& name) {
+            return static_cast<uint32_t>(StringData::Hasher()(name));
+        }
+
+    } // namespace
+
+    IndexedBSONObj::IndexedBSONObj(const BSONObj& obj)
+        : _obj(obj)
+        , _scanned(false) {
+    }
+
+    BSONElement IndexedBSONObj::getField(const StringData& name) const {
+        if (!_scanned)
+            _buildIndex();
+
+        if (_slots.empty())
+            return _obj.getField(name);
+
+        const uint32_t hash = hashFieldName(name);
+        const size_t mask = _slots.size() - 1;
+        for (size_t i = hash & mask; _slots[i].offset; i = (i + 1) & mask) {
+            if (_slots[i].hash != hash)
+                continue;
+            const BSONElement e(_obj.objdata() + _slots[i].offset);
+            if (name == e.fieldName())
+                return e;
+        }
+        return BSONElement();
+    }
+
+    void IndexedBSONObj::_buildIndex() const {
+        _scanned = true;
+
+        const int nFields = _obj.nFields();
+        if (nFields < kMinIndexedFields)
+            return;
+
+        // A power of two at least twice the field count keeps probe sequences short.
+        size_t capacity = 16;
+        while (capacity < static_cast<size_t>(nFields) * 2)
+            capacity *= 2;
+        _slots.resize(capacity);
+        const size_t mask = capacity - 1;
+
+        BSONObjIterator it(_obj);
+        while (it.more()) {
+            const BSONElement e = it.next();
+            const StringData name(e.fieldName(), e.fieldNameSize() - 1);
+            const uint32_t hash = hashFieldName(name);
+
+            size_t i = hash & mask;
+            bool duplicate = false;
+            for (; _slots[i].offset; i = (i + 1) & mask) {
+                if (_slots[i].hash == hash &&
+                    name == BSONElement(_obj.objdata() + _slots[i].offset).fieldName()) {
+                    duplicate = true;
+                    break;
+                }
+            }
+            if (duplicate)
+                continue;
+
+            _slots[i].offset = static_cast<uint32_t>(e.rawdata() - _obj.objdata());
+            _slots[i].hash = hash;
+        }
+    }
+
+} // namespace mongo
@@ -0,0 +1,77 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "mongo/base/string_data.h"
+#include "mongo/bson/bsonelement.h"
+#include "mongo/bson/bsonobj.h"
+#include "mongo/client/export_macros.h"
+#include "mongo/platform/cstdint.h"
+
+namespace mongo {
+
+    /**
+     * A read-only view of a BSONObj for code that looks up many of its top-level fields by
+     * name. BSONObj::getField() scans the elements on every call; the first lookup through an
+     * IndexedBSONObj builds a field name -> offset table instead, so that later lookups take
+     * constant time. The BSON itself is not touched.
+     *
+     * The table is an open-addressing hash of element offsets and hashes, two 32-bit words per
+     * slot: field names are compared in place, never copied. Objects with only a few fields
+     * are not worth indexing and are scanned like BSONObj does.
+     *
+     * Lookups are of top-level field names, like BSONObj::getField(): a dotted name is taken
+     * literally. For duplicate names the first element wins, also like BSONObj.
+     *
+     * The index is built by a const method, so a single IndexedBSONObj must not be used from
+     * several threads before its first lookup. The viewed object is held like any BSONObj
+     * copy: an owned object is kept alive, an unowned one must outlive the view.
+     */
+    class MONGO_CLIENT_API IndexedBSONObj {
+    public:
+        // Objects with fewer fields are scanned rather than indexed.
+        static const int kMinIndexedFields = 8;
+
+        explicit IndexedBSONObj(const BSONObj& obj);
+
+        const BSONObj& obj() const { return _obj; }
+
+        /** The first element called 'name', or an EOO element if there is none. */
+        BSONElement getField(const StringData& name) const;
+
+        BSONElement operator[](const StringData& name) const { return getField(name); }
+
+        bool hasField(const StringData& name) const { return !getField(name).eoo(); }
+
+        /** Whether the lookup table has been built, for tests. */
+        bool isIndexed() const { return !_slots.empty(); }
+
+    private:
+        struct Slot {
+            uint32_t offset;        // of the element from objdata(); 0 for an empty slot
+            uint32_t hash;          // low bits of the field name hash
+        };
+
+        void _buildIndex() const;
+
+        BSONObj _obj;
+        mutable bool _scanned;      // the object has been looked at, indexed or not
+        mutable std::vector<Slot> _slots;
+    };
+
+} // namespace mongo
@@ -0,0 +1,99 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/bson/indexed_bsonobj.h"
+
+#include "mongo/db/jsobj.h"
+#include "mongo/unittest/unittest.h"
+#include "mongo/util/mongoutils/str.h"
+
+namespace {
+
+    using mongo::BSONObj;
+    using mongo::BSONObjBuilder;
+    using mongo::IndexedBSONObj;
+
+    BSONObj wideObject(int nFields) {
+        BSONObjBuilder b;
+        for (int i = 0; i < nFields; ++i) {
+            b.append(std::string(mongoutils::str::stream() << "field" << i), i);
+        }
+        return b.obj();
+    }
+
+    TEST(IndexedBSONObj, FindsEveryField) {
+        const BSONObj obj = wideObject(500);
+        const IndexedBSONObj indexed(obj);
+
+        for (int i = 499; i >= 0; --i) {
+            const std::string name = mongoutils::str::stream() << "field" << i;
+            ASSERT_EQUALS(i, indexed[name].numberInt());
+            ASSERT_EQUALS(obj[name].rawdata(), indexed[name].rawdata());
+        }
+        ASSERT_TRUE(indexed.isIndexed());
+    }
+
+    TEST(IndexedBSONObj, MissingFields) {
+        const IndexedBSONObj indexed(wideObject(100));
+
+        ASSERT_TRUE(indexed["field100"].eoo());
+        ASSERT_TRUE(indexed["field"].eoo());
+        ASSERT_TRUE(indexed[""].eoo());
+        ASSERT_FALSE(indexed.hasField("nope"));
+        ASSERT_TRUE(indexed.hasField("field99"));
+    }
+
+    TEST(IndexedBSONObj, FirstDuplicateWins) {
+        BSONObjBuilder b;
+        b.append("a", 1);
+        b.appendElements(wideObject(20));
+        b.append("a", 2);
+        const IndexedBSONObj indexed(b.obj());
+
+        ASSERT_EQUALS(1, indexed["a"].numberInt());
+        ASSERT_TRUE(indexed.isIndexed());
+    }
+
+    TEST(IndexedBSONObj, DottedNamesAreLiteral) {
+        BSONObjBuilder b;
+        b.appendElements(wideObject(20));
+        b.append("a", BSON("b" << 1));
+        b.append("a.b", 2);
+        const IndexedBSONObj indexed(b.obj());
+
+        ASSERT_EQUALS(2, indexed["a.b"].numberInt());
+    }
+
+    TEST(IndexedBSONObj, SmallObjectsAreNotIndexed) {
+        const IndexedBSONObj small(BSON("a" << 1 << "b" << 2));
+        ASSERT_EQUALS(2, small["b"].numberInt());
+        ASSERT_TRUE(small["c"].eoo());
+        ASSERT_FALSE(small.isIndexed());
+
+        const IndexedBSONObj empty((BSONObj()));
+        ASSERT_TRUE(empty["a"].eoo());
+        ASSERT_FALSE(empty.isIndexed());
+    }
+
+    TEST(IndexedBSONObj, IndexIsBuiltOnFirstLookup) {
+        const IndexedBSONObj indexed(wideObject(50));
+        ASSERT_FALSE(indexed.isIndexed());
+        indexed["field7"];
+        ASSERT_TRUE(indexed.isIndexed());
+    }
+
+} // namespace
@@ -0,0 +1,85 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/bson/util/bson_arena.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "mongo/bson/bsonobj.h"
+#include "mongo/util/assert_util.h"
+
+namespace mongo {
+
+    BSONArena::BSONArena(size_t blockSize)
+        : _blockSize(blockSize)
+        , _pos(NULL)
+        , _end(NULL)
+        , _bytesAllocated(0)
+        , _bytesReserved(0) {
+        verify(blockSize > 0);
+    }
+
+    BSONArena::~BSONArena() {
+        clear();
+    }
+
+    char* BSONArena::allocate(size_t size) {
+        _bytesAllocated += size;
+
+        if (size > _blockSize / 4)
+            return _newBlock(size);
+
+        if (static_cast<size_t>(_end - _pos) < size) {
+            _pos = _newBlock(_blockSize);
+            _end = _pos + _blockSize;
+        }
+
+        char* const result = _pos;
+        _pos += size;
+        return result;
+    }
+
+    BSONObj BSONArena::copy(const BSONObj& obj) {
+        char* const data = allocate(obj.objsize());
+        std::memcpy(data, obj.objdata(), obj.objsize());
+        return BSONObj(data);
+    }
+
+    void BSONArena::clear() {
+        for (size_t i = 0; i < _blocks.size(); ++i)
+            std::free(_blocks[i]);
+        _blocks.clear();
+        _pos = _end = NULL;
+        _bytesAllocated = 0;
+        _bytesReserved = 0;
+    }
+
+    char* BSONArena::_newBlock(size_t size) {
+        _blocks.push_back(NULL);
+        char* const block = static_cast<char*>(std::malloc(size));
+        if (block == NULL) {
+            _blocks.pop_back();
+            msgasserted(18747, "out of memory BSONArena::allocate");
+        }
+
+        _blocks.back() = block;
+        _bytesReserved += size;
+        return block;
+    }
+
+} // namespace mongo
@@ -0,0 +1,86 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <cstddef>
+#include <vector>
+
+#include "mongo/client/export_macros.h"
+
+namespace mongo {
+
+    class BSONObj;
+
+    /**
+     * A bump allocator for many small BSON objects with a common lifetime, such as the
+     * documents of one write batch. Memory is carved out of large blocks and only released,
+     * all at once, by clear() or the destructor: keeping N documents costs about N / 1000
+     * mallocs instead of N.
+     *
+     * Objects are usually built in a reused scratch buffer and then copied in:
+     *
+     *   BufBuilder scratch;
+     *   BSONArena arena;
+     *   for (...) {
+     *       scratch.reset();
+     *       BSONObjBuilder b(scratch);
+     *       b.append(...);
+     *       docs.push_back(arena.copy(b.done()));
+     *   }
+     *
+     * The BSONObjs handed out are not owned (see BSONObj::isOwned()): they are only valid
+     * while the arena is, and getOwned() copies them out of it. Not thread-safe.
+     */
+    class MONGO_CLIENT_API BSONArena : private boost::noncopyable {
+    public:
+        static const size_t kDefaultBlockSize = 64 * 1024;
+
+        explicit BSONArena(size_t blockSize = kDefaultBlockSize);
+
+        ~BSONArena();
+
+        /**
+         * Returns 'size' bytes, with no particular alignment, valid until clear(). Requests
+         * larger than a quarter block get a block of their own, so that they don't waste the
+         * rest of the current one.
+         */
+        char* allocate(size_t size);
+
+        /** A copy of 'obj' in the arena. */
+        BSONObj copy(const BSONObj& obj);
+
+        /** Releases everything allocated so far, invalidating the objects copied in. */
+        void clear();
+
+        /** The bytes handed out since the last clear(). */
+        size_t bytesAllocated() const { return _bytesAllocated; }
+
+        /** The bytes of the blocks held, for tests and statistics. */
+        size_t bytesReserved() const { return _bytesReserved; }
+
+    private:
+        char* _newBlock(size_t size);
+
+        const size_t _blockSize;
+        std::vector<char*> _blocks;
+        char* _pos;                 // free space left in the current block
+        char* _end;
+        size_t _bytesAllocated;
+        size_t _bytesReserved;
+    };
+
+} // namespace mongo
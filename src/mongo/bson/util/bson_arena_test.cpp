@@ -0,0 +1,93 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/bson/util/bson_arena.h"
+
+#include <string>
+#include <vector>
+
+#include "mongo/db/jsobj.h"
+#include "mongo/unittest/unittest.h"
+
+namespace {
+
+    using mongo::BSONArena;
+    using mongo::BSONObj;
+    using mongo::BSONObjBuilder;
+    using mongo::BufBuilder;
+
+    TEST(BSONArena, CopiesAreIndependentOfTheSource) {
+        BSONArena arena;
+        BufBuilder scratch;
+        std::vector<BSONObj> docs;
+
+        for (int i = 0; i < 10000; ++i) {
+            scratch.reset();
+            BSONObjBuilder b(scratch);
+            b.append("_id", i);
+            b.append("name", "some document");
+            docs.push_back(arena.copy(b.done()));
+        }
+
+        for (int i = 0; i < 10000; ++i) {
+            ASSERT_FALSE(docs[i].isOwned());
+            ASSERT_EQUALS(i, docs[i]["_id"].numberInt());
+            ASSERT_EQUALS("some document", docs[i]["name"].str());
+        }
+    }
+
+    TEST(BSONArena, SmallObjectsShareBlocks) {
+        BSONArena arena(64 * 1024);
+        const BSONObj doc = BSON("_id" << 1 << "name" << "some document");
+
+        for (int i = 0; i < 10000; ++i) {
+            arena.copy(doc);
+        }
+
+        ASSERT_EQUALS(10000U * doc.objsize(), arena.bytesAllocated());
+        // Blocks are filled up to the last document that fits.
+        const size_t blocks = arena.bytesReserved() / (64 * 1024);
+        ASSERT_EQUALS((arena.bytesAllocated() + 64 * 1024 - 1) / (64 * 1024), blocks);
+    }
+
+    TEST(BSONArena, LargeObjectsGetTheirOwnBlock) {
+        BSONArena arena(1024);
+        const BSONObj small = BSON("a" << 1);
+        const BSONObj large = BSON("padding" << std::string(4096, 'x'));
+
+        const BSONObj first = arena.copy(small);
+        const BSONObj copied = arena.copy(large);
+        const BSONObj second = arena.copy(small);
+
+        ASSERT_EQUALS(large, copied);
+        // The large object didn't use up the current block.
+        ASSERT_EQUALS(first.objdata() + first.objsize(), second.objdata());
+        ASSERT_EQUALS(1024U + large.objsize(), arena.bytesReserved());
+    }
+
+    TEST(BSONArena, Clear) {
+        BSONArena arena;
+        arena.copy(BSON("a" << 1));
+        arena.clear();
+        ASSERT_EQUALS(0U, arena.bytesAllocated());
+        ASSERT_EQUALS(0U, arena.bytesReserved());
+
+        const BSONObj doc = arena.copy(BSON("b" << 2));
+        ASSERT_EQUALS(2, doc["b"].numberInt());
+    }
+
+} // namespace
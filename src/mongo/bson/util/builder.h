@@ -347,6 +347,9 @@ namespace mongo {
 
         std::string str() const { return std::string(_buf.data, _buf.l); }
 
+        /** The current string, valid until the builder next changes. */
+        StringData stringData() const { return StringData(_buf.data, _buf.l); }
+
         /** size of current string */
         int len() const { return _buf.l; }
 
@@ -0,0 +1,562 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kNetworking
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/client/async_client.h"
+
+#include "mongo/db/dbmessage.h"
+#include "mongo/db/namespace_string.h"
+#include "mongo/util/assert_util.h"
+#include "mongo/util/log.h"
+#include "mongo/util/mongoutils/str.h"
+#include "mongo/util/net/message_buffer_pool.h"
+#include "mongo/util/net/message_compressor.h"
+#include "mongo/util/net/message_port.h"
+#include "mongo/util/net/socket_poll.h"
+#include "mongo/util/time_support.h"
+
+namespace mongo {
+
+    using std::string;
+    using std::vector;
+
+    void assembleRequest(const string& ns, BSONObj query, int nToReturn, int nToSkip,
+                         const BSONObj* fieldsToReturn, int queryOptions, Message& toSend);
+
+    namespace {
+
+        // How long the reactor waits in poll() before rechecking for shutdown.
+        const int kPollTimeoutMillis = 100;
+
+        Status statusFromCommandReply(const BSONObj& reply) {
+            ErrorCodes::Error code = ErrorCodes::fromInt(reply["code"].numberInt());
+            if (reply["ok"].trueValue() && code == ErrorCodes::OK)
+                return Status::OK();
+            if (code == ErrorCodes::OK)
+                code = ErrorCodes::UnknownError;
+            return Status(code, reply["errmsg"].str());
+        }
+
+        // Extracts the single document of a command reply.
+        Status singleDocument(Message* reply, BSONObj* out) {
+            QueryResult::View qr = reply->singleData().view2ptr();
+            if (qr.getNReturned() != 1) {
+                return Status(ErrorCodes::ProtocolError,
+                              str::stream() << "expected one document in command reply, got "
+                                            << qr.getNReturned());
+            }
+            *out = BSONObj(qr.data()).getOwned();
+            return Status::OK();
+        }
+
+        void handleCommandReply(const AsyncClient::CommandCallback& callback,
+                                const Status& status,
+                                Message* reply) {
+            if (!status.isOK()) {
+                callback(status, BSONObj());
+                return;
+            }
+
+            BSONObj obj;
+            Status parsed = singleDocument(reply, &obj);
+            callback(parsed.isOK() ? statusFromCommandReply(obj) : parsed, obj);
+        }
+
+        void handleWriteReply(const AsyncClient::WriteCallback& callback,
+                              const Status& status,
+                              Message* reply) {
+            if (!status.isOK()) {
+                callback(status, BSONObj());
+                return;
+            }
+
+            BSONObj gle;
+            Status result = singleDocument(reply, &gle);
+            if (result.isOK())
+                result = statusFromCommandReply(gle);
+
+            if (result.isOK() && gle["err"].type() == String) {
+                ErrorCodes::Error code = ErrorCodes::fromInt(gle["code"].numberInt());
+                if (code == ErrorCodes::OK)
+                    code = ErrorCodes::UnknownError;
+                result = Status(code, gle["err"].str());
+            }
+
+            callback(result, gle);
+        }
+
+    } // namespace
+
+    AsyncClient::Connection::Connection()
+        : failed(false)
+        , received(0)
+        , buffer(NULL)
+        , capacity(0)
+        , length(0) {
+    }
+
+    AsyncClient::Connection::~Connection() {
+        if (buffer)
+            MessageBufferPool::global().release(buffer, capacity);
+    }
+
+    AsyncClient::AsyncClient(size_t numConnections)
+        : _numConnections(numConnections)
+        , _numOutstanding(0)
+        , _nextConn(0)
+        , _inShutdown(false) {
+        verify(_numConnections > 0);
+    }
+
+    AsyncClient::~AsyncClient() {
+        DESTRUCTOR_GUARD(shutdown(););
+    }
+
+    bool AsyncClient::connect(const HostAndPort& host, string& errmsg) {
+        uassert(18722, "AsyncClient is already connected", _connections.empty());
+
+        vector<boost::shared_ptr<Connection> > connections;
+        for (size_t i = 0; i < _numConnections; ++i) {
+            boost::shared_ptr<Connection> c(new Connection);
+            c->conn.reset(new DBClientConnection());
+            if (!c->conn->connect(host, errmsg))
+                return false;
+            connections.push_back(c);
+        }
+
+        _connections.swap(connections);
+        _reactor.reset(new boost::thread(stdx::bind(&AsyncClient::_reactorLoop, this)));
+        return true;
+    }
+
+    void AsyncClient::asyncRunCommand(const string& dbname,
+                                      const BSONObj& cmd,
+                                      const CommandCallback& callback) {
+        Message toSend;
+        assembleRequest(dbname + ".$cmd", cmd, -1, 0, NULL, 0, toSend);
+        _send(_nextConnection(), toSend,
+              stdx::bind(&handleCommandReply, callback,
+                         stdx::placeholders::_1, stdx::placeholders::_2));
+    }
+
+    void AsyncClient::asyncQuery(const string& ns,
+                                 const Query& query,
+                                 int nToReturn,
+                                 int nToSkip,
+                                 const BSONObj* fieldsToReturn,
+                                 int queryOptions,
+                                 const QueryCallback& callback) {
+        Message toSend;
+        assembleRequest(ns, query.obj, nToReturn, nToSkip, fieldsToReturn, queryOptions, toSend);
+
+        const size_t connIndex = _nextConnection();
+        _send(connIndex, toSend,
+              stdx::bind(&AsyncClient::_handleQueryReply, this, connIndex, 0LL, callback,
+                         stdx::placeholders::_1, stdx::placeholders::_2));
+    }
+
+    void AsyncClient::asyncGetMore(const string& ns,
+                                   long long cursorId,
+                                   int nToReturn,
+                                   const QueryCallback& callback) {
+        size_t connIndex;
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            std::map<long long, size_t>::const_iterator it = _cursorConnections.find(cursorId);
+            uassert(18723, str::stream() << "unknown cursor id " << cursorId,
+                    it != _cursorConnections.end());
+            connIndex = it->second;
+        }
+
+        BufBuilder b;
+        b.appendNum(0);
+        b.appendStr(ns);
+        b.appendNum(nToReturn);
+        b.appendNum(cursorId);
+
+        Message toSend;
+        toSend.setData(dbGetMore, b.buf(), b.len());
+        _send(connIndex, toSend,
+              stdx::bind(&AsyncClient::_handleQueryReply, this, connIndex, cursorId, callback,
+                         stdx::placeholders::_1, stdx::placeholders::_2));
+    }
+
+    void AsyncClient::asyncInsert(const string& ns,
+                                  const vector<BSONObj>& docs,
+                                  const WriteConcern& writeConcern,
+                                  const WriteCallback& callback) {
+        const size_t connIndex = _nextConnection();
+
+        BufBuilder b;
+        b.appendNum(0);
+        b.appendStr(ns);
+        for (vector<BSONObj>::const_iterator it = docs.begin(); it != docs.end(); ++it) {
+            it->appendSelfToBufBuilder(b);
+        }
+        uassert(18724, str::stream() << "insert of " << b.len() << " bytes exceeds the "
+                                     << "maximum message size",
+                b.len() <= _connections[connIndex]->conn->getMaxMessageSizeBytes());
+
+        Message insert;
+        insert.setData(dbInsert, b.buf(), b.len());
+
+        if (!writeConcern.requiresConfirmation()) {
+            {
+                boost::lock_guard<boost::mutex> sendLock(_connections[connIndex]->sendMutex);
+                _connections[connIndex]->conn->port().say(insert);
+            }
+            callback(Status::OK(), BSONObj());
+            return;
+        }
+
+        BSONObjBuilder gle;
+        gle.append("getlasterror", true);
+        gle.appendElements(writeConcern.obj());
+
+        Message toSend;
+        assembleRequest(nsToDatabase(ns) + ".$cmd", gle.obj(), -1, 0, NULL, 0, toSend);
+        _send(connIndex, toSend,
+              stdx::bind(&handleWriteReply, callback,
+                         stdx::placeholders::_1, stdx::placeholders::_2),
+              &insert);
+    }
+
+    size_t AsyncClient::numOutstanding() const {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        return _numOutstanding;
+    }
+
+    void AsyncClient::waitForAll() {
+        boost::unique_lock<boost::mutex> lk(_mutex);
+        while (_numOutstanding > 0) {
+            _allDone.wait(lk);
+        }
+    }
+
+    void AsyncClient::shutdown() {
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            _inShutdown = true;
+        }
+
+        if (_reactor) {
+            _reactor->join();
+        }
+
+        PendingMap pending;
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            pending.swap(_pending);
+            _cursorConnections.clear();
+        }
+
+        const Status canceled(ErrorCodes::CallbackCanceled, "AsyncClient was shut down");
+        for (PendingMap::const_iterator it = pending.begin(); it != pending.end(); ++it) {
+            _complete(it->second.handler, canceled, NULL);
+        }
+
+        for (size_t i = 0; i < _connections.size(); ++i) {
+            _connections[i]->conn->port().shutdown();
+        }
+    }
+
+    size_t AsyncClient::_nextConnection() {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        for (size_t tried = 0; tried < _connections.size(); ++tried) {
+            const size_t candidate = _nextConn++ % _connections.size();
+            if (!_connections[candidate]->failed)
+                return candidate;
+        }
+        uasserted(18725, "AsyncClient has no usable connection");
+        return 0;
+    }
+
+    void AsyncClient::_send(size_t connIndex,
+                            Message& toSend,
+                            const ReplyHandler& handler,
+                            Message* precededBy) {
+        Connection& c = *_connections[connIndex];
+
+        // Assign the id ourselves rather than through MessagingPort::say() so the handler is
+        // registered before the reply can possibly arrive.
+        const MSGID id = nextMessageId();
+        toSend.header().setId(id);
+        toSend.header().setResponseTo(0);
+
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            uassert(18726, "AsyncClient is shut down", !_inShutdown);
+            uassert(18727, str::stream() << "connection to " << c.conn->getServerAddress()
+                                         << " has failed",
+                    !c.failed);
+
+            Pending& p = _pending[id];
+            p.connIndex = connIndex;
+            p.handler = handler;
+            ++_numOutstanding;
+        }
+
+        try {
+            boost::lock_guard<boost::mutex> sendLock(c.sendMutex);
+            if (precededBy)
+                c.conn->port().say(*precededBy);
+            toSend.send(c.conn->port(), "say");
+        }
+        catch (...) {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            if (_pending.erase(id) == 0) {
+                // The connection was failed, or the client shut down, concurrently and our
+                // handler has already been told.
+                return;
+            }
+            if (--_numOutstanding == 0)
+                _allDone.notify_all();
+            throw;
+        }
+    }
+
+    void AsyncClient::_reactorLoop() {
+        vector<pollfd> fds;
+        vector<size_t> connIndexes;
+
+        while (true) {
+            fds.clear();
+            connIndexes.clear();
+            {
+                boost::lock_guard<boost::mutex> lk(_mutex);
+                if (_inShutdown)
+                    return;
+
+                for (size_t i = 0; i < _connections.size(); ++i) {
+                    if (_connections[i]->failed)
+                        continue;
+                    pollfd pfd;
+                    pfd.fd = _connections[i]->conn->port().psock->rawFD();
+                    pfd.events = POLLIN;
+                    pfd.revents = 0;
+                    fds.push_back(pfd);
+                    connIndexes.push_back(i);
+                }
+            }
+
+            if (fds.empty()) {
+                sleepmillis(kPollTimeoutMillis);
+                continue;
+            }
+
+            if (socketPoll(&fds[0], fds.size(), kPollTimeoutMillis) <= 0)
+                continue;
+
+            for (size_t i = 0; i < fds.size(); ++i) {
+                if (fds[i].revents == 0)
+                    continue;
+
+                if (fds[i].revents & POLLNVAL) {
+                    _failConnection(connIndexes[i],
+                                    Status(ErrorCodes::HostUnreachable, "invalid socket"));
+                    continue;
+                }
+
+                // SSL may hold more than it was asked for, which poll() would not report.
+                const size_t connIndex = connIndexes[i];
+                do {
+                    _readReply(connIndex);
+                } while (!_connections[connIndex]->failed &&
+                         _connections[connIndex]->conn->port().psock->pendingRecvBytes() > 0);
+            }
+        }
+    }
+
+    void AsyncClient::_readReply(size_t connIndex) {
+        Connection& c = *_connections[connIndex];
+        Socket& sock = *c.conn->port().psock;
+        const int headerLen = sizeof(MSGHEADER::Value);
+
+        // A single recv() per call: poll() found data waiting, so it returns without blocking.
+        try {
+            if (!c.buffer) {
+                c.received += sock.unsafe_recv(reinterpret_cast<char*>(&c.header) + c.received,
+                                               headerLen - c.received);
+                if (c.received < headerLen)
+                    return;
+
+                const int len = c.header.constView().getMessageLength();
+                if (len < headerLen || static_cast<size_t>(len) > MaxMessageSizeBytes) {
+                    _failConnection(connIndex,
+                                    Status(ErrorCodes::ProtocolError,
+                                           str::stream() << "invalid reply length " << len
+                                                         << " from "
+                                                         << c.conn->getServerAddress()));
+                    return;
+                }
+
+                c.buffer = MessageBufferPool::global().allocate(len, &c.capacity);
+                c.length = len;
+                memcpy(c.buffer, &c.header, headerLen);
+            }
+            else {
+                c.received += sock.unsafe_recv(c.buffer + c.received, c.length - c.received);
+            }
+        }
+        catch (const DBException& e) {
+            LOG(1) << "AsyncClient receive from " << c.conn->getServerAddress() << " failed: "
+                   << e.what() << std::endl;
+            _failConnection(connIndex,
+                            Status(ErrorCodes::HostUnreachable,
+                                   str::stream() << "connection to "
+                                                 << c.conn->getServerAddress() << " failed"));
+            return;
+        }
+
+        if (c.received < c.length)
+            return;
+
+        Message reply;
+        reply.setPooledData(c.buffer, c.capacity);
+        c.buffer = NULL;
+        c.received = 0;
+        c.length = 0;
+
+        if (reply.operation() == dbCompressed) {
+            try {
+                MessageCompressor::decompressMessage(&reply);
+            }
+            catch (const DBException& e) {
+                _failConnection(connIndex,
+                                Status(ErrorCodes::ProtocolError,
+                                       str::stream() << "can't expand compressed reply from "
+                                                     << c.conn->getServerAddress() << ": "
+                                                     << e.what()));
+                return;
+            }
+        }
+
+        ReplyHandler handler;
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            PendingMap::iterator it = _pending.find(reply.header().getResponseTo());
+            if (it == _pending.end()) {
+                LOG(1) << "AsyncClient discarding reply to unknown request "
+                       << reply.header().getResponseTo() << std::endl;
+                return;
+            }
+            handler = it->second.handler;
+            _pending.erase(it);
+        }
+
+        _complete(handler, Status::OK(), &reply);
+    }
+
+    void AsyncClient::_failConnection(size_t connIndex, const Status& status) {
+        vector<ReplyHandler> failed;
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            _connections[connIndex]->failed = true;
+
+            PendingMap::iterator it = _pending.begin();
+            while (it != _pending.end()) {
+                if (it->second.connIndex == connIndex) {
+                    failed.push_back(it->second.handler);
+                    _pending.erase(it++);
+                }
+                else {
+                    ++it;
+                }
+            }
+
+            std::map<long long, size_t>::iterator cursor = _cursorConnections.begin();
+            while (cursor != _cursorConnections.end()) {
+                if (cursor->second == connIndex)
+                    _cursorConnections.erase(cursor++);
+                else
+                    ++cursor;
+            }
+        }
+
+        LOG(1) << "AsyncClient connection failed with " << failed.size()
+               << " requests outstanding: " << status.reason() << std::endl;
+
+        for (size_t i = 0; i < failed.size(); ++i) {
+            _complete(failed[i], status, NULL);
+        }
+    }
+
+    void AsyncClient::_complete(const ReplyHandler& handler, const Status& status, Message* reply) {
+        try {
+            handler(status, reply);
+        }
+        catch (const std::exception& e) {
+            warning() << "AsyncClient callback threw: " << e.what() << std::endl;
+        }
+        catch (...) {
+            warning() << "AsyncClient callback threw an unknown exception" << std::endl;
+        }
+
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        if (--_numOutstanding == 0)
+            _allDone.notify_all();
+    }
+
+    void AsyncClient::_handleQueryReply(size_t connIndex,
+                                        long long sentCursorId,
+                                        const QueryCallback& callback,
+                                        const Status& status,
+                                        Message* reply) {
+        vector<BSONObj> docs;
+        if (!status.isOK()) {
+            callback(status, docs, 0);
+            return;
+        }
+
+        QueryResult::View qr = reply->singleData().view2ptr();
+        const long long cursorId = qr.getCursorId();
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            if (sentCursorId != 0 && sentCursorId != cursorId)
+                _cursorConnections.erase(sentCursorId);
+            if (cursorId != 0)
+                _cursorConnections[cursorId] = connIndex;
+        }
+
+        if (qr.getResultFlags() & ResultFlag_CursorNotFound) {
+            callback(Status(ErrorCodes::CursorNotFound,
+                            str::stream() << "cursor " << sentCursorId << " not found"),
+                     docs, 0);
+            return;
+        }
+
+        const char* data = qr.data();
+        for (int i = 0; i < qr.getNReturned(); ++i) {
+            BSONObj obj(data);
+            docs.push_back(obj.getOwned());
+            data += obj.objsize();
+        }
+
+        if (qr.getResultFlags() & ResultFlag_ErrSet) {
+            const BSONObj err = docs.empty() ? BSONObj() : docs.front();
+            ErrorCodes::Error code = ErrorCodes::fromInt(err["code"].numberInt());
+            if (code == ErrorCodes::OK)
+                code = ErrorCodes::UnknownError;
+            callback(Status(code, getErrField(err).str()), docs, cursorId);
+            return;
+        }
+
+        callback(Status::OK(), docs, cursorId);
+    }
+
+} // namespace mongo
@@ -0,0 +1,214 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mongo/base/status.h"
+#include "mongo/client/dbclientinterface.h"
+#include "mongo/client/export_macros.h"
+#include "mongo/stdx/functional.h"
+#include "mongo/util/net/hostandport.h"
+#include "mongo/util/net/message.h"
+
+namespace mongo {
+
+    /**
+     * A client that issues requests without waiting for their replies.
+     *
+     * Each async* method sends its request and returns immediately; the reply is delivered to a
+     * callback once it arrives. Any number of requests may be outstanding at once, spread round
+     * robin over 'numConnections' connections to a single server. One reactor thread owned by
+     * the client waits on all of those sockets with poll() and dispatches replies as they come
+     * in. It only reads what has already arrived, collecting a reply over as many reads as it
+     * takes, so a slow or partial reply on one connection does not hold up the others. A
+     * handful of threads can thus keep many requests in flight:
+     *
+     *   AsyncClient client(4);
+     *   std::string errmsg;
+     *   if (!client.connect(HostAndPort("localhost:27017"), errmsg))
+     *       ...
+     *   client.asyncRunCommand("admin", BSON("ping" << 1), onPing);
+     *   client.asyncQuery("test.foo", Query(), 0, 0, NULL, 0, onDocuments);
+     *   client.waitForAll();
+     *
+     * Callbacks run on the reactor thread and must not block on other requests from the same
+     * client. Exceptions thrown by a callback are logged and swallowed. If a connection fails,
+     * every request outstanding on it is completed with a HostUnreachable status; the remaining
+     * connections keep working.
+     *
+     * Errors detected while sending (e.g. a closed connection) are thrown from the async* call,
+     * in which case the callback is never invoked.
+     */
+    class MONGO_CLIENT_API AsyncClient : private boost::noncopyable {
+    public:
+        /** Delivers the reply document of a command, or the reason the command failed. */
+        typedef stdx::function<void (const Status&, const BSONObj&)> CommandCallback;
+
+        /**
+         * Delivers one batch of query or getMore results. 'cursorId' is non-zero if more results
+         * can be fetched with asyncGetMore().
+         */
+        typedef stdx::function<void (const Status&,
+                                     const std::vector<BSONObj>&,
+                                     long long cursorId)> QueryCallback;
+
+        /** Delivers the getLastError reply acknowledging a write. */
+        typedef CommandCallback WriteCallback;
+
+        explicit AsyncClient(size_t numConnections = 1);
+
+        /** Calls shutdown(). */
+        ~AsyncClient();
+
+        /**
+         * Opens the connections to 'host' and starts the reactor thread. Returns false and sets
+         * 'errmsg' if any connection fails. May be called only once.
+         */
+        bool connect(const HostAndPort& host, std::string& errmsg);
+
+        /** Runs 'cmd' against 'dbname'. A reply with ok:0 is reported as an error status. */
+        void asyncRunCommand(const std::string& dbname,
+                             const BSONObj& cmd,
+                             const CommandCallback& callback);
+
+        /**
+         * Sends an OP_QUERY; 'callback' receives the first batch. The arguments are as for
+         * DBClientBase::query(). Further batches must be requested with asyncGetMore() using the
+         * returned cursor id; cursors are pinned to the connection that opened them, which
+         * asyncGetMore() takes care of.
+         */
+        void asyncQuery(const std::string& ns,
+                        const Query& query,
+                        int nToReturn,
+                        int nToSkip,
+                        const BSONObj* fieldsToReturn,
+                        int queryOptions,
+                        const QueryCallback& callback);
+
+        /** Fetches the next batch of a cursor opened with asyncQuery(). */
+        void asyncGetMore(const std::string& ns,
+                          long long cursorId,
+                          int nToReturn,
+                          const QueryCallback& callback);
+
+        /**
+         * Inserts 'docs' with a single OP_INSERT. If 'writeConcern' requires confirmation a
+         * getLastError is pipelined right behind it on the same connection and 'callback'
+         * receives its reply; otherwise 'callback' is invoked on the calling thread with an OK
+         * status and an empty document once the insert has been handed to the socket.
+         */
+        void asyncInsert(const std::string& ns,
+                         const std::vector<BSONObj>& docs,
+                         const WriteConcern& writeConcern,
+                         const WriteCallback& callback);
+
+        /** Number of requests whose callbacks have not run yet. */
+        size_t numOutstanding() const;
+
+        /** Blocks until every outstanding callback has run. */
+        void waitForAll();
+
+        /**
+         * Stops the reactor thread, closes all connections and completes every outstanding
+         * request with a CallbackCanceled status. Safe to call more than once.
+         */
+        void shutdown();
+
+    private:
+        // Turns a raw reply, or its absence, into a call of the user's callback.
+        typedef stdx::function<void (const Status&, Message*)> ReplyHandler;
+
+        struct Connection {
+            boost::scoped_ptr<DBClientConnection> conn;
+            boost::mutex sendMutex;
+            bool failed;
+
+            // The reply being received, only used by the reactor thread. Its header collects
+            // in 'header' until the length is known; then the whole reply goes to 'buffer',
+            // which comes from the MessageBufferPool and is 'length' bytes long.
+            MSGHEADER::Value header;
+            int received;
+            char* buffer;
+            size_t capacity;
+            int length;
+
+            Connection();
+
+            // Gives back the buffer of a partly received reply.
+            ~Connection();
+        };
+
+        struct Pending {
+            size_t connIndex;
+            ReplyHandler handler;
+        };
+
+        typedef std::map<MSGID, Pending> PendingMap;
+
+        // Picks the next connection that has not failed.
+        size_t _nextConnection();
+
+        // Sends 'toSend' on connection 'connIndex' and arranges for 'handler' to receive the
+        // reply. If 'precededBy' is given it is written first, on the same connection and with
+        // nothing in between. Throws if the messages can't be sent.
+        void _send(size_t connIndex,
+                   Message& toSend,
+                   const ReplyHandler& handler,
+                   Message* precededBy = NULL);
+
+        void _reactorLoop();
+
+        // Reads what has arrived on connection 'connIndex', which poll() found readable,
+        // without waiting for more, and dispatches the reply once it is complete.
+        void _readReply(size_t connIndex);
+
+        // Marks a connection failed and completes everything outstanding on it with 'status'.
+        void _failConnection(size_t connIndex, const Status& status);
+
+        // Runs 'handler' and decrements the outstanding count. Never throws.
+        void _complete(const ReplyHandler& handler, const Status& status, Message* reply);
+
+        // Reply handler for asyncQuery() and asyncGetMore(); keeps _cursorConnections current.
+        void _handleQueryReply(size_t connIndex,
+                               long long sentCursorId,
+                               const QueryCallback& callback,
+                               const Status& status,
+                               Message* reply);
+
+        const size_t _numConnections;
+        std::vector<boost::shared_ptr<Connection> > _connections;
+
+        boost::scoped_ptr<boost::thread> _reactor;
+
+        mutable boost::mutex _mutex;
+        boost::condition_variable _allDone;
+        PendingMap _pending;
+        std::map<long long, size_t> _cursorConnections;
+        size_t _numOutstanding;
+        size_t _nextConn;
+        bool _inShutdown;
+    };
+
+} // namespace mongo
@@ -0,0 +1,193 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/client/async_client.h"
+
+#include <boost/thread/mutex.hpp>
+
+#include "mongo/dbtests/mock/mock_wire_server.h"
+#include "mongo/unittest/unittest.h"
+#include "mongo/util/time_support.h"
+
+namespace {
+
+    using mongo::AsyncClient;
+    using mongo::BSONObj;
+    using mongo::ErrorCodes;
+    using mongo::MockWireServer;
+    using mongo::Query;
+    using mongo::Status;
+    using mongo::WriteConcern;
+    using std::vector;
+
+    // Collects the results delivered to AsyncClient callbacks.
+    class Results {
+    public:
+        void onCommand(const Status& status, const BSONObj& reply) {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            statuses.push_back(status);
+            replies.push_back(reply);
+        }
+
+        void onBatch(const Status& status, const vector<BSONObj>& batch, long long cursorId) {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            statuses.push_back(status);
+            docs.insert(docs.end(), batch.begin(), batch.end());
+            cursorIds.push_back(cursorId);
+        }
+
+        vector<Status> statuses;
+        vector<BSONObj> replies;
+        vector<BSONObj> docs;
+        vector<long long> cursorIds;
+
+    private:
+        boost::mutex _mutex;
+    };
+
+    class AsyncClientTest : public mongo::unittest::Test {
+    protected:
+        void connect(AsyncClient* client) {
+            std::string errmsg;
+            ASSERT_TRUE(client->connect(_server.getHostAndPort(), errmsg));
+        }
+
+        AsyncClient::CommandCallback commandCallback() {
+            return mongo::stdx::bind(&Results::onCommand, &_results,
+                                     mongo::stdx::placeholders::_1,
+                                     mongo::stdx::placeholders::_2);
+        }
+
+        AsyncClient::QueryCallback queryCallback() {
+            return mongo::stdx::bind(&Results::onBatch, &_results,
+                                     mongo::stdx::placeholders::_1,
+                                     mongo::stdx::placeholders::_2,
+                                     mongo::stdx::placeholders::_3);
+        }
+
+        MockWireServer _server;
+        Results _results;
+    };
+
+    TEST_F(AsyncClientTest, ManyCommandsInFlight) {
+        AsyncClient client(2);
+        connect(&client);
+        _server.setReplyDelayMillis(5);
+
+        for (int i = 0; i < 20; ++i) {
+            client.asyncRunCommand("admin", BSON("ping" << 1), commandCallback());
+        }
+        client.waitForAll();
+
+        ASSERT_EQUALS(0U, client.numOutstanding());
+        ASSERT_EQUALS(20U, _results.statuses.size());
+        for (size_t i = 0; i < _results.statuses.size(); ++i) {
+            ASSERT_OK(_results.statuses[i]);
+        }
+        ASSERT_EQUALS(2U, _server.getConnectionCount());
+    }
+
+    TEST_F(AsyncClientTest, CommandErrorIsReported) {
+        AsyncClient client;
+        connect(&client);
+
+        client.asyncRunCommand("admin", BSON("noSuchCommand" << 1), commandCallback());
+        client.waitForAll();
+
+        ASSERT_EQUALS(1U, _results.statuses.size());
+        ASSERT_EQUALS(ErrorCodes::CommandNotFound, _results.statuses[0].code());
+    }
+
+    TEST_F(AsyncClientTest, QueryAndGetMore) {
+        for (int i = 0; i < 5; ++i) {
+            _server.insert("test.foo", BSON("_id" << i));
+        }
+
+        AsyncClient client(3);
+        connect(&client);
+
+        client.asyncQuery("test.foo", Query(), 2, 0, NULL, 0, queryCallback());
+        client.waitForAll();
+        ASSERT_EQUALS(2U, _results.docs.size());
+        ASSERT_NOT_EQUALS(0LL, _results.cursorIds.back());
+
+        while (_results.cursorIds.back() != 0) {
+            client.asyncGetMore("test.foo", _results.cursorIds.back(), 2, queryCallback());
+            client.waitForAll();
+        }
+
+        ASSERT_EQUALS(5U, _results.docs.size());
+        for (int i = 0; i < 5; ++i) {
+            ASSERT_EQUALS(i, _results.docs[i]["_id"].numberInt());
+        }
+        ASSERT_EQUALS(0U, _server.getOpenCursorCount());
+    }
+
+    TEST_F(AsyncClientTest, InsertWithAcknowledgement) {
+        AsyncClient client;
+        connect(&client);
+
+        vector<BSONObj> docs;
+        docs.push_back(BSON("x" << 1));
+        docs.push_back(BSON("x" << 2));
+        client.asyncInsert("test.bar", docs, WriteConcern::acknowledged, commandCallback());
+        client.waitForAll();
+
+        ASSERT_EQUALS(1U, _results.statuses.size());
+        ASSERT_OK(_results.statuses[0]);
+        ASSERT_EQUALS(2, _results.replies[0]["n"].numberInt());
+        ASSERT_EQUALS(2U, _server.getDocuments("test.bar").size());
+    }
+
+    TEST_F(AsyncClientTest, PartialReplyDoesNotHoldUpOtherConnections) {
+        AsyncClient client(2);
+        connect(&client);
+        _server.setSplitReply("ping", 1000);
+
+        client.asyncRunCommand("admin", BSON("ping" << 1), commandCallback());
+        mongo::sleepmillis(50); // the first half of the ping reply arrives
+        client.asyncRunCommand("admin", BSON("ismaster" << 1), commandCallback());
+
+        // The ismaster reply, on the other connection, is dispatched while the ping reply is
+        // still incomplete.
+        for (int i = 0; i < 500 && client.numOutstanding() > 1; ++i) {
+            mongo::sleepmillis(1);
+        }
+        ASSERT_EQUALS(1U, client.numOutstanding());
+        ASSERT_TRUE(_results.replies[0]["ismaster"].trueValue());
+
+        client.waitForAll();
+        ASSERT_EQUALS(2U, _results.statuses.size());
+        ASSERT_OK(_results.statuses[1]);
+    }
+
+    TEST_F(AsyncClientTest, ShutdownCancelsOutstandingRequests) {
+        AsyncClient client;
+        connect(&client);
+        _server.setReplyDelayMillis(500);
+
+        client.asyncRunCommand("admin", BSON("ping" << 1), commandCallback());
+        client.shutdown();
+
+        ASSERT_EQUALS(0U, client.numOutstanding());
+        ASSERT_EQUALS(1U, _results.statuses.size());
+        ASSERT_EQUALS(ErrorCodes::CallbackCanceled, _results.statuses[0].code());
+        ASSERT_THROWS(client.asyncRunCommand("admin", BSON("ping" << 1), commandCallback()),
+                      mongo::UserException);
+    }
+
+} // namespace
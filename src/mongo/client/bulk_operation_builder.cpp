@@ -18,11 +18,15 @@
 #include "mongo/client/bulk_operation_builder.h"
 
 #include <algorithm>
+#include <boost/thread/thread.hpp>
 
+#include "mongo/base/owned_pointer_vector.h"
 #include "mongo/client/dbclientinterface.h"
+#include "mongo/client/exceptions.h"
 #include "mongo/client/insert_write_operation.h"
 #include "mongo/client/write_options.h"
 #include "mongo/client/write_result.h"
+#include "mongo/platform/atomic_word.h"
 
 namespace mongo {
 
@@ -30,8 +34,33 @@ namespace mongo {
         inline bool compare(WriteOperation* const lhs, WriteOperation* const rhs) {
             return lhs->operationType() > rhs->operationType();
         }
+
+        // Room for the rest of the command around a batch, as in CommandWriter.
+        const int kCommandOverhead = 8 * 1024;
     } // namespace
 
+    typedef std::vector<WriteOperation*> Batch;
+
+    /** State shared by the threads of executeConcurrently(). */
+    struct BulkOperationBuilder::ConcurrentExecution {
+        ConcurrentExecution(const WriteConcern* writeConcern, const std::vector<Batch>& batches)
+            : writeConcern(writeConcern)
+            , batches(batches)
+            , results(batches.size())
+            , statuses(batches.size(), Status::OK()) {
+        }
+
+        const WriteConcern* const writeConcern;
+        const std::vector<Batch>& batches;
+
+        // Index of the next batch to be sent.
+        AtomicUInt32 nextBatch;
+
+        // One entry per batch, each only touched by the thread sending that batch.
+        std::vector<WriteResult> results;
+        std::vector<Status> statuses;
+    };
+
     BulkOperationBuilder::BulkOperationBuilder(DBClientBase* const client, const std::string& ns, bool ordered)
         : _client(client)
         , _ns(ns)
@@ -73,6 +102,108 @@ namespace mongo {
         _client->_write(_ns, _write_operations, _ordered, writeConcern, writeResult);
     }
 
+    void BulkOperationBuilder::executeConcurrently(
+        const WriteConcern* writeConcern,
+        WriteResult* writeResult,
+        size_t numConnections,
+        const stdx::function<DBClientBase* ()>& connectionFactory
+    ) {
+        uassert(18736, "Only unordered bulk operations can be executed concurrently", !_ordered);
+        uassert(18737, "Concurrent execution needs at least one connection", numConnections > 0);
+        uassert(0, "Bulk operations cannot be re-executed", !_executed);
+        uassert(0, "Bulk operations cannot be executed without any operations",
+            !_write_operations.empty());
+
+        _executed = true;
+
+        std::sort(_write_operations.begin(), _write_operations.end(), compare);
+
+        std::vector<Batch> batches;
+        _splitIntoBatches(&batches);
+
+        ConcurrentExecution execution(writeConcern, batches);
+        for (size_t i = 0; i < execution.results.size(); ++i)
+            execution.results[i]._requiresDetailedInsertResults = true;
+
+        // No point in opening more connections than there are batches.
+        OwnedPointerVector<DBClientBase> connections;
+        const size_t numExtraConnections = std::min(numConnections, batches.size()) - 1;
+        for (size_t i = 0; i < numExtraConnections; ++i)
+            connections.push_back(connectionFactory());
+
+        boost::thread_group threads;
+        for (size_t i = 0; i < connections.size(); ++i) {
+            threads.create_thread(stdx::bind(&BulkOperationBuilder::_executeBatches,
+                                             this, connections[i], &execution));
+        }
+        _executeBatches(_client, &execution);
+        threads.join_all();
+
+        for (size_t i = 0; i < batches.size(); ++i)
+            writeResult->_merge(execution.results[i]);
+
+        for (size_t i = 0; i < batches.size(); ++i) {
+            const Status& status = execution.statuses[i];
+            if (!status.isOK())
+                uasserted(status.code(), status.reason());
+        }
+
+        writeResult->_check(true);
+    }
+
+    void BulkOperationBuilder::_splitIntoBatches(std::vector<Batch>* batches) const {
+        const size_t maxBatchSize = _client->getMaxWriteBatchSize();
+        const int maxBatchBytes = _client->getMaxBsonObjectSize() - kCommandOverhead;
+
+        int batchBytes = 0;
+        std::vector<WriteOperation*>::const_iterator it;
+        for (it = _write_operations.begin(); it != _write_operations.end(); ++it) {
+            const int size = (*it)->incrementalSize();
+
+            if (batches->empty()
+                || batches->back().size() >= maxBatchSize
+                || batches->back().front()->operationType() != (*it)->operationType()
+                || batchBytes + size > maxBatchBytes) {
+                batches->push_back(Batch());
+                batchBytes = 0;
+            }
+
+            batches->back().push_back(*it);
+            batchBytes += size;
+        }
+    }
+
+    void BulkOperationBuilder::_executeBatches(DBClientBase* conn,
+                                               ConcurrentExecution* execution) {
+        for (size_t i = execution->nextBatch.fetchAndAdd(1);
+             i < execution->batches.size();
+             i = execution->nextBatch.fetchAndAdd(1)) {
+
+            WriteResult& result = execution->results[i];
+            try {
+                conn->_write(_ns, execution->batches[i], _ordered, execution->writeConcern,
+                             &result);
+            }
+            catch (const OperationException& ex) {
+                // Write errors are recorded in the result and reported once all batches are
+                // merged. Anything else means the batch failed as a whole.
+                if (!result.hasErrors()) {
+                    const int code = ex.obj()["code"].numberInt();
+                    execution->statuses[i] =
+                        Status(code ? static_cast<ErrorCodes::Error>(code)
+                                    : ErrorCodes::UnknownError,
+                               ex.what());
+                }
+            }
+            catch (const DBException& ex) {
+                execution->statuses[i] = ex.toStatus();
+            }
+            catch (const std::exception& ex) {
+                execution->statuses[i] = Status(ErrorCodes::UnknownError, ex.what());
+            }
+        }
+    }
+
     void BulkOperationBuilder::enqueue(WriteOperation* operation) {
         operation->setBulkIndex(_currentIndex++);
         _write_operations.push_back(operation);
@@ -20,6 +20,7 @@
 #include "mongo/bson/bsonobj.h"
 #include "mongo/client/bulk_update_builder.h"
 #include "mongo/client/write_result.h"
+#include "mongo/stdx/functional.h"
 
 namespace mongo {
 
@@ -100,9 +101,37 @@ namespace mongo {
          */
         void execute(const WriteConcern* writeConcern, WriteResult* writeResult);
 
+        /**
+         * Executes an unordered bulk operation over several connections at once.
+         *
+         * The operations are cut into batches up front, and 'numConnections' threads send them
+         * in parallel: one uses the builder's own connection, the others use connections made
+         * by 'connectionFactory' for the duration of the call. The results of all batches are
+         * merged into 'writeResult' with every write error referring to the operation's index
+         * in the whole bulk operation, just as execute() would report it.
+         *
+         * @param wc The Write concern for the entire bulk operation. 0 = default (acknowledged);
+         * @param results Vector where the results of operations will go.
+         * @param numConnections The number of batches to have in flight at once.
+         * @param connectionFactory Makes the additional connections; they are deleted again
+         *  before this returns.
+         */
+        void executeConcurrently(const WriteConcern* writeConcern,
+                                 WriteResult* writeResult,
+                                 size_t numConnections,
+                                 const stdx::function<DBClientBase* ()>& connectionFactory);
+
     private:
+        struct ConcurrentExecution;
+
         void enqueue(WriteOperation* const operation);
 
+        // Cuts the sorted operations into batches that each fit a single write command.
+        void _splitIntoBatches(std::vector<std::vector<WriteOperation*> >* batches) const;
+
+        // Thread body of executeConcurrently(): sends batches on 'conn' until none are left.
+        void _executeBatches(DBClientBase* conn, ConcurrentExecution* execution);
+
         DBClientBase* const _client;
         const std::string _ns;
         const bool _ordered;
@@ -0,0 +1,100 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/client/bulk_operation_builder.h"
+
+#include <string>
+
+#include "mongo/client/dbclientinterface.h"
+#include "mongo/client/exceptions.h"
+#include "mongo/dbtests/mock/mock_wire_server.h"
+#include "mongo/unittest/unittest.h"
+
+namespace {
+
+    using mongo::BulkOperationBuilder;
+    using mongo::DBClientConnection;
+    using mongo::MockWireServer;
+    using mongo::WriteConcern;
+    using mongo::WriteResult;
+
+    const char kNamespace[] = "test.foo";
+
+    class BulkOperationBuilderTest : public mongo::unittest::Test {
+    protected:
+        void setUp() {
+            _server.setMaxWireVersion(2);
+
+            std::string errmsg;
+            ASSERT_TRUE(_conn.connect(_server.getHostAndPort(), errmsg));
+        }
+
+        void executeConcurrently(BulkOperationBuilder* bulk, WriteResult* result) {
+            bulk->executeConcurrently(&WriteConcern::acknowledged, result, 3,
+                                      mongo::stdx::bind(&MockWireServer::connect, &_server));
+        }
+
+        MockWireServer _server;
+        DBClientConnection _conn;
+    };
+
+    TEST_F(BulkOperationBuilderTest, ConcurrentInsertsAllArrive) {
+        BulkOperationBuilder bulk = _conn.initializeUnorderedBulkOp(kNamespace);
+        for (int i = 0; i < 2500; ++i) {
+            bulk.insert(BSON("_id" << i));
+        }
+
+        WriteResult result;
+        executeConcurrently(&bulk, &result);
+
+        ASSERT_EQUALS(2500, result.nInserted());
+        ASSERT_FALSE(result.hasErrors());
+        ASSERT_EQUALS(2500U, _server.getDocuments(kNamespace).size());
+
+        // maxWriteBatchSize is 1000: three batches, each on its own connection.
+        ASSERT_EQUALS(3U, _server.getConnectionCount());
+    }
+
+    TEST_F(BulkOperationBuilderTest, ConcurrentWriteErrorsUseBulkIndexes) {
+        _server.insert(kNamespace, BSON("_id" << 10));
+        _server.insert(kNamespace, BSON("_id" << 1500));
+        _server.insert(kNamespace, BSON("_id" << 2300));
+
+        BulkOperationBuilder bulk = _conn.initializeUnorderedBulkOp(kNamespace);
+        for (int i = 0; i < 2500; ++i) {
+            bulk.insert(BSON("_id" << i));
+        }
+
+        WriteResult result;
+        ASSERT_THROWS(executeConcurrently(&bulk, &result), mongo::OperationException);
+
+        ASSERT_EQUALS(2497, result.nInserted());
+        ASSERT_EQUALS(3U, result.writeErrors().size());
+        ASSERT_EQUALS(10, result.writeErrors()[0]["index"].numberInt());
+        ASSERT_EQUALS(1500, result.writeErrors()[1]["index"].numberInt());
+        ASSERT_EQUALS(2300, result.writeErrors()[2]["index"].numberInt());
+    }
+
+    TEST_F(BulkOperationBuilderTest, ConcurrentExecutionRequiresUnordered) {
+        BulkOperationBuilder bulk = _conn.initializeOrderedBulkOp(kNamespace);
+        bulk.insert(BSON("_id" << 1));
+
+        WriteResult result;
+        ASSERT_THROWS(executeConcurrently(&bulk, &result), mongo::UserException);
+    }
+
+} // namespace
@@ -0,0 +1,254 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kNetworking
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/client/bulk_writer.h"
+
+#include <boost/thread/locks.hpp>
+
+#include "mongo/client/dbclientinterface.h"
+#include "mongo/client/delete_write_operation.h"
+#include "mongo/client/exceptions.h"
+#include "mongo/client/insert_write_operation.h"
+#include "mongo/client/update_write_operation.h"
+#include "mongo/db/jsobj.h"
+#include "mongo/util/assert_util.h"
+#include "mongo/util/log.h"
+
+namespace mongo {
+
+    namespace {
+        // Room for the command document around the batch array.
+        const int kCommandOverheadBytes = 16 * 1024;
+    } // namespace
+
+    BulkWriter::BulkWriter(const ConnectionFactory& connectionFactory,
+                           const std::string& ns,
+                           const WriteConcern& writeConcern,
+                           const ResultCallback& callback,
+                           size_t maxInFlightBatches)
+        : _connectionFactory(connectionFactory)
+        , _ns(ns)
+        , _writeConcern(writeConcern)
+        , _callback(callback)
+        , _maxInFlightBatches(maxInFlightBatches)
+        , _maxWriteBatchSize(0)
+        , _maxBatchBytes(0)
+        , _nextIndex(0)
+        , _inFlight(0)
+        , _shutdown(false) {
+
+        uassert(18734, "a BulkWriter needs at least one connection", maxInFlightBatches > 0);
+        _current.bytes = 0;
+        _current.arena.reset(new BSONArena());
+
+        try {
+            for (size_t i = 0; i < _maxInFlightBatches; ++i) {
+                _connections.push_back(_connectionFactory());
+            }
+        }
+        catch (...) {
+            for (size_t i = 0; i < _connections.size(); ++i)
+                delete _connections[i];
+            throw;
+        }
+
+        _maxWriteBatchSize = _connections.front()->getMaxWriteBatchSize();
+        _maxBatchBytes = _connections.front()->getMaxBsonObjectSize() - kCommandOverheadBytes;
+
+        for (size_t i = 0; i < _maxInFlightBatches; ++i) {
+            _workers.create_thread(stdx::bind(&BulkWriter::_work, this, i));
+        }
+    }
+
+    BulkWriter::~BulkWriter() {
+        DESTRUCTOR_GUARD(
+            waitForAll();
+        );
+
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            _shutdown = true;
+            _notEmpty.notify_all();
+        }
+        _workers.join_all();
+
+        // Only left over if waitForAll() failed.
+        _deleteOps(&_current);
+        for (std::deque<Batch>::iterator it = _queue.begin(); it != _queue.end(); ++it)
+            _deleteOps(&*it);
+
+        for (size_t i = 0; i < _connections.size(); ++i)
+            delete _connections[i];
+    }
+
+    void BulkWriter::insert(const BSONObj& doc) {
+        boost::unique_lock<boost::mutex> lk(_mutex);
+
+        // Adds the _id here rather than in InsertWriteOperation, which would allocate.
+        BSONObj withId = doc;
+        if (!doc.hasField("_id")) {
+            _scratch.reset();
+            BSONObjBuilder b(_scratch);
+            b.append("_id", OID::gen());
+            b.appendElements(doc);
+            withId = b.done();
+        }
+
+        _makeRoom_inlock(lk, withId.objsize());
+        _enqueue_inlock(lk, new InsertWriteOperation(_current.arena->copy(withId)));
+    }
+
+    void BulkWriter::update(const BSONObj& selector, const BSONObj& update,
+                            bool upsert, bool multi) {
+        int flags = 0;
+        if (upsert)
+            flags |= UpdateOption_Upsert;
+        if (multi)
+            flags |= UpdateOption_Multi;
+
+        boost::unique_lock<boost::mutex> lk(_mutex);
+        _makeRoom_inlock(lk, selector.objsize() + update.objsize());
+        _enqueue_inlock(lk, new UpdateWriteOperation(_current.arena->copy(selector),
+                                                     _current.arena->copy(update),
+                                                     flags));
+    }
+
+    void BulkWriter::remove(const BSONObj& selector, bool justOne) {
+        boost::unique_lock<boost::mutex> lk(_mutex);
+        _makeRoom_inlock(lk, selector.objsize());
+        _enqueue_inlock(lk, new DeleteWriteOperation(_current.arena->copy(selector),
+                                                     justOne ? RemoveOption_JustOne : 0));
+    }
+
+    void BulkWriter::flush() {
+        boost::unique_lock<boost::mutex> lk(_mutex);
+        _flush_inlock(lk);
+    }
+
+    void BulkWriter::waitForAll() {
+        boost::unique_lock<boost::mutex> lk(_mutex);
+        _flush_inlock(lk);
+        while (!_queue.empty() || _inFlight > 0) {
+            _idle.wait(lk);
+        }
+    }
+
+    void BulkWriter::_makeRoom_inlock(boost::unique_lock<boost::mutex>& lk, int size) {
+        if (!_current.ops.empty() && _current.bytes + size > _maxBatchBytes)
+            _flush_inlock(lk);
+    }
+
+    void BulkWriter::_enqueue_inlock(boost::unique_lock<boost::mutex>& lk, WriteOperation* op) {
+        op->setBulkIndex(_nextIndex++);
+        _current.ops.push_back(op);
+        _current.bytes += op->incrementalSize();
+
+        if (_current.ops.size() >= static_cast<size_t>(_maxWriteBatchSize))
+            _flush_inlock(lk);
+    }
+
+    void BulkWriter::_flush_inlock(boost::unique_lock<boost::mutex>& lk) {
+        if (_current.ops.empty())
+            return;
+
+        // Bounds memory: at most one batch per connection may wait to be sent.
+        while (_queue.size() >= _maxInFlightBatches) {
+            _notFull.wait(lk);
+        }
+
+        _queue.push_back(Batch());
+        _queue.back().ops.swap(_current.ops);
+        _queue.back().bytes = _current.bytes;
+        _queue.back().arena.swap(_current.arena);
+        _current.bytes = 0;
+        _current.arena.reset(new BSONArena());
+        _notEmpty.notify_one();
+    }
+
+    void BulkWriter::_work(size_t connectionIndex) {
+        while (true) {
+            Batch batch;
+            {
+                boost::unique_lock<boost::mutex> lk(_mutex);
+                while (_queue.empty() && !_shutdown) {
+                    _notEmpty.wait(lk);
+                }
+                if (_queue.empty())
+                    return;
+
+                batch.ops.swap(_queue.front().ops);
+                batch.bytes = _queue.front().bytes;
+                batch.arena.swap(_queue.front().arena);
+                _queue.pop_front();
+                ++_inFlight;
+                _notFull.notify_one();
+            }
+
+            WriteResult result;
+            const Status status = _send(connectionIndex, batch, &result);
+            _deleteOps(&batch);
+
+            try {
+                _callback(status, result);
+            }
+            catch (const std::exception& ex) {
+                warning() << "BulkWriter result callback threw: " << ex.what() << std::endl;
+            }
+
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            if (--_inFlight == 0 && _queue.empty())
+                _idle.notify_all();
+        }
+    }
+
+    Status BulkWriter::_send(size_t connectionIndex, const Batch& batch, WriteResult* result) {
+        try {
+            DBClientBase*& conn = _connections[connectionIndex];
+            if (conn->isFailed()) {
+                LOG(1) << "BulkWriter replacing failed connection to "
+                       << conn->getServerAddress() << std::endl;
+                DBClientBase* replacement = _connectionFactory();
+                delete conn;
+                conn = replacement;
+            }
+
+            conn->_write(_ns, batch.ops, false, &_writeConcern, result);
+            return Status::OK();
+        }
+        catch (const OperationException& ex) {
+            // a write error, which 'result' also lists
+            const int code = ex.obj()["code"].numberInt();
+            return Status(code ? static_cast<ErrorCodes::Error>(code) : ErrorCodes::UnknownError,
+                          ex.what());
+        }
+        catch (const DBException& ex) {
+            return ex.toStatus();
+        }
+        catch (const std::exception& ex) {
+            return Status(ErrorCodes::UnknownError, ex.what());
+        }
+    }
+
+    void BulkWriter::_deleteOps(Batch* batch) {
+        for (size_t i = 0; i < batch->ops.size(); ++i)
+            delete batch->ops[i];
+        batch->ops.clear();
+    }
+
+} // namespace mongo
@@ -0,0 +1,154 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "mongo/base/status.h"
+#include "mongo/bson/bsonobj.h"
+#include "mongo/bson/util/bson_arena.h"
+#include "mongo/bson/util/builder.h"
+#include "mongo/client/export_macros.h"
+#include "mongo/client/write_concern.h"
+#include "mongo/client/write_result.h"
+#include "mongo/stdx/functional.h"
+
+namespace mongo {
+
+    class DBClientBase;
+    class WriteOperation;
+
+    /**
+     * A long-lived, unordered bulk writer for streams of writes of unbounded length.
+     *
+     * Unlike BulkOperationBuilder, which keeps every operation until execute(), a BulkWriter
+     * cuts the stream into batches as it goes. A batch is closed as soon as it holds the
+     * server's maxWriteBatchSize operations or would grow beyond its maxBsonObjectSize, and is
+     * then handed to one of 'maxInFlightBatches' background threads, each sending on a
+     * connection of its own. The producer only waits when all of them are busy and as many
+     * closed batches are already waiting, so memory use stays bounded.
+     *
+     *   BulkWriter writer(factory, "test.foo", WriteConcern::acknowledged, callback);
+     *   while (...)
+     *       writer.insert(doc);
+     *   writer.waitForAll();
+     *
+     * The outcome of each batch is passed to the result callback. Batches may be sent, and
+     * complete, in any order; the "index" of a write error is the position of the failed
+     * operation in the whole stream.
+     *
+     * The documents of a batch are copied into a BSONArena of its own, which is released in
+     * one go once the batch has been sent.
+     */
+    class MONGO_CLIENT_API BulkWriter : private boost::noncopyable {
+    public:
+        static const size_t kDefaultMaxInFlightBatches = 2;
+
+        typedef stdx::function<DBClientBase* ()> ConnectionFactory;
+
+        /**
+         * Receives the outcome of one batch: a non-OK status if the batch failed outright
+         * (including write errors, which are also listed in the result), and what the server
+         * reported for it. Called on the background threads, possibly concurrently, and must
+         * not throw.
+         */
+        typedef stdx::function<void (const Status&, const WriteResult&)> ResultCallback;
+
+        /**
+         * Opens 'maxInFlightBatches' connections through 'connectionFactory'; the writer owns
+         * them. A connection found to have failed is replaced through the factory before its
+         * next batch.
+         */
+        BulkWriter(const ConnectionFactory& connectionFactory,
+                   const std::string& ns,
+                   const WriteConcern& writeConcern,
+                   const ResultCallback& callback,
+                   size_t maxInFlightBatches = kDefaultMaxInFlightBatches);
+
+        /** Sends everything still buffered, waits for it and stops the background threads. */
+        ~BulkWriter();
+
+        void insert(const BSONObj& doc);
+
+        void update(const BSONObj& selector, const BSONObj& update,
+                    bool upsert = false, bool multi = false);
+
+        void remove(const BSONObj& selector, bool justOne = false);
+
+        /** Closes the current batch, if any, so that it is sent without waiting for more. */
+        void flush();
+
+        /** Flushes and waits until every batch has been sent and reported. */
+        void waitForAll();
+
+    private:
+        struct Batch {
+            std::vector<WriteOperation*> ops;
+            int bytes;
+            boost::shared_ptr<BSONArena> arena;  // holds the documents of 'ops'
+        };
+
+        // Closes the current batch if it can't take another 'size' bytes. Writes must be
+        // copied into the current batch's arena only after this.
+        void _makeRoom_inlock(boost::unique_lock<boost::mutex>& lk, int size);
+
+        void _enqueue_inlock(boost::unique_lock<boost::mutex>& lk, WriteOperation* op);
+
+        // Hands the current batch to the background threads.
+        void _flush_inlock(boost::unique_lock<boost::mutex>& lk);
+
+        void _work(size_t connectionIndex);
+
+        // Sends 'batch' on connection 'connectionIndex', reconnecting if necessary.
+        Status _send(size_t connectionIndex, const Batch& batch, WriteResult* result);
+
+        static void _deleteOps(Batch* batch);
+
+        const ConnectionFactory _connectionFactory;
+        const std::string _ns;
+        const WriteConcern _writeConcern;
+        const ResultCallback _callback;
+        const size_t _maxInFlightBatches;
+
+        // Batch limits, from the first connection's isMaster.
+        int _maxWriteBatchSize;
+        int _maxBatchBytes;
+
+        // _connections[i] is only used by the i-th background thread.
+        std::vector<DBClientBase*> _connections;
+        boost::thread_group _workers;
+
+        // Protects everything below
+        boost::mutex _mutex;
+        boost::condition_variable _notEmpty;
+        boost::condition_variable _notFull;
+        boost::condition_variable _idle;
+        Batch _current;
+        BufBuilder _scratch;        // for adding an _id to inserted documents
+        size_t _nextIndex;
+        std::deque<Batch> _queue;
+        size_t _inFlight;
+        bool _shutdown;
+    };
+
+} // namespace mongo
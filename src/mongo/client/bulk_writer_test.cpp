@@ -0,0 +1,154 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/client/bulk_writer.h"
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <string>
+
+#include "mongo/client/dbclientinterface.h"
+#include "mongo/dbtests/mock/mock_wire_server.h"
+#include "mongo/unittest/unittest.h"
+
+namespace {
+
+    using mongo::BSONObj;
+    using mongo::BulkWriter;
+    using mongo::MockWireServer;
+    using mongo::Status;
+    using mongo::WriteConcern;
+    using mongo::WriteResult;
+
+    const char kNamespace[] = "test.foo";
+
+    // Records the status of every batch reported to it.
+    class Results {
+    public:
+        void onBatch(const Status& status, const WriteResult& result) {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            statuses.push_back(status);
+        }
+
+        std::vector<Status> statuses;
+
+    private:
+        boost::mutex _mutex;
+    };
+
+    class BulkWriterTest : public mongo::unittest::Test {
+    protected:
+        BulkWriter* makeWriter(size_t maxInFlightBatches) {
+            return new BulkWriter(mongo::stdx::bind(&MockWireServer::connect, &_server),
+                                  kNamespace,
+                                  WriteConcern::acknowledged,
+                                  mongo::stdx::bind(&Results::onBatch, &_results,
+                                                    mongo::stdx::placeholders::_1,
+                                                    mongo::stdx::placeholders::_2),
+                                  maxInFlightBatches);
+        }
+
+        MockWireServer _server;
+        Results _results;
+    };
+
+    TEST_F(BulkWriterTest, BatchesByCount) {
+        boost::scoped_ptr<BulkWriter> writer(makeWriter(2));
+        for (int i = 0; i < 2500; ++i) {
+            writer->insert(BSON("_id" << i));
+        }
+        writer->waitForAll();
+
+        // maxWriteBatchSize is 1000
+        ASSERT_EQUALS(3U, _results.statuses.size());
+        for (size_t i = 0; i < _results.statuses.size(); ++i) {
+            ASSERT_OK(_results.statuses[i]);
+        }
+        ASSERT_EQUALS(2500U, _server.getDocuments(kNamespace).size());
+        ASSERT_EQUALS(2U, _server.getConnectionCount());
+    }
+
+    TEST_F(BulkWriterTest, BatchesByBytes) {
+        const std::string padding(1024 * 1024, 'x');
+
+        boost::scoped_ptr<BulkWriter> writer(makeWriter(1));
+        for (int i = 0; i < 40; ++i) {
+            writer->insert(BSON("_id" << i << "padding" << padding));
+        }
+        writer->waitForAll();
+
+        // At most 15 of these fit under maxBsonObjectSize (16MB).
+        ASSERT_EQUALS(3U, _results.statuses.size());
+        ASSERT_EQUALS(40U, _server.getDocuments(kNamespace).size());
+    }
+
+    TEST_F(BulkWriterTest, DestructorFlushes) {
+        {
+            boost::scoped_ptr<BulkWriter> writer(makeWriter(2));
+            writer->insert(BSON("_id" << 1));
+            writer->insert(BSON("_id" << 2));
+        }
+
+        ASSERT_EQUALS(1U, _results.statuses.size());
+        ASSERT_OK(_results.statuses[0]);
+        ASSERT_EQUALS(2U, _server.getDocuments(kNamespace).size());
+    }
+
+    TEST_F(BulkWriterTest, DocumentsAreCopied) {
+        boost::scoped_ptr<BulkWriter> writer(makeWriter(1));
+
+        // Builds every document in the same buffer, so each insert must take a copy.
+        mongo::BufBuilder scratch;
+        for (int i = 0; i < 100; ++i) {
+            scratch.reset();
+            mongo::BSONObjBuilder b(scratch);
+            b.append("n", i);
+            writer->insert(b.done());
+        }
+        writer->update(BSON("n" << 1), BSON("$set" << BSON("updated" << true)));
+        writer->remove(BSON("n" << 2));
+        writer->waitForAll();
+
+        const std::vector<BSONObj> docs = _server.getDocuments(kNamespace);
+        ASSERT_EQUALS(100U, docs.size());
+        for (int i = 0; i < 100; ++i) {
+            ASSERT_EQUALS(mongo::jstOID, docs[i]["_id"].type());
+            ASSERT_EQUALS(i, docs[i]["n"].numberInt());
+        }
+    }
+
+    TEST(BulkWriter, ReportsFailedBatches) {
+        Results results;
+        boost::scoped_ptr<MockWireServer> server(new MockWireServer());
+        boost::scoped_ptr<BulkWriter> writer(
+            new BulkWriter(mongo::stdx::bind(&MockWireServer::connect, server.get()),
+                           kNamespace,
+                           WriteConcern::acknowledged,
+                           mongo::stdx::bind(&Results::onBatch, &results,
+                                             mongo::stdx::placeholders::_1,
+                                             mongo::stdx::placeholders::_2)));
+
+        server.reset();
+        writer->insert(BSON("_id" << 1));
+        writer->waitForAll();
+
+        ASSERT_EQUALS(1U, results.statuses.size());
+        ASSERT_NOT_OK(results.statuses[0]);
+    }
+
+} // namespace
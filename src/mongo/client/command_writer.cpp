@@ -17,16 +17,30 @@
 
 #include "mongo/client/command_writer.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include "mongo/client/dbclientinterface.h"
 #include "mongo/client/write_result.h"
+#include "mongo/db/dbmessage.h"
 #include "mongo/db/namespace_string.h"
+#include "mongo/util/net/message.h"
 
 namespace mongo {
 
     const int kOverhead = 8 * 1024;
     const char kOrderedKey[] = "ordered";
 
-    CommandWriter::CommandWriter(DBClientBase* client) : _client(client) {
+    namespace {
+        // Bounds on the size a request buffer starts at. A buffer that must grow beyond the
+        // upper bound only does so for the large writes that need it.
+        const int kMinRequestSizeHint = 512;
+        const int kMaxRequestSizeHint = 256 * 1024;
+    } // namespace
+
+    CommandWriter::CommandWriter(DBClientBase* client)
+        : _client(client)
+        , _requestSizeHint(kMinRequestSizeHint) {
     }
 
     void CommandWriter::write(
@@ -42,27 +56,37 @@ namespace mongo {
         std::vector<WriteOperation*>::const_iterator batch_begin = write_operations.begin();
         const std::vector<WriteOperation*>::const_iterator end = write_operations.end();
 
+        // Reused by every batch of this write.
+        BufBuilder request(_requestSizeHint);
+
         while (batch_begin != end) {
 
-            boost::scoped_ptr<BSONObjBuilder> command(new BSONObjBuilder);
-            boost::scoped_ptr<BSONArrayBuilder> batch(new BSONArrayBuilder);
+            // The command is encoded in a single pass, straight into the body of the OP_QUERY
+            // that carries it: the nested builders write in place and patch their lengths
+            // when done, so the documents are copied exactly once.
+            request.reset();
+            _startRequest(ns, &request);
+            const int commandStart = request.len();
+
+            BSONObjBuilder command(request);
             std::vector<WriteOperation*>::const_iterator batch_iter = batch_begin;
 
             // We must be able to fit the first item of the batch. Otherwise, the calling code
             // passed an over size write operation in violation of our contract.
-            invariant(_fits(batch.get(), *batch_iter));
+            invariant(_fits(0, *batch_iter));
 
             // Set the current operation type
             const WriteOpType batchOpType = (*batch_iter)->operationType();
 
             // Begin the command for this batch.
-            (*batch_iter)->startCommand(ns.toString(), command.get());
+            (*batch_iter)->startCommand(ns.toString(), &command);
+            BSONArrayBuilder batch(command.subarrayStart((*batch_iter)->batchName()));
 
             while (true) {
 
                 // Always safe to append here: either we just entered the loop, or all the
                 // checks below passed.
-                (*batch_iter)->appendSelfToCommand(batch.get());
+                (*batch_iter)->appendSelfToCommand(&batch);
 
                 // Associate batch index with WriteOperation
                 batchOps.push_back(*batch_iter);
@@ -84,7 +108,7 @@ namespace mongo {
                     break;
 
                 // If we can't put the next item into the current batch, issue what we have.
-                if (!_fits(batch.get(), *next))
+                if (!_fits(request.len() - commandStart, *next))
                     break;
 
                 // OK to proceed to next op.
@@ -92,10 +116,12 @@ namespace mongo {
             }
 
             // End the command for this batch.
-            _endCommand(batch.get(), *batch_iter, ordered, command.get());
+            _endCommand(&batch, ordered, writeConcern, &command);
+            _requestSizeHint = std::min(std::max(request.len(), kMinRequestSizeHint),
+                                        kMaxRequestSizeHint);
 
             // Issue the complete command.
-            BSONObj batchResult = _send(command.get(), writeConcern, ns);
+            BSONObj batchResult = _send(&request);
 
             // Merge this batch's result into the result for all batches written.
             writeResult->_mergeCommandResult(batchOps, batchResult);
@@ -112,37 +138,68 @@ namespace mongo {
 
     }
 
-    bool CommandWriter::_fits(BSONArrayBuilder* builder, WriteOperation* operation) {
+    bool CommandWriter::_fits(int commandSize, WriteOperation* operation) {
         int opSize = operation->incrementalSize();
         int maxSize = _client->getMaxBsonObjectSize();
 
         // This update is too large to ever be sent as a command, assert
         uassert(0, "update command exceeds maxBsonObjectSize", opSize <= maxSize);
 
-        return (builder->len() + opSize + kOverhead) <= maxSize;
+        return (commandSize + opSize + kOverhead) <= maxSize;
+    }
+
+    void CommandWriter::_startRequest(const StringData& ns, BufBuilder* request) {
+        // Message header, filled in by _send(), then the OP_QUERY preamble of a findOne on
+        // the database's $cmd collection.
+        request->skip(sizeof(MSGHEADER::Value));
+        request->appendNum(0); // query options
+        request->appendStr(nsToDatabase(ns) + ".$cmd");
+        request->appendNum(0); // nToSkip
+        request->appendNum(-1); // nToReturn
     }
 
     void CommandWriter::_endCommand(
         BSONArrayBuilder* batch,
-        WriteOperation* operation,
         bool ordered,
+        const WriteConcern* writeConcern,
         BSONObjBuilder* command
     ) {
-        command->append(operation->batchName(), batch->arr());
+        batch->done();
         command->append(kOrderedKey, ordered);
+        command->append("writeConcern", writeConcern->obj());
+
+        // What runCommand() would have done
+        if (DBClientWithCommands::RunCommandHookFunc hook = _client->getRunCommandHook())
+            hook(command);
+
+        command->done();
     }
 
-    BSONObj CommandWriter::_send(
-        BSONObjBuilder* command,
-        const WriteConcern* writeConcern,
-        const StringData& ns
-    ) {
-        command->append("writeConcern", writeConcern->obj());
+    BSONObj CommandWriter::_send(BufBuilder* request) {
+        Message toSend;
+        toSend.appendBorrowedData(request->buf(), request->len());
+        toSend.header().setOperation(dbQuery);
+
+        Message response;
+        _client->call(toSend, response);
+
+        QueryResult::View reply = response.singleData().view2ptr();
+        uassert(18735, "write command returned no reply document", reply.getNReturned() == 1);
+        // Lets a replica set connection notice a "not master" error, as a cursor would.
+        bool retry;
+        std::string host;
+        _client->checkResponse(reply.data(), reply.getNReturned(), &retry, &host);
+
+        BSONObj result = BSONObj(reply.data()).getOwned();
+
+        // A query failure, which runCommand() raises through DBClientCursor::nextSafe().
+        if (std::strcmp(result.firstElementFieldName(), "$err") == 0)
+            uasserted(13106, "nextSafe(): " + result.toString());
 
-        BSONObj result;
-        bool commandWorked = _client->runCommand(nsToDatabase(ns), command->obj(), result);
+        if (DBClientWithCommands::PostRunCommandHookFunc hook = _client->getPostRunCommandHook())
+            hook(result, _client->getServerAddress());
 
-        if (!commandWorked) throw OperationException(result);
+        if (!result["ok"].trueValue()) throw OperationException(result);
 
         return result;
     }
@@ -34,21 +34,24 @@ namespace mongo {
         );
 
     private:
+        void _startRequest(const StringData& ns, BufBuilder* request);
+
         void _endCommand(
             BSONArrayBuilder* batch,
-            WriteOperation* op, bool ordered,
+            bool ordered,
+            const WriteConcern* writeConcern,
             BSONObjBuilder* command
         );
 
-        BSONObj _send(
-            BSONObjBuilder* command,
-            const WriteConcern* writeConcern,
-            const StringData& ns
-        );
+        BSONObj _send(BufBuilder* request);
 
-        bool _fits(BSONArrayBuilder* builder, WriteOperation* operation);
+        bool _fits(int commandSize, WriteOperation* operation);
 
         DBClientBase* const _client;
+
+        // What the next write's request buffer starts at: the size of the last request, within
+        // bounds. Like the rest of the connection, only used by one thread at a time.
+        int _requestSizeHint;
     };
 
 } // namespace mongo
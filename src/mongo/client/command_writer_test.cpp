@@ -0,0 +1,105 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/client/command_writer.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mongo/client/bulk_operation_builder.h"
+#include "mongo/client/dbclientinterface.h"
+#include "mongo/dbtests/mock/mock_wire_server.h"
+#include "mongo/unittest/unittest.h"
+
+namespace {
+
+    using mongo::BSONObj;
+    using mongo::BSONObjBuilder;
+    using mongo::DBClientConnection;
+    using mongo::MockWireServer;
+    using mongo::WriteConcern;
+    using mongo::WriteResult;
+
+    void markCalled(bool* called, BSONObjBuilder* command) {
+        *called = true;
+    }
+
+    class CommandWriterTest : public mongo::unittest::Test {
+    protected:
+        void setUp() {
+            // Write commands are used from wire version 2 on.
+            _server.setMaxWireVersion(2);
+
+            std::string errmsg;
+            ASSERT_TRUE(_conn.connect(_server.getHostAndPort(), errmsg));
+            ASSERT_EQUALS(2, _conn.getMaxWireVersion());
+        }
+
+        MockWireServer _server;
+        DBClientConnection _conn;
+    };
+
+    TEST_F(CommandWriterTest, BatchedInsertArrivesIntact) {
+        const std::string padding(1000, 'x');
+
+        std::vector<BSONObj> docs;
+        for (int i = 0; i < 1500; ++i) {
+            docs.push_back(BSON("_id" << i << "padding" << padding));
+        }
+        _conn.insert("test.foo", docs, 0, &WriteConcern::acknowledged);
+
+        // maxWriteBatchSize is 1000, so this takes two commands, and no OP_INSERT.
+        ASSERT_EQUALS(0U, _server.getOpCount(mongo::dbInsert));
+
+        const std::vector<BSONObj> stored = _server.getDocuments("test.foo");
+        ASSERT_EQUALS(docs.size(), stored.size());
+        for (size_t i = 0; i < docs.size(); ++i) {
+            ASSERT_EQUALS(docs[i], stored[i]);
+        }
+    }
+
+    TEST_F(CommandWriterTest, ResultIsMerged) {
+        std::auto_ptr<mongo::BulkOperationBuilder> bulk(
+            new mongo::BulkOperationBuilder(&_conn, "test.foo", true));
+        for (int i = 0; i < 10; ++i) {
+            bulk->insert(BSON("_id" << i));
+        }
+
+        WriteResult result;
+        bulk->execute(&WriteConcern::acknowledged, &result);
+        ASSERT_EQUALS(10, result.nInserted());
+        ASSERT_FALSE(result.hasErrors());
+    }
+
+    TEST_F(CommandWriterTest, QueryFailureIsUserException) {
+        _server.setQueryFailure("insert");
+        ASSERT_THROWS(_conn.insert("test.foo", BSON("_id" << 1), 0, &WriteConcern::acknowledged),
+                      mongo::UserException);
+    }
+
+    TEST_F(CommandWriterTest, RunCommandHookIsApplied) {
+        bool hookCalled = false;
+        _conn.setRunCommandHook(mongo::stdx::bind(&markCalled, &hookCalled,
+                                                  mongo::stdx::placeholders::_1));
+        _conn.insert("test.foo", BSON("_id" << 1), 0, &WriteConcern::acknowledged);
+
+        ASSERT_TRUE(hookCalled);
+        ASSERT_EQUALS(1U, _server.getDocuments("test.foo").size());
+    }
+
+} // namespace
@@ -0,0 +1,312 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kNetworking
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/client/connection_pool.h"
+
+#include <memory>
+
+#include "mongo/util/assert_util.h"
+#include "mongo/util/log.h"
+#include "mongo/util/mongoutils/str.h"
+#include "mongo/util/time_support.h"
+#include "mongo/util/timer.h"
+
+namespace mongo {
+
+    namespace {
+        void deleteAll(const std::vector<DBClientBase*>& conns) {
+            for (std::vector<DBClientBase*>::const_iterator it = conns.begin();
+                 it != conns.end(); ++it) {
+                delete *it;
+            }
+        }
+    } // namespace
+
+    ConnectionPool::Options::Options()
+        : _maxPoolSize(kDefaultMaxPoolSize)
+        , _minPoolSize(kDefaultMinPoolSize)
+        , _maxIdleTimeMillis(0)
+        , _waitQueueTimeoutMillis(0)
+        , _socketTimeoutSecs(0) {
+    }
+
+    ConnectionPool::Options& ConnectionPool::Options::setMaxPoolSize(size_t value) {
+        _maxPoolSize = value;
+        return *this;
+    }
+
+    ConnectionPool::Options& ConnectionPool::Options::setMinPoolSize(size_t value) {
+        _minPoolSize = value;
+        return *this;
+    }
+
+    ConnectionPool::Options& ConnectionPool::Options::setMaxIdleTimeMillis(unsigned int millis) {
+        _maxIdleTimeMillis = millis;
+        return *this;
+    }
+
+    ConnectionPool::Options& ConnectionPool::Options::setWaitQueueTimeoutMillis(
+        unsigned int millis) {
+        _waitQueueTimeoutMillis = millis;
+        return *this;
+    }
+
+    ConnectionPool::Options& ConnectionPool::Options::setSocketTimeoutSecs(double secs) {
+        _socketTimeoutSecs = secs;
+        return *this;
+    }
+
+    ConnectionPool::Options& ConnectionPool::Options::setAuthParams(const BSONObj& params) {
+        _authParams = params.getOwned();
+        return *this;
+    }
+
+    ConnectionPool::ScopedConnection::ScopedConnection(ConnectionPool& pool,
+                                                       const HostAndPort& host)
+        : _pool(pool)
+        , _host(host)
+        , _conn(pool.acquire(host)) {
+    }
+
+    ConnectionPool::ScopedConnection::~ScopedConnection() {
+        if (_conn) {
+            LOG(1) << "scoped connection to " << _host.toString()
+                   << " not being returned to the pool" << std::endl;
+            _pool.discard(_host, _conn);
+        }
+    }
+
+    DBClientBase* ConnectionPool::ScopedConnection::get() const {
+        uassert(18710, "scoped connection has already been returned to the pool", _conn);
+        return _conn;
+    }
+
+    void ConnectionPool::ScopedConnection::done() {
+        if (!_conn)
+            return;
+        _pool.release(_host, _conn);
+        _conn = NULL;
+    }
+
+    ConnectionPool::ConnectionPool(const Options& options) : _options(options) {
+        uassert(18711, "connection pool maxPoolSize must be positive", options.maxPoolSize() > 0);
+        uassert(18712, "connection pool minPoolSize can't exceed maxPoolSize",
+                options.minPoolSize() <= options.maxPoolSize());
+    }
+
+    ConnectionPool::~ConnectionPool() {
+        clear();
+    }
+
+    DBClientBase* ConnectionPool::acquire(const HostAndPort& host) {
+        const unsigned int timeoutMillis = _options.waitQueueTimeoutMillis();
+        Timer waitTimer;
+
+        while (true) {
+            DBClientBase* candidate = NULL;
+            std::vector<DBClientBase*> expired;
+            {
+                boost::unique_lock<boost::mutex> lk(_mutex);
+                HostPool& hostPool = _pools[host];
+
+                while (true) {
+                    _reapIdle_inlock(&hostPool, curTimeMillis64(), &expired);
+
+                    if (!hostPool.idle.empty()) {
+                        candidate = hostPool.idle.back().conn;
+                        hostPool.idle.pop_back();
+                        break;
+                    }
+
+                    if (hostPool.inUse < _options.maxPoolSize())
+                        break;
+
+                    if (timeoutMillis == 0) {
+                        _slotAvailable.wait(lk);
+                        continue;
+                    }
+
+                    const int remaining = static_cast<int>(timeoutMillis) - waitTimer.millis();
+                    if (remaining <= 0 ||
+                        !_slotAvailable.timed_wait(lk, boost::posix_time::milliseconds(remaining))) {
+
+                        // Recheck once more: we may have been signalled right at the deadline.
+                        if (hostPool.idle.empty() && hostPool.inUse >= _options.maxPoolSize()) {
+                            lk.unlock();
+                            deleteAll(expired);
+                            uasserted(18713, str::stream()
+                                      << "timed out after " << timeoutMillis
+                                      << "ms waiting for a connection to " << host.toString()
+                                      << " (maxPoolSize: " << _options.maxPoolSize() << ")");
+                        }
+                    }
+                }
+
+                // Reserve the slot before dropping the lock so that concurrent acquirers see it.
+                hostPool.inUse++;
+            }
+
+            // Closing sockets and health checks may block, so never do them under the lock.
+            deleteAll(expired);
+
+            if (!candidate)
+                return _connect(host);
+
+            if (_isHealthy(candidate))
+                return candidate;
+
+            LOG(1) << "dropping unhealthy pooled connection to " << host.toString() << std::endl;
+            discard(host, candidate);
+        }
+    }
+
+    void ConnectionPool::release(const HostAndPort& host, DBClientBase* conn) {
+        if (!_isHealthy(conn) || !_flushCursorKills(conn)) {
+            discard(host, conn);
+            return;
+        }
+
+        std::vector<DBClientBase*> expired;
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            HostPool& hostPool = _pools[host];
+            invariant(hostPool.inUse > 0);
+
+            const unsigned long long now = curTimeMillis64();
+            hostPool.inUse--;
+            hostPool.idle.push_back(IdleConnection(conn, now));
+            _reapIdle_inlock(&hostPool, now, &expired);
+        }
+        _slotAvailable.notify_all();
+        deleteAll(expired);
+    }
+
+    void ConnectionPool::discard(const HostAndPort& host, DBClientBase* conn) {
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            HostPool& hostPool = _pools[host];
+            invariant(hostPool.inUse > 0);
+            hostPool.inUse--;
+        }
+        _slotAvailable.notify_all();
+        delete conn;
+    }
+
+    void ConnectionPool::reapIdleConnections() {
+        std::vector<DBClientBase*> expired;
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            const unsigned long long now = curTimeMillis64();
+            for (HostPoolMap::iterator it = _pools.begin(); it != _pools.end(); ++it) {
+                _reapIdle_inlock(&it->second, now, &expired);
+            }
+        }
+        deleteAll(expired);
+    }
+
+    void ConnectionPool::clear() {
+        std::vector<DBClientBase*> idle;
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            for (HostPoolMap::iterator it = _pools.begin(); it != _pools.end(); ++it) {
+                std::deque<IdleConnection>& hostIdle = it->second.idle;
+                for (size_t i = 0; i < hostIdle.size(); ++i) {
+                    idle.push_back(hostIdle[i].conn);
+                }
+                hostIdle.clear();
+            }
+        }
+        deleteAll(idle);
+    }
+
+    size_t ConnectionPool::getNumIdle(const HostAndPort& host) const {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        HostPoolMap::const_iterator it = _pools.find(host);
+        return it == _pools.end() ? 0 : it->second.idle.size();
+    }
+
+    size_t ConnectionPool::getNumInUse(const HostAndPort& host) const {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        HostPoolMap::const_iterator it = _pools.find(host);
+        return it == _pools.end() ? 0 : it->second.inUse;
+    }
+
+    void ConnectionPool::_reapIdle_inlock(HostPool* hostPool,
+                                          unsigned long long now,
+                                          std::vector<DBClientBase*>* expired) {
+        const unsigned long long maxIdle = _options.maxIdleTimeMillis();
+        if (maxIdle == 0)
+            return;
+
+        // The front of the queue holds the connections that have been idle the longest.
+        while (hostPool->idle.size() + hostPool->inUse > _options.minPoolSize() &&
+               !hostPool->idle.empty() &&
+               now - hostPool->idle.front().lastUsedMillis > maxIdle) {
+            expired->push_back(hostPool->idle.front().conn);
+            hostPool->idle.pop_front();
+        }
+    }
+
+    DBClientBase* ConnectionPool::_connect(const HostAndPort& host) {
+        std::auto_ptr<DBClientBase> conn;
+        try {
+            std::string errmsg;
+            conn.reset(ConnectionString(host).connect(errmsg, _options.socketTimeoutSecs()));
+            uassert(18714, str::stream() << "failed to connect to " << host.toString()
+                                         << ": " << errmsg, conn.get());
+
+            if (!_options.authParams().isEmpty())
+                conn->auth(_options.authParams());
+        }
+        catch (...) {
+            conn.reset();
+            {
+                boost::lock_guard<boost::mutex> lk(_mutex);
+                _pools[host].inUse--;
+            }
+            _slotAvailable.notify_all();
+            throw;
+        }
+
+        LOG(1) << "opened pooled connection to " << host.toString() << std::endl;
+        return conn.release();
+    }
+
+    bool ConnectionPool::_flushCursorKills(DBClientBase* conn) {
+        DBClientConnection* const connection = dynamic_cast<DBClientConnection*>(conn);
+        if (!connection)
+            return true;
+
+        try {
+            connection->flushCursorKills();
+            return true;
+        }
+        catch (const DBException& ex) {
+            LOG(1) << "failed to send cursor kills on pooled connection: " << ex.toString()
+                   << std::endl;
+            return false;
+        }
+    }
+
+    bool ConnectionPool::_isHealthy(DBClientBase* conn) {
+        // checks are ordered from cheap to expensive
+        return !conn->isFailed() && conn->isStillConnected();
+    }
+
+} // namespace mongo
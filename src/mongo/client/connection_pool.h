@@ -0,0 +1,214 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <deque>
+#include <vector>
+
+#include "mongo/client/dbclientinterface.h"
+#include "mongo/client/export_macros.h"
+#include "mongo/platform/unordered_map.h"
+#include "mongo/util/net/hostandport.h"
+
+namespace mongo {
+
+    /**
+     * A thread-safe pool of connections to individual servers, keyed by HostAndPort.
+     *
+     * Connections are created on demand through ConnectionString::connect, so connection hooks
+     * (see ConnectionString::setConnectionHook) are honored. At most 'maxPoolSize' connections,
+     * idle or in use, exist for any one host; a caller asking for a connection to a host that is
+     * at its limit waits until another thread returns one, or until 'waitQueueTimeoutMillis'
+     * elapses.
+     *
+     * Idle connections are handed out most recently used first and are checked with
+     * isFailed()/isStillConnected() before being reused. Connections idle for longer than
+     * 'maxIdleTimeMillis' are closed whenever the pool is touched, but never below
+     * 'minPoolSize' per host.
+     *
+     * Prefer ConnectionPool::ScopedConnection over calling acquire() and release() directly:
+     *
+     *   ConnectionPool::ScopedConnection conn(pool, HostAndPort("localhost:27017"));
+     *   conn->insert("test.foo", BSON("x" << 1));
+     *   conn.done();
+     */
+    class MONGO_CLIENT_API ConnectionPool : private boost::noncopyable {
+    public:
+
+        static const size_t kDefaultMaxPoolSize = 100;
+        static const size_t kDefaultMinPoolSize = 0;
+
+        /** Configuration for a ConnectionPool. All setters return *this for chaining. */
+        class MONGO_CLIENT_API Options {
+        public:
+            Options();
+
+            /** Maximum number of connections per host, idle or in use.
+             *
+             *  Default: 100
+             */
+            Options& setMaxPoolSize(size_t value);
+            size_t maxPoolSize() const { return _maxPoolSize; }
+
+            /** Number of idle connections per host that are never reaped.
+             *
+             *  Default: 0
+             */
+            Options& setMinPoolSize(size_t value);
+            size_t minPoolSize() const { return _minPoolSize; }
+
+            /** Idle connections unused for longer than this are closed.
+             *
+             *  Default: 0 ms (idle connections are kept forever)
+             */
+            Options& setMaxIdleTimeMillis(unsigned int millis);
+            unsigned int maxIdleTimeMillis() const { return _maxIdleTimeMillis; }
+
+            /** How long acquire() waits for a connection when a host is at 'maxPoolSize'.
+             *
+             *  Default: 0 ms (wait forever)
+             */
+            Options& setWaitQueueTimeoutMillis(unsigned int millis);
+            unsigned int waitQueueTimeoutMillis() const { return _waitQueueTimeoutMillis; }
+
+            /** Socket timeout passed to newly created connections.
+             *
+             *  Default: 0 (no timeout)
+             */
+            Options& setSocketTimeoutSecs(double secs);
+            double socketTimeoutSecs() const { return _socketTimeoutSecs; }
+
+            /** Credentials, in the format accepted by DBClientWithCommands::auth, applied to
+             *  every newly created connection. Pooled connections are already authenticated.
+             *
+             *  Default: <empty> (no authentication)
+             */
+            Options& setAuthParams(const BSONObj& params);
+            const BSONObj& authParams() const { return _authParams; }
+
+        private:
+            size_t _maxPoolSize;
+            size_t _minPoolSize;
+            unsigned int _maxIdleTimeMillis;
+            unsigned int _waitQueueTimeoutMillis;
+            double _socketTimeoutSecs;
+            BSONObj _authParams;
+        };
+
+        /**
+         * RAII holder for a pooled connection. Call done() once the connection is known to be in
+         * a reusable state (no outstanding cursors or unread replies) to return it to the pool.
+         * If done() is not called, the connection is destroyed rather than returned, because its
+         * state is unknown.
+         */
+        class MONGO_CLIENT_API ScopedConnection : private boost::noncopyable {
+        public:
+            /** Blocks until a connection to 'host' is available. Throws on timeout or failure. */
+            ScopedConnection(ConnectionPool& pool, const HostAndPort& host);
+            ~ScopedConnection();
+
+            DBClientBase* get() const;
+            DBClientBase* operator->() const { return get(); }
+            DBClientBase& conn() const { return *get(); }
+
+            /** Returns the connection to the pool. The holder must not be used afterwards. */
+            void done();
+
+        private:
+            ConnectionPool& _pool;
+            const HostAndPort _host;
+            DBClientBase* _conn;
+        };
+
+        explicit ConnectionPool(const Options& options = Options());
+
+        /** Closes all idle connections. All acquired connections must have been returned. */
+        ~ConnectionPool();
+
+        const Options& getOptions() const { return _options; }
+
+        /**
+         * Returns a connection to 'host', reusing a healthy idle connection if there is one and
+         * otherwise opening a new one. Waits up to 'waitQueueTimeoutMillis' if 'host' is at its
+         * connection limit.
+         *
+         * The caller owns the connection until it passes it to release() or discard().
+         *
+         * @throws UserException on wait queue timeout or if a connection can't be established.
+         */
+        DBClientBase* acquire(const HostAndPort& host);
+
+        /**
+         * Returns a connection obtained from acquire(). Pending lazy cursor kills are sent first
+         * (see DBClientConnection::flushCursorKills()). Failed connections are destroyed.
+         */
+        void release(const HostAndPort& host, DBClientBase* conn);
+
+        /** Destroys a connection obtained from acquire() and frees its slot. */
+        void discard(const HostAndPort& host, DBClientBase* conn);
+
+        /** Closes connections that have been idle for longer than 'maxIdleTimeMillis'. */
+        void reapIdleConnections();
+
+        /** Closes all idle connections. Connections currently in use are not affected. */
+        void clear();
+
+        size_t getNumIdle(const HostAndPort& host) const;
+        size_t getNumInUse(const HostAndPort& host) const;
+
+    private:
+        struct IdleConnection {
+            IdleConnection(DBClientBase* conn, unsigned long long lastUsedMillis)
+                : conn(conn), lastUsedMillis(lastUsedMillis) {}
+
+            DBClientBase* conn;
+            unsigned long long lastUsedMillis;
+        };
+
+        struct HostPool {
+            HostPool() : inUse(0) {}
+
+            // Ordered from least to most recently returned.
+            std::deque<IdleConnection> idle;
+            size_t inUse;
+        };
+
+        typedef unordered_map<HostAndPort, HostPool> HostPoolMap;
+
+        // Removes expired idle connections from 'hostPool' and appends them to 'expired'.
+        void _reapIdle_inlock(HostPool* hostPool,
+                              unsigned long long now,
+                              std::vector<DBClientBase*>* expired);
+
+        DBClientBase* _connect(const HostAndPort& host);
+
+        static bool _isHealthy(DBClientBase* conn);
+
+        // Sends the cursor kills 'conn' is holding back, so they don't wait out its idle time.
+        // Returns false if that fails.
+        static bool _flushCursorKills(DBClientBase* conn);
+
+        const Options _options;
+
+        mutable boost::mutex _mutex;
+        boost::condition_variable _slotAvailable;
+        HostPoolMap _pools;
+    };
+
+} // namespace mongo
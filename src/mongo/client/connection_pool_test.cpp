@@ -0,0 +1,215 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/client/connection_pool.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "mongo/client/dbclientcursor.h"
+#include "mongo/dbtests/mock/mock_conn_registry.h"
+#include "mongo/dbtests/mock/mock_remote_db_server.h"
+#include "mongo/dbtests/mock/mock_wire_server.h"
+#include "mongo/unittest/unittest.h"
+#include "mongo/util/time_support.h"
+
+namespace {
+
+    using mongo::ConnectionPool;
+    using mongo::ConnectionString;
+    using mongo::DBClientBase;
+    using mongo::HostAndPort;
+    using mongo::MockConnRegistry;
+    using mongo::MockRemoteDBServer;
+    using mongo::MockWireServer;
+    using mongo::UserException;
+
+    /**
+     * Warning: Tests running this fixture cannot be run in parallel with other tests
+     * that uses ConnectionString::setConnectionHook
+     */
+    class ConnectionPoolTest : public mongo::unittest::Test {
+    protected:
+        ConnectionPoolTest()
+            : _first("$first:27017")
+            , _second("$second:27017") {
+        }
+
+        void setUp() {
+            _originalConnectionHook = ConnectionString::getConnectionHook();
+            ConnectionString::setConnectionHook(MockConnRegistry::get()->getConnStrHook());
+            MockConnRegistry::get()->addServer(&_first);
+            MockConnRegistry::get()->addServer(&_second);
+        }
+
+        void tearDown() {
+            MockConnRegistry::get()->clear();
+            ConnectionString::setConnectionHook(_originalConnectionHook);
+        }
+
+        HostAndPort first() const { return HostAndPort(_first.getServerAddress()); }
+        HostAndPort second() const { return HostAndPort(_second.getServerAddress()); }
+
+        MockRemoteDBServer _first;
+        MockRemoteDBServer _second;
+
+    private:
+        ConnectionString::ConnectionHook* _originalConnectionHook;
+    };
+
+    void releaseAfterDelay(ConnectionPool* pool, HostAndPort host, DBClientBase* conn) {
+        mongo::sleepmillis(50);
+        pool->release(host, conn);
+    }
+
+    TEST_F(ConnectionPoolTest, ReusesReturnedConnection) {
+        ConnectionPool pool;
+
+        DBClientBase* conn = pool.acquire(first());
+        ASSERT_EQUALS(1U, pool.getNumInUse(first()));
+        ASSERT_EQUALS(0U, pool.getNumIdle(first()));
+
+        pool.release(first(), conn);
+        ASSERT_EQUALS(0U, pool.getNumInUse(first()));
+        ASSERT_EQUALS(1U, pool.getNumIdle(first()));
+
+        DBClientBase* reused = pool.acquire(first());
+        ASSERT_EQUALS(conn, reused);
+        pool.release(first(), reused);
+    }
+
+    TEST_F(ConnectionPoolTest, HostsArePooledSeparately) {
+        ConnectionPool pool(ConnectionPool::Options().setMaxPoolSize(1));
+
+        DBClientBase* firstConn = pool.acquire(first());
+        DBClientBase* secondConn = pool.acquire(second());
+        ASSERT_NOT_EQUALS(firstConn, secondConn);
+        ASSERT_EQUALS(1U, pool.getNumInUse(first()));
+        ASSERT_EQUALS(1U, pool.getNumInUse(second()));
+
+        pool.release(first(), firstConn);
+        pool.release(second(), secondConn);
+    }
+
+    TEST_F(ConnectionPoolTest, WaitQueueTimesOut) {
+        ConnectionPool pool(ConnectionPool::Options()
+                            .setMaxPoolSize(1)
+                            .setWaitQueueTimeoutMillis(20));
+
+        DBClientBase* conn = pool.acquire(first());
+        ASSERT_THROWS(pool.acquire(first()), UserException);
+        pool.release(first(), conn);
+    }
+
+    TEST_F(ConnectionPoolTest, WaiterReceivesReleasedConnection) {
+        ConnectionPool pool(ConnectionPool::Options().setMaxPoolSize(1));
+
+        DBClientBase* conn = pool.acquire(first());
+        boost::thread releaser(boost::bind(&releaseAfterDelay, &pool, first(), conn));
+
+        DBClientBase* next = pool.acquire(first());
+        releaser.join();
+
+        ASSERT_EQUALS(conn, next);
+        pool.release(first(), next);
+    }
+
+    TEST_F(ConnectionPoolTest, FailedConnectionIsNotReused) {
+        ConnectionPool pool;
+
+        DBClientBase* conn = pool.acquire(first());
+        _first.shutdown();
+        ASSERT_THROWS(conn->query("test.user", mongo::Query()), mongo::SocketException);
+        ASSERT(conn->isFailed());
+
+        pool.release(first(), conn);
+        ASSERT_EQUALS(0U, pool.getNumIdle(first()));
+        ASSERT_EQUALS(0U, pool.getNumInUse(first()));
+    }
+
+    TEST_F(ConnectionPoolTest, ScopedConnectionDone) {
+        ConnectionPool pool;
+        {
+            ConnectionPool::ScopedConnection conn(pool, first());
+            conn->query("test.user", mongo::Query());
+            conn.done();
+        }
+        ASSERT_EQUALS(1U, pool.getNumIdle(first()));
+        ASSERT_EQUALS(0U, pool.getNumInUse(first()));
+    }
+
+    TEST_F(ConnectionPoolTest, ScopedConnectionWithoutDoneIsDiscarded) {
+        ConnectionPool pool;
+        {
+            ConnectionPool::ScopedConnection conn(pool, first());
+            conn->query("test.user", mongo::Query());
+        }
+        ASSERT_EQUALS(0U, pool.getNumIdle(first()));
+        ASSERT_EQUALS(0U, pool.getNumInUse(first()));
+    }
+
+    TEST(ConnectionPool, ReturningConnectionSendsPendingCursorKills) {
+        MockWireServer server;
+        for (int i = 0; i < 10; ++i) {
+            server.insert("test.foo", BSON("_id" << i));
+        }
+
+        ConnectionPool pool;
+        {
+            ConnectionPool::ScopedConnection conn(pool, server.getHostAndPort());
+            {
+                std::auto_ptr<mongo::DBClientCursor> cursor =
+                    conn->query("test.foo", mongo::Query(), 0, 0, NULL, 0, 2);
+                cursor->next();
+            }
+            ASSERT_EQUALS(1U, server.getOpenCursorCount());
+            conn.done();
+        }
+
+        for (int i = 0; i < 500 && server.getKilledCursorCount() < 1; ++i) {
+            mongo::sleepmillis(10);
+        }
+        ASSERT_EQUALS(1U, server.getKilledCursorCount());
+        ASSERT_EQUALS(1U, pool.getNumIdle(server.getHostAndPort()));
+    }
+
+    TEST_F(ConnectionPoolTest, ReapsIdleConnectionsAboveMinPoolSize) {
+        ConnectionPool pool(ConnectionPool::Options()
+                            .setMinPoolSize(1)
+                            .setMaxIdleTimeMillis(1));
+
+        DBClientBase* conn1 = pool.acquire(first());
+        DBClientBase* conn2 = pool.acquire(first());
+        DBClientBase* conn3 = pool.acquire(first());
+        pool.release(first(), conn1);
+        pool.release(first(), conn2);
+        pool.release(first(), conn3);
+
+        mongo::sleepmillis(10);
+        pool.reapIdleConnections();
+        ASSERT_EQUALS(1U, pool.getNumIdle(first()));
+    }
+
+    TEST_F(ConnectionPoolTest, ConnectFailureFreesSlot) {
+        ConnectionPool pool(ConnectionPool::Options().setMaxPoolSize(1));
+
+        _second.shutdown();
+        ASSERT_THROWS(pool.acquire(second()), UserException);
+        ASSERT_EQUALS(0U, pool.getNumInUse(second()));
+    }
+
+} // namespace
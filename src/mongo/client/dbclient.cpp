@@ -42,8 +42,10 @@
 #include "mongo/db/namespace_string.h"
 #include "mongo/util/assert_util.h"
 #include "mongo/util/log.h"
+#include "mongo/util/net/message_compressor.h"
 #include "mongo/util/net/ssl_manager.h"
 #include "mongo/util/password_digest.h"
+#include "mongo/util/time_support.h"
 
 #include <boost/algorithm/string/case_conv.hpp>
 #include <boost/algorithm/string/classification.hpp>
@@ -90,6 +92,20 @@ namespace mongo {
             // options
             "(?:\\?(?:(.+=.+)&?)+)*";
 
+        // A connection sends its queued cursor kills right away once there are this many, or
+        // once the oldest has waited this long, rather than only with its next message.
+        const size_t kMaxPendingCursorKills = 1000;
+        const unsigned long long kMaxCursorKillDelayMillis = 1000;
+
+        void makeKillCursorsMessage( const long long* cursorIds, int count, Message* toSend ) {
+            BufBuilder b( 8 + count * sizeof(long long) );
+            b.appendNum( (int)0 ); // reserved
+            b.appendNum( count );
+            for ( int i = 0; i < count; ++i )
+                b.appendNum( cursorIds[i] );
+            toSend->setData( dbKillCursors , b.buf() , b.len() );
+        }
+
     } // namespace
 
     void ConnectionString::_fillServers( string s ) {
@@ -474,7 +490,7 @@ namespace mongo {
     Query& Query::where(const string &jscode, BSONObj scope) {
         /* use where() before sort() and hint() and explain(), else this will assert. */
         verify( ! isComplex() );
-        BSONObjBuilder b;
+        BSONObjBuilder b( obj.objsize() + 64 + jscode.size() + scope.objsize() );
         b.appendElements(obj);
         b.appendWhere(jscode, scope);
         obj = b.obj();
@@ -484,7 +500,7 @@ namespace mongo {
     void Query::makeComplex() {
         if ( isComplex() )
             return;
-        BSONObjBuilder b;
+        BSONObjBuilder b( obj.objsize() + 16 );
         b.append( "query", obj );
         obj = b.obj();
     }
@@ -1425,6 +1441,14 @@ namespace mongo {
             update(ns.rawData(), MONGO_QUERY("_id" << toSave.getField("_id")), toSave, true, false, wc);
     }
 
+    DBClientConnection::~DBClientConnection() {
+        DESTRUCTOR_GUARD(
+            if ( p && !_failed )
+                flushCursorKills();
+        );
+        _numConnections.fetchAndAdd(-1);
+    }
+
     bool DBClientConnection::connect(const HostAndPort& server, string& errmsg) {
         _server = server;
         _serverString = _server.toString();
@@ -1446,6 +1470,8 @@ namespace mongo {
         }
 
         server.reset(serverSockAddr.release());
+        // Cursors of a previous connection died with it.
+        _pendingCursorKills.clear();
         p.reset(new MessagingPort( _so_timeout, _logLevel ));
 
         if (_server.host().empty() ) {
@@ -1479,7 +1505,16 @@ namespace mongo {
         }
 #endif
         BSONObj info;
-        bool worked = simpleCommand("admin", &info, "ismaster");
+        bool worked;
+        if (_compressors.empty()) {
+            worked = simpleCommand("admin", &info, "ismaster");
+        }
+        else {
+            worked = runCommand("admin", BSON("ismaster" << 1 << "compression" << _compressors),
+                                info);
+            if (worked)
+                _negotiateCompression(info);
+        }
         if (worked) {
             if (info.hasField("maxBsonObjectSize"))
                 _maxBsonObjectSize = info.getIntField("maxBsonObjectSize");
@@ -1496,6 +1531,39 @@ namespace mongo {
         return worked;
     }
 
+    void DBClientConnection::setCompressors(const std::vector<std::string>& compressors) {
+        for (size_t i = 0; i < compressors.size(); ++i) {
+            uassert(18746, str::stream() << "unsupported compressor: " << compressors[i],
+                    MessageCompressor::forName(compressors[i]));
+        }
+        _compressors = compressors;
+    }
+
+    std::string DBClientConnection::getCompressor() const {
+        return p && p->getCompressor() ? p->getCompressor()->getName() : std::string();
+    }
+
+    void DBClientConnection::_negotiateCompression(const BSONObj& isMasterReply) {
+        // The server lists the codecs it accepts, in our order of preference.
+        BSONObjIterator it(isMasterReply.getObjectField("compression"));
+        while (it.more()) {
+            const BSONElement name = it.next();
+            if (name.type() != String ||
+                std::find(_compressors.begin(), _compressors.end(), name.str()) ==
+                    _compressors.end()) {
+                continue;
+            }
+
+            const MessageCompressor* compressor = MessageCompressor::forName(name.str());
+            if (compressor) {
+                LOG(1) << "compressing messages to " << toString() << " with "
+                       << compressor->getName() << endl;
+                p->setCompressor(compressor);
+                return;
+            }
+        }
+    }
+
     void DBClientConnection::logout(const string& dbname, BSONObj& info){
         authCache.erase(dbname);
         runCommand(dbname, BSON("logout" << 1), info);
@@ -1579,11 +1647,18 @@ namespace mongo {
         _maxBsonObjectSize = defaultMaxBsonObjectSize;
         _maxMessageSizeBytes = defaultMaxMessageSizeBytes;
         _maxWriteBatchSize = defaultMaxWriteBatchSize;
+        _piggyBackUnacknowledgedWrites = false;
     }
 
     DBClientBase::~DBClientBase() {
     }
 
+    void DBClientBase::_killCursorOnNextMessage( long long cursorId ) {
+        Message m;
+        makeKillCursorsMessage( &cursorId, 1, &m );
+        sayPiggyBack( m );
+    }
+
     auto_ptr<DBClientCursor> DBClientBase::query(const string &ns, Query query, int nToReturn,
             int nToSkip, const BSONObj *fieldsToReturn, int queryOptions , int batchSize ) {
         auto_ptr<DBClientCursor> c( new DBClientCursor( this,
@@ -2070,7 +2145,12 @@ namespace mongo {
     void assembleRequest( const string &ns, BSONObj query, int nToReturn, int nToSkip, const BSONObj *fieldsToReturn, int queryOptions, Message &toSend ) {
         CHECK_OBJECT( query , "assembleRequest query" );
         // see query.h for the protocol we are using here.
-        BufBuilder b;
+        // The message is built in place, header included, in a buffer of exactly its size
+        // that the Message then takes over: one allocation and no copy.
+        const int size = sizeof(MSGHEADER::Value) + 4 + ns.size() + 1 + 4 + 4 + query.objsize()
+                         + ( fieldsToReturn ? fieldsToReturn->objsize() : 0 );
+        BufBuilder b( size );
+        b.skip( sizeof(MSGHEADER::Value) );
         int opts = queryOptions;
         b.appendNum(opts);
         b.appendStr(ns);
@@ -2079,12 +2159,19 @@ namespace mongo {
         query.appendSelfToBufBuilder(b);
         if ( fieldsToReturn )
             fieldsToReturn->appendSelfToBufBuilder(b);
-        toSend.setData(dbQuery, b.buf(), b.len());
+        dassert( b.len() == size );
+
+        MsgData::View header = b.buf();
+        header.setLen( b.len() );
+        header.setOperation( dbQuery );
+        b.decouple();
+        toSend.setData( header.view2ptr(), true );
     }
 
     void DBClientConnection::say( Message &toSend, bool isRetry , string * actualServer ) {
         checkConnection();
         try {
+            _piggyBackCursorKills();
             port().say( toSend );
         }
         catch( SocketException & ) {
@@ -2094,7 +2181,14 @@ namespace mongo {
     }
 
     void DBClientConnection::sayPiggyBack( Message &toSend ) {
-        port().piggyBack( toSend );
+        try {
+            _piggyBackCursorKills();
+            port().piggyBack( toSend );
+        }
+        catch( SocketException & ) {
+            _failed = true;
+            throw;
+        }
     }
 
     bool DBClientConnection::recv( Message &m ) {
@@ -2113,6 +2207,7 @@ namespace mongo {
         */
         checkConnection();
         try {
+            _piggyBackCursorKills();
             if ( !port().call(toSend, response) ) {
                 _failed = true;
                 if ( assertOk )
@@ -2168,18 +2263,56 @@ namespace mongo {
     }
 
     void DBClientConnection::killCursor( long long cursorId ) {
-        StackBufBuilder b;
-        b.appendNum( (int)0 ); // reserved
-        b.appendNum( (int)1 ); // number
-        b.appendNum( cursorId );
+        if ( _lazyKillCursor ) {
+            _killCursorOnNextMessage( cursorId );
+            return;
+        }
 
+        // Takes along any kills still queued.
+        _pendingCursorKills.push_back( cursorId );
         Message m;
-        m.setData( dbKillCursors , b.buf() , b.len() );
-        
-        if ( _lazyKillCursor )
-            sayPiggyBack( m );
-        else
-            say(m);
+        makeKillCursorsMessage( &_pendingCursorKills[0], _pendingCursorKills.size(), &m );
+        _pendingCursorKills.clear();
+        say( m );
+    }
+
+    void DBClientConnection::flushCursorKills() {
+        if ( _pendingCursorKills.empty() )
+            return;
+
+        checkConnection();
+        try {
+            _piggyBackCursorKills();
+            port().flushPiggyBack();
+        }
+        catch( SocketException & ) {
+            _failed = true;
+            throw;
+        }
+    }
+
+    void DBClientConnection::_killCursorOnNextMessage( long long cursorId ) {
+        const unsigned long long now = curTimeMillis64();
+        if ( _pendingCursorKills.empty() )
+            _pendingCursorKillsSince = now;
+        _pendingCursorKills.push_back( cursorId );
+
+        // The delay is only checked here, see flushCursorKills().
+        if ( _pendingCursorKills.size() >= kMaxPendingCursorKills ||
+             now - _pendingCursorKillsSince >= kMaxCursorKillDelayMillis ) {
+            flushCursorKills();
+        }
+    }
+
+    void DBClientConnection::_piggyBackCursorKills() {
+        if ( _pendingCursorKills.empty() )
+            return;
+
+        Message m;
+        makeKillCursorsMessage( &_pendingCursorKills[0], _pendingCursorKills.size(), &m );
+        // Cleared first: if sending fails the kills are lost with the connection anyway.
+        _pendingCursorKills.clear();
+        port().piggyBack( m );
     }
 
 #ifdef MONGO_SSL
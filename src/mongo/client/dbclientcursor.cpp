@@ -21,11 +21,15 @@
 
 #include "mongo/client/dbclientcursor.h"
 
+#include <algorithm>
+#include <cmath>
+
 #include "mongo/db/dbmessage.h"
 #include "mongo/db/namespace_string.h"
 #include "mongo/util/debug_util.h"
 #include "mongo/client/dbclientcursorshim.h"
 #include "mongo/util/log.h"
+#include "mongo/util/time_support.h"
 
 namespace mongo {
 
@@ -48,7 +52,15 @@ namespace mongo {
         resultFlags(0),
         cursorId(),
         _ownCursor( true ),
-        wasError( false ) {
+        wasError( false ),
+        _prefetchFraction(0),
+        _prefetchRequestId(0),
+        _adaptiveMaxBatchBytes(0),
+        _adaptiveBatchSize(0),
+        _bytesReceived(0),
+        _docsReceived(0),
+        _batchReceivedMicros(0),
+        _roundTripMicros(0) {
         _finishConsInit();
     }
 
@@ -64,7 +76,15 @@ namespace mongo {
         resultFlags(0),
         cursorId(_cursorId),
         _ownCursor(true),
-        wasError(false) {
+        wasError(false),
+        _prefetchFraction(0),
+        _prefetchRequestId(0),
+        _adaptiveMaxBatchBytes(0),
+        _adaptiveBatchSize(0),
+        _bytesReceived(0),
+        _docsReceived(0),
+        _batchReceivedMicros(0),
+        _roundTripMicros(0) {
         _finishConsInit();
     }
 
@@ -75,16 +95,18 @@ namespace mongo {
     }
 
     int DBClientCursor::nextBatchSize() {
+        const int size = batchSize ? batchSize : _adaptiveBatchSize;
+
         if (nToReturn) {
             int remaining = nToReturn - nReturned;
 
-            if (batchSize && batchSize < remaining)
-                return batchSize;
+            if (size && size < remaining)
+                return size;
 
             return -remaining;
         }
 
-        return batchSize;
+        return size;
     }
 
     void DBClientCursor::_assembleInit( Message& toSend ) {
@@ -92,19 +114,31 @@ namespace mongo {
             assembleRequest( ns, query, nextBatchSize() , nToSkip, fieldsToReturn, opts, toSend );
         }
         else {
-            BufBuilder b;
-            b.appendNum( opts );
-            b.appendStr( ns );
-            b.appendNum( nextBatchSize() );
-            b.appendNum( cursorId );
-            toSend.setData( dbGetMore, b.buf(), b.len() );
+            _assembleGetMore( toSend );
         }
     }
 
+    void DBClientCursor::_assembleGetMore( Message& toSend ) {
+        // Built in place in a buffer of exactly the message's size, like assembleRequest().
+        BufBuilder b( sizeof(MSGHEADER::Value) + 4 + ns.size() + 1 + 4 + 8 );
+        b.skip( sizeof(MSGHEADER::Value) );
+        b.appendNum( opts );
+        b.appendStr( ns );
+        b.appendNum( nextBatchSize() );
+        b.appendNum( cursorId );
+
+        MsgData::View header = b.buf();
+        header.setLen( b.len() );
+        header.setOperation( dbGetMore );
+        b.decouple();
+        toSend.setData( header.view2ptr(), true );
+    }
+
     bool DBClientCursor::init() {
         Message toSend;
         _assembleInit( toSend );
 
+        const unsigned long long sentMicros = curTimeMicros64();
         if ( !_client->call( toSend, *batch.m, false, &_originalHost ) ) {
             // log msg temp?
             log() << "DBClientCursor::init call() failed" << endl;
@@ -115,6 +149,7 @@ namespace mongo {
             log() << "DBClientCursor::init message from call() was empty" << endl;
             return false;
         }
+        _roundTripMicros = curTimeMicros64() - sentMicros;
         dataReceived();
         return true;
     }
@@ -178,21 +213,88 @@ namespace mongo {
     void DBClientCursor::requestMore() {
         verify( cursorId && batch.pos == batch.nReturned );
 
-        BufBuilder b;
-        b.appendNum(opts);
-        b.appendStr(ns);
-        b.appendNum(nextBatchSize());
-        b.appendNum(cursorId);
-
-        Message toSend;
-        toSend.setData(dbGetMore, b.buf(), b.len());
         auto_ptr<Message> response(new Message());
 
-        _client->call( toSend, *response );
+        if ( _prefetchRequestId ) {
+            // the getMore already went out, its reply is (or will be) waiting on the connection
+            _receivePrefetched( *response );
+        }
+        else {
+            _adaptBatchSize();
+
+            Message toSend;
+            _assembleGetMore( toSend );
+
+            const unsigned long long sentMicros = curTimeMicros64();
+            _client->call( toSend, *response );
+            _roundTripMicros = curTimeMicros64() - sentMicros;
+        }
+
         this->batch.m = response;
         dataReceived();
     }
 
+    void DBClientCursor::setPrefetchFraction( double fraction ) {
+        uassert( 18729, "prefetch fraction must be between 0 and 1",
+                 fraction >= 0 && fraction <= 1 );
+        _prefetchFraction = fraction;
+    }
+
+    void DBClientCursor::_maybePrefetch() {
+        if ( _prefetchRequestId || !cursorId || nToReturn || ( opts & QueryOption_Exhaust ) )
+            return;
+
+        // Send once 'fraction' of the batch has been consumed, but never before the first
+        // document: a fraction of 0 would otherwise ask for a batch nobody may ever look at.
+        const int threshold = std::max( 1, static_cast<int>(
+                std::ceil( _prefetchFraction * batch.nReturned ) ) );
+        if ( batch.pos < threshold || !_client->lazySupported() )
+            return;
+
+        _adaptBatchSize();
+
+        Message toSend;
+        _assembleGetMore( toSend );
+        _client->say( toSend );
+        _prefetchRequestId = toSend.header().getId();
+    }
+
+    void DBClientCursor::setAdaptiveBatchSizing( int maxBatchBytes ) {
+        uassert( 18732, "maximum batch size in bytes must not be negative", maxBatchBytes >= 0 );
+        _adaptiveMaxBatchBytes = maxBatchBytes;
+    }
+
+    void DBClientCursor::_adaptBatchSize() {
+        if ( !_adaptiveMaxBatchBytes || batchSize || !_docsReceived || !batch.pos )
+            return;
+
+        // How long the consumer takes for a whole batch, extrapolated from what it has used
+        // so far in case a read-ahead is being sent before the batch is finished.
+        const unsigned long long consumeMicros =
+            ( curTimeMicros64() - _batchReceivedMicros ) * batch.nReturned / batch.pos;
+
+        const long long avgObjSize = std::max( 1LL, _bytesReceived / _docsReceived );
+        const int maxSize = static_cast<int>( std::max( 2LL, _adaptiveMaxBatchBytes / avgObjSize ) );
+
+        int size = _adaptiveBatchSize ? _adaptiveBatchSize : batch.nReturned;
+        if ( !_roundTripMicros || consumeMicros < _roundTripMicros )
+            size = size > maxSize / 2 ? maxSize : size * 2;
+
+        // a batch size of 1 would close the cursor
+        _adaptiveBatchSize = std::max( 2, std::min( size, maxSize ) );
+    }
+
+    void DBClientCursor::_receivePrefetched( Message& response ) {
+        const MSGID requestId = _prefetchRequestId;
+        _prefetchRequestId = 0;
+
+        uassert( 18730, "recv failed while reading prefetched batch", _client->recv( response ) );
+        uassert( 18731, str::stream() << "reply to prefetched getMore " << requestId
+                                      << " has unexpected responseTo "
+                                      << response.header().getResponseTo(),
+                 response.header().getResponseTo() == requestId );
+    }
+
     /** with QueryOption_Exhaust, the server just blasts data at us (marked at end with cursorid==0). */
     void DBClientCursor::exhaustReceiveMore() {
         verify( cursorId && batch.pos == batch.nReturned );
@@ -232,6 +334,11 @@ namespace mongo {
         batch.pos = 0;
         batch.data = qr.data();
 
+        // kept even while adaptive sizing is off so it can be turned on at any point
+        _bytesReceived += batch.m->header().getLen() - ( batch.data - qr.view2ptr() );
+        _docsReceived += batch.nReturned;
+        _batchReceivedMicros = curTimeMicros64();
+
         _client->checkResponse( batch.data, batch.nReturned, &retry, &host ); // watches for "not master"
 
         /* this assert would fire the way we currently work:
@@ -276,6 +383,10 @@ namespace mongo {
         batch.pos++;
         BSONObj o(batch.data);
         batch.data += o.objsize();
+
+        if ( _prefetchFraction > 0 )
+            _maybePrefetch();
+
         /* todo would be good to make data null at end of batch for safety */
         return o;
     }
@@ -355,20 +466,30 @@ namespace mongo {
     DBClientCursor::~DBClientCursor() {
         DESTRUCTOR_GUARD (
 
+        if ( _prefetchRequestId ) {
+            // Leave the connection with nothing unread on it. The prefetched batch may also
+            // have exhausted or closed the cursor, in which case there is nothing to kill.
+            Message response;
+            _receivePrefetched( response );
+            cursorId = QueryResult::ConstView( response.singleData().view2ptr() ).getCursorId();
+        }
+
         if ( cursorId && _ownCursor ) {
-            BufBuilder b;
-            b.appendNum( (int)0 ); // reserved
-            b.appendNum( (int)1 ); // number
-            b.appendNum( cursorId );
-            
-            Message m;
-            m.setData( dbKillCursors , b.buf() , b.len() );
-
-            // Kill the cursor the same way the connection itself would.  Usually, non-lazily
-            if( DBClientConnection::getLazyKillCursor() )
-                _client->sayPiggyBack( m );
-            else
+            // Kill the cursor the same way the connection itself would.  Usually, lazily:
+            // connections batch the kills of many cursors into one message.
+            if( DBClientConnection::getLazyKillCursor() ) {
+                _client->_killCursorOnNextMessage( cursorId );
+            }
+            else {
+                BufBuilder b;
+                b.appendNum( (int)0 ); // reserved
+                b.appendNum( (int)1 ); // number
+                b.appendNum( cursorId );
+
+                Message m;
+                m.setData( dbKillCursors , b.buf() , b.len() );
                 _client->say( m );
+            }
         }
 
         );
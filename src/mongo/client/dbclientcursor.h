@@ -125,6 +125,32 @@ namespace mongo {
         /// Change batchSize after construction. Can change after requesting first batch.
         void setBatchSize(int newBatchSize) { batchSize = newBatchSize; }
 
+        /**
+         * Enables read-ahead. Once next() has returned 'fraction' of the current batch, the
+         * getMore for the following batch is sent right away instead of when the batch runs
+         * out, so the round trip overlaps with processing the rest of the batch. 0, the
+         * default, disables read-ahead.
+         *
+         * Read-ahead requires a client that supports lazy queries (a DBClientConnection) and is
+         * not used for exhaust cursors or cursors with a limit. While a read-ahead request is
+         * outstanding its reply is waiting on the connection, so the connection must not be
+         * used for anything else until the cursor has moved on to the next batch or has been
+         * destroyed.
+         */
+        void setPrefetchFraction(double fraction);
+
+        /**
+         * Lets the cursor size its getMore requests instead of leaving it to the server. Each
+         * getMore asks for twice as many documents as the previous batch held, for as long as
+         * the consumer works through a batch faster than the server takes to answer a getMore;
+         * a slower consumer would not benefit from larger batches. Batches are capped so that,
+         * at the average size of the documents received so far, one batch stays within
+         * 'maxBatchBytes'. 0, the default, disables adaptive sizing.
+         *
+         * Has no effect while an explicit batch size is set.
+         */
+        void setAdaptiveBatchSizing(int maxBatchBytes);
+
         DBClientCursor( DBClientBase* client, const std::string &_ns, BSONObj _query, int _nToReturn,
                         int _nToSkip, const BSONObj *_fieldsToReturn, int queryOptions , int bs );
         DBClientCursor( DBClientBase* client, const std::string &_ns, long long _cursorId, int _nToReturn, int options, int _batchSize );
@@ -210,6 +236,21 @@ namespace mongo {
         void requestMore();
         void exhaustReceiveMore(); // for exhaust
 
+        // read-ahead, see setPrefetchFraction()
+        double _prefetchFraction;
+        MSGID _prefetchRequestId; // 0 unless a read-ahead getMore is outstanding
+        void _maybePrefetch();
+        void _receivePrefetched( Message& response );
+
+        // adaptive batch sizing, see setAdaptiveBatchSizing()
+        int _adaptiveMaxBatchBytes; // 0 if disabled
+        int _adaptiveBatchSize; // size of the last getMore we sized, 0 if none yet
+        long long _bytesReceived;
+        long long _docsReceived;
+        unsigned long long _batchReceivedMicros;
+        unsigned long long _roundTripMicros; // 0 until a round trip has been timed
+        void _adaptBatchSize();
+
         // Don't call from a virtual function
         void _assertIfNull() const { uassert(13348, "connection died", this); }
 
@@ -219,6 +260,7 @@ namespace mongo {
 
         // init pieces
         void _assembleInit( Message& toSend );
+        void _assembleGetMore( Message& toSend );
     };
 
     /** iterate over objects in current batch only - will not cause a network call
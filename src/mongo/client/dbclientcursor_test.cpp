@@ -0,0 +1,254 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/client/dbclientcursor.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mongo/client/dbclientinterface.h"
+#include "mongo/dbtests/mock/mock_wire_server.h"
+#include "mongo/unittest/unittest.h"
+#include "mongo/util/time_support.h"
+
+namespace {
+
+    using mongo::DBClientConnection;
+    using mongo::DBClientCursor;
+    using mongo::MockWireServer;
+    using mongo::Query;
+    using std::auto_ptr;
+    using std::vector;
+
+    const char kNamespace[] = "test.foo";
+
+    class DBClientCursorTest : public mongo::unittest::Test {
+    protected:
+        void setUp() {
+            for (int i = 0; i < 10; ++i) {
+                _server.insert(kNamespace, BSON("_id" << i));
+            }
+
+            std::string errmsg;
+            ASSERT_TRUE(_conn.connect(_server.getHostAndPort(), errmsg));
+        }
+
+        auto_ptr<DBClientCursor> query(int batchSize) {
+            return _conn.query(kNamespace, Query(), 0, 0, NULL, 0, batchSize);
+        }
+
+        // The server handles requests on its own thread, so give it a moment to catch up.
+        size_t waitForGetMores(size_t expected) {
+            for (int i = 0; i < 500 && _server.getOpCount(mongo::dbGetMore) < expected; ++i) {
+                mongo::sleepmillis(10);
+            }
+            return _server.getOpCount(mongo::dbGetMore);
+        }
+
+        // Drains 'cursor', returning the number of documents in each batch it received.
+        vector<int> batchSizes(DBClientCursor* cursor, int sleepMillisPerDoc = 0) {
+            vector<int> sizes;
+            while (cursor->more()) {
+                sizes.push_back(cursor->objsLeftInBatch());
+                while (cursor->moreInCurrentBatch()) {
+                    cursor->next();
+                    if (sleepMillisPerDoc)
+                        mongo::sleepmillis(sleepMillisPerDoc);
+                }
+            }
+            return sizes;
+        }
+
+        // Like waitForGetMores(), for killed cursors.
+        size_t waitForKilledCursors(size_t expected) {
+            for (int i = 0; i < 500 && _server.getKilledCursorCount() < expected; ++i) {
+                mongo::sleepmillis(10);
+            }
+            return _server.getKilledCursorCount();
+        }
+
+        MockWireServer _server;
+        DBClientConnection _conn;
+    };
+
+    TEST_F(DBClientCursorTest, ReadAheadReturnsAllDocuments) {
+        auto_ptr<DBClientCursor> cursor = query(4);
+        cursor->setPrefetchFraction(0.5);
+
+        for (int i = 0; i < 10; ++i) {
+            ASSERT_TRUE(cursor->more());
+            ASSERT_EQUALS(i, cursor->next()["_id"].numberInt());
+        }
+        ASSERT_FALSE(cursor->more());
+
+        // Batches of 4, 4 and 2: the cursor is exhausted by the second getMore.
+        ASSERT_EQUALS(2U, _server.getOpCount(mongo::dbGetMore));
+        ASSERT_EQUALS(0U, _server.getOpenCursorCount());
+    }
+
+    TEST_F(DBClientCursorTest, ReadAheadIsSentBeforeBatchRunsOut) {
+        auto_ptr<DBClientCursor> cursor = query(4);
+        cursor->setPrefetchFraction(0.5);
+
+        cursor->next();
+        ASSERT_EQUALS(0U, _server.getOpCount(mongo::dbGetMore));
+
+        cursor->next();
+        ASSERT_EQUALS(1U, waitForGetMores(1));
+        ASSERT_EQUALS(2, cursor->objsLeftInBatch());
+    }
+
+    TEST_F(DBClientCursorTest, DestroyWithReadAheadOutstanding) {
+        {
+            auto_ptr<DBClientCursor> cursor = query(4);
+            cursor->setPrefetchFraction(0.25);
+            cursor->next();
+            ASSERT_EQUALS(1U, waitForGetMores(1));
+        }
+
+        // The prefetched reply was drained, so the connection is still in sync.
+        ASSERT_EQUALS(10ULL, _conn.count(kNamespace));
+        ASSERT_EQUALS(0U, _server.getOpenCursorCount());
+    }
+
+    TEST_F(DBClientCursorTest, ReadAheadDisabledByDefault) {
+        auto_ptr<DBClientCursor> cursor = query(4);
+
+        for (int i = 0; i < 4; ++i) {
+            cursor->next();
+        }
+        ASSERT_EQUALS(0U, _server.getOpCount(mongo::dbGetMore));
+    }
+
+    TEST_F(DBClientCursorTest, InvalidPrefetchFraction) {
+        auto_ptr<DBClientCursor> cursor = query(4);
+        ASSERT_THROWS(cursor->setPrefetchFraction(-0.5), mongo::UserException);
+        ASSERT_THROWS(cursor->setPrefetchFraction(1.5), mongo::UserException);
+    }
+
+    TEST_F(DBClientCursorTest, AdaptiveBatchesGrowForFastConsumer) {
+        for (int i = 10; i < 2000; ++i) {
+            _server.insert(kNamespace, BSON("_id" << i));
+        }
+        // Makes the round trip far slower than consuming a batch, even on a loaded host.
+        _server.setReplyDelayMillis(20);
+
+        auto_ptr<DBClientCursor> cursor = query(0);
+        cursor->setAdaptiveBatchSizing(1024 * 1024);
+        const vector<int> sizes = batchSizes(cursor.get());
+
+        // 101 documents in the first batch. A scheduling hiccup may hold a batch size, but
+        // sizes never shrink and grow by doubling.
+        ASSERT_GREATER_THAN_OR_EQUALS(sizes.size(), 2U);
+        ASSERT_EQUALS(101, sizes[0]);
+        int total = sizes[0];
+        for (size_t i = 1; i < sizes.size(); ++i) {
+            total += sizes[i];
+            if (i + 1 < sizes.size()) {
+                ASSERT_TRUE(sizes[i] == sizes[i - 1] || sizes[i] == 2 * sizes[i - 1]);
+            }
+            else {
+                ASSERT_LESS_THAN_OR_EQUALS(sizes[i], 2 * sizes[i - 1]);
+            }
+        }
+        ASSERT_EQUALS(2000, total);
+        ASSERT_GREATER_THAN(*std::max_element(sizes.begin(), sizes.end()), 101);
+    }
+
+    TEST_F(DBClientCursorTest, AdaptiveBatchesAreCappedByBytes) {
+        const std::string padding(1000, 'x');
+        for (int i = 0; i < 300; ++i) {
+            _server.insert("test.big", BSON("_id" << i << "padding" << padding));
+        }
+
+        auto_ptr<DBClientCursor> cursor = _conn.query("test.big", Query(), 0, 0, NULL, 0, 0);
+        cursor->setAdaptiveBatchSizing(64 * 1024);
+        const vector<int> sizes = batchSizes(cursor.get());
+
+        int total = 0;
+        for (size_t i = 0; i < sizes.size(); ++i) {
+            total += sizes[i];
+            if (i > 0) {
+                ASSERT_LESS_THAN_OR_EQUALS(sizes[i], 64);
+            }
+        }
+        ASSERT_EQUALS(300, total);
+    }
+
+    TEST_F(DBClientCursorTest, AdaptiveBatchesHoldForSlowConsumer) {
+        for (int i = 10; i < 300; ++i) {
+            _server.insert(kNamespace, BSON("_id" << i));
+        }
+
+        auto_ptr<DBClientCursor> cursor = query(0);
+        cursor->setAdaptiveBatchSizing(1024 * 1024);
+        const vector<int> sizes = batchSizes(cursor.get(), 1);
+
+        ASSERT_EQUALS(3U, sizes.size());
+        ASSERT_EQUALS(101, sizes[0]);
+        ASSERT_EQUALS(101, sizes[1]);
+        ASSERT_EQUALS(98, sizes[2]);
+    }
+
+    TEST_F(DBClientCursorTest, ExplicitBatchSizeOverridesAdaptiveSizing) {
+        auto_ptr<DBClientCursor> cursor = query(3);
+        cursor->setAdaptiveBatchSizing(1024 * 1024);
+        const vector<int> sizes = batchSizes(cursor.get());
+
+        ASSERT_EQUALS(4U, sizes.size());
+        ASSERT_EQUALS(3, sizes[2]);
+        ASSERT_THROWS(cursor->setAdaptiveBatchSizing(-1), mongo::UserException);
+    }
+
+    TEST_F(DBClientCursorTest, KillsOfManyCursorsGoOutAsOneMessage) {
+        vector<DBClientCursor*> cursors;
+        for (int i = 0; i < 5; ++i) {
+            cursors.push_back(query(2).release());
+            cursors.back()->next();
+        }
+        ASSERT_EQUALS(5U, _server.getOpenCursorCount());
+
+        for (size_t i = 0; i < cursors.size(); ++i) {
+            delete cursors[i];
+        }
+        ASSERT_EQUALS(0U, _server.getOpCount(mongo::dbKillCursors));
+
+        // Sent along with the next message.
+        ASSERT_EQUALS(10ULL, _conn.count(kNamespace));
+        ASSERT_EQUALS(1U, _server.getOpCount(mongo::dbKillCursors));
+        ASSERT_EQUALS(5U, _server.getKilledCursorCount());
+        ASSERT_EQUALS(0U, _server.getOpenCursorCount());
+    }
+
+    TEST_F(DBClientCursorTest, FlushCursorKills) {
+        {
+            auto_ptr<DBClientCursor> cursor = query(2);
+            cursor->next();
+        }
+        _conn.flushCursorKills();
+
+        ASSERT_EQUALS(1U, waitForKilledCursors(1));
+        ASSERT_EQUALS(0U, _server.getOpenCursorCount());
+
+        // Nothing left to send.
+        _conn.flushCursorKills();
+        ASSERT_EQUALS(1U, _server.getOpCount(mongo::dbKillCursors));
+    }
+
+} // namespace
@@ -502,11 +502,18 @@ namespace mongo {
         template< class T >
         void appendComplex( const char *fieldName, const T& val ) {
             makeComplex();
-            BSONObjBuilder b;
+            // Sized for the result, so that the builder never regrows.
+            BSONObjBuilder b( obj.objsize() + 1 + strlen(fieldName) + 1 + valueSizeHint(val) );
             b.appendElements(obj);
             b.append(fieldName, val);
             obj = b.obj();
         }
+
+        // At least the encoded size of each kind of value appendComplex() is used with.
+        static int valueSizeHint( const BSONObj& val ) { return val.objsize(); }
+        static int valueSizeHint( const std::string& val ) { return 4 + val.size() + 1; }
+        template< class T >
+        static int valueSizeHint( const T& ) { return 8; }
     };
 
     /**
@@ -1296,6 +1303,7 @@ namespace mongo {
      */
     class MONGO_CLIENT_API DBClientBase : public DBClientWithCommands, public DBConnector {
     friend class BulkOperationBuilder;
+    friend class BulkWriter;
     protected:
         static AtomicInt64 ConnectionIdSequence;
         long long _connectionId; // unique connection id for this connection
@@ -1307,6 +1315,17 @@ namespace mongo {
         int _maxWireVersion;
         int _maxMessageSizeBytes;
         int _maxWriteBatchSize;
+        bool _piggyBackUnacknowledgedWrites;
+
+        friend class DBClientCursor;
+
+        /**
+         * Kills 'cursorId' without sending anything right away: the kill goes out with the
+         * next message to the server. Used for cursors that go out of scope while lazy
+         * cursor kills are on (see DBClientConnection::setLazyKillCursor).
+         */
+        virtual void _killCursorOnNextMessage( long long cursorId );
+
         void _write(
             const std::string& ns,
             const std::vector<WriteOperation*>& writes,
@@ -1328,6 +1347,19 @@ namespace mongo {
         const WriteConcern& getWriteConcern() const { return _writeConcern; }
         void setWriteConcern( const WriteConcern& w ) { _writeConcern = w; }
 
+        /**
+         * If true, legacy writes that need no acknowledgement are piggybacked (see
+         * sayPiggyBack), so that many go out in one socket write. They are held back until the
+         * next operation that is sent right away, or until enough of them fill the buffer.
+         * Has no effect on servers that support write commands.
+         *
+         * Default: false
+         */
+        void setPiggyBackUnacknowledgedWrites( bool value ) {
+            _piggyBackUnacknowledgedWrites = value;
+        }
+        bool getPiggyBackUnacknowledgedWrites() const { return _piggyBackUnacknowledgedWrites; }
+
         void setWireVersions( int minWireVersion, int maxWireVersion ){
             _minWireVersion = minWireVersion;
             _maxWireVersion = maxWireVersion;
@@ -1528,13 +1560,11 @@ namespace mongo {
            Connect timeout is fixed, but short, at 5 seconds.
          */
         DBClientConnection(bool _autoReconnect=false, DBClientReplicaSet* cp=0, double so_timeout=0) :
-            clientSet(cp), _failed(false), autoReconnect(_autoReconnect), autoReconnectBackoff(1000, 2000), _so_timeout(so_timeout) {
+            _pendingCursorKillsSince(0), clientSet(cp), _failed(false), autoReconnect(_autoReconnect), autoReconnectBackoff(1000, 2000), _so_timeout(so_timeout) {
             _numConnections.fetchAndAdd(1);
         }
 
-        virtual ~DBClientConnection() {
-            _numConnections.fetchAndAdd(-1);
-        }
+        virtual ~DBClientConnection();
 
         /** Connect to a Mongo database server.
 
@@ -1610,6 +1640,17 @@ namespace mongo {
         std::string getServerAddress() const { return _serverString; }
 
         virtual void killCursor( long long cursorID );
+
+        /**
+         * Sends the kills of cursors that are waiting for the next message to this server.
+         * Lazily killed cursors are sent along with any other message, or once they have waited
+         * a second - but that wait is only checked when another cursor is killed, so kills
+         * queued on a connection that then goes idle stay there until it is used or destroyed.
+         * ConnectionPool calls this when a connection is returned; call it before leaving any
+         * other connection idle.
+         */
+        void flushCursorKills();
+
         virtual bool callRead( Message& toSend , Message& response ) { return call( toSend , response ); }
         virtual void say( Message &toSend, bool isRetry = false , std::string * actualServer = 0 );
         virtual bool recv( Message& m );
@@ -1621,6 +1662,18 @@ namespace mongo {
 
         virtual bool lazySupported() const { return true; }
 
+        /**
+         * Asks the server to compress the traffic of this connection with the first codec of
+         * 'compressors', e.g. "snappy" or "zlib", that it supports too. Takes effect at the next
+         * connect or reconnect. A server without compression support is used uncompressed.
+         *
+         * @throws UserException if this build has no codec by one of the names.
+         */
+        void setCompressors(const std::vector<std::string>& compressors);
+
+        /** The name of the codec agreed on with the server, or empty if not compressing. */
+        std::string getCompressor() const;
+
         static int MONGO_CLIENT_FUNC getNumConnections() {
             return _numConnections.load();
         }
@@ -1646,6 +1699,17 @@ namespace mongo {
         virtual void _auth(const BSONObj& params);
         virtual void sayPiggyBack( Message &toSend );
 
+        // Queues the kill; all queued kills go out as one OP_KILL_CURSORS with the next
+        // message, or right away once there are many of them or the oldest has waited long.
+        virtual void _killCursorOnNextMessage( long long cursorId );
+
+        // Hands the queued kills to the port's piggyback buffer, so that they leave in the
+        // same write as whatever is sent next.
+        void _piggyBackCursorKills();
+
+        std::vector<long long> _pendingCursorKills;
+        unsigned long long _pendingCursorKillsSince; // when the oldest queued kill was queued
+
         DBClientReplicaSet *clientSet;
         boost::scoped_ptr<MessagingPort> p;
         boost::scoped_ptr<SockAddr> server;
@@ -1662,8 +1726,12 @@ namespace mongo {
 
         std::map<std::string, BSONObj> authCache;
         double _so_timeout;
+        std::vector<std::string> _compressors;
         bool _connect( std::string& errmsg );
 
+        // Switches to the first codec the server accepted in its isMaster reply, if any.
+        void _negotiateCompression(const BSONObj& isMasterReply);
+
         static AtomicInt32 _numConnections;
         static bool _lazyKillCursor; // lazy means we piggy back kill cursors on next op
 
@@ -53,8 +53,8 @@ namespace mongo {
         builder->appendNum(_flags);
     }
 
-    void DeleteWriteOperation::appendSelfToRequest(BufBuilder* builder) const {
-        _selector.appendSelfToBufBuilder(*builder);
+    void DeleteWriteOperation::appendSelfToRequest(std::vector<BSONObj>* documents) const {
+        documents->push_back(_selector);
     }
 
     void DeleteWriteOperation::startCommand(const std::string& ns, BSONObjBuilder* command) const {
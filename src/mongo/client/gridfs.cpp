@@ -21,6 +21,8 @@
 
 #include <algorithm>
 #include <boost/smart_ptr.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
 #include <fcntl.h>
 #include <fstream>
 #include <utility>
@@ -29,6 +31,7 @@
 #include <io.h>
 #endif
 
+#include "mongo/client/bulk_writer.h"
 #include "mongo/client/dbclientcursor.h"
 
 #ifndef MIN
@@ -48,6 +51,13 @@ namespace mongo {
 
     const unsigned DEFAULT_CHUNK_SIZE = 255 * 1024;
 
+    namespace {
+        // GridFileReader asks for the next batch of chunks once this much of one has been read,
+        const double kChunkPrefetchFraction = 0.5;
+        // and lets batches grow up to this size while the reader keeps up.
+        const int kMaxChunkBatchBytes = 16 * 1024 * 1024;
+    } // namespace
+
     GridFSChunk::GridFSChunk( BSONObj o ) {
         _data = o;
     }
@@ -61,6 +71,48 @@ namespace mongo {
     }
 
 
+    class GridFS::ChunkUploader : private boost::noncopyable {
+    public:
+        ChunkUploader(const ConnectionFactory& connectionFactory,
+                      const string& chunksNS,
+                      size_t numConnections)
+            : _status(Status::OK())
+            , _writer(connectionFactory,
+                      chunksNS,
+                      WriteConcern::acknowledged,
+                      stdx::bind(&ChunkUploader::_onBatch, this,
+                                 stdx::placeholders::_1, stdx::placeholders::_2),
+                      numConnections) {
+        }
+
+        void insert(const BSONObj& chunk) {
+            _writer.insert(chunk);
+        }
+
+        // Waits for every chunk inserted so far; throws if any of them could not be stored.
+        void waitForAll() {
+            _writer.waitForAll();
+
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            const Status status = _status;
+            _status = Status::OK();
+            uassert(18755,
+                    str::stream() << "Error storing GridFS chunks: " << status.toString(),
+                    status.isOK());
+        }
+
+    private:
+        void _onBatch(const Status& status, const WriteResult&) {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            if (_status.isOK())
+                _status = status;
+        }
+
+        boost::mutex _mutex;
+        Status _status; // the first failure since the last waitForAll()
+        BulkWriter _writer;
+    };
+
     GridFS::GridFS( DBClientBase& client , const string& dbName , const string& prefix ) : _client( client ) , _dbName( dbName ) , _prefix( prefix ) {
         _filesNS = dbName + "." + prefix + ".files";
         _chunksNS = dbName + "." + prefix + ".chunks";
@@ -83,6 +135,13 @@ namespace mongo {
         return _chunkSize;
     }
 
+    void GridFS::setUploadConnections(const ConnectionFactory& connectionFactory,
+                                      size_t numConnections) {
+        _uploader.reset();
+        if (numConnections > 0)
+            _uploader.reset(new ChunkUploader(connectionFactory, _chunksNS, numConnections));
+    }
+
     BSONObj GridFS::storeFile( const char* data , size_t length , const string& remoteName , const string& contentType) {
         char const * const end = data + length;
 
@@ -90,15 +149,17 @@ namespace mongo {
         id.init();
         BSONObj idObj = BSON("_id" << id);
 
+        ChunkBatch batch;
         int chunkNumber = 0;
         while (data < end) {
             int chunkLen = MIN(_chunkSize, (unsigned)(end-data));
             GridFSChunk c(idObj, chunkNumber, data, chunkLen);
-            _client.insert( _chunksNS.c_str() , c._data );
+            _insertChunk( &batch , c );
 
             chunkNumber++;
             data += chunkLen;
         }
+        _flushChunks( &batch );
 
         return insertFile(remoteName, id, length, contentType);
     }
@@ -116,6 +177,7 @@ namespace mongo {
         id.init();
         BSONObj idObj = BSON("_id" << id);
 
+        ChunkBatch batch;
         int chunkNumber = 0;
         gridfs_offset length = 0;
         while (!feof(fd)) {
@@ -132,7 +194,7 @@ namespace mongo {
             }
 
             GridFSChunk c(idObj, chunkNumber, buf, chunkLen);
-            _client.insert( _chunksNS.c_str() , c._data );
+            _insertChunk( &batch , c );
 
             length += chunkLen;
             chunkNumber++;
@@ -142,6 +204,8 @@ namespace mongo {
         if (fd != stdin)
             fclose( fd );
 
+        _flushChunks( &batch );
+
         return insertFile((remoteName.empty() ? fileName : remoteName), id, length, contentType);
     }
 
@@ -213,8 +277,32 @@ namespace mongo {
         return _client.query( _filesNS.c_str() , o );
     }
 
-    void GridFS::_insertChunk( const GridFSChunk& chunk ) {
-        _client.insert( _chunksNS.c_str() , chunk._data );
+    void GridFS::_insertChunk( ChunkBatch* batch , const GridFSChunk& chunk ) {
+        if ( _uploader ) {
+            _uploader->insert( chunk._data );
+            return;
+        }
+
+        const int size = chunk._data.objsize();
+        if ( !batch->chunks.empty() &&
+             ( batch->bytes + size > _client.getMaxMessageSizeBytes() ||
+               batch->chunks.size() >= static_cast<size_t>( _client.getMaxWriteBatchSize() ) ) ) {
+            _client.insert( _chunksNS , batch->chunks );
+            batch->chunks.clear();
+            batch->bytes = 0;
+        }
+        batch->chunks.push_back( chunk._data );
+        batch->bytes += size;
+    }
+
+    void GridFS::_flushChunks( ChunkBatch* batch ) {
+        if ( !batch->chunks.empty() ) {
+            _client.insert( _chunksNS , batch->chunks );
+            batch->chunks.clear();
+            batch->bytes = 0;
+        }
+        if ( _uploader )
+            _uploader->waitForAll();
     }
 
     BSONObj GridFile::getMetadata() const {
@@ -238,19 +326,8 @@ namespace mongo {
     }
 
     gridfs_offset GridFile::write( ostream & out ) const {
-        _exists();
-
-        const int num = getNumChunks();
-
-        for ( int i=0; i<num; i++ ) {
-            GridFSChunk c = getChunk( i );
-
-            int len;
-            const char * data = c.data( len );
-            out.write( data , len );
-        }
-
-        return getContentLength();
+        GridFileReader reader( *this );
+        return reader.write( out );
     }
 
     gridfs_offset GridFile::write( const string& where ) const {
@@ -267,6 +344,95 @@ namespace mongo {
     void GridFile::_exists() const {
         uassert( 10015 ,  "doesn't exists" , exists() );
     }
+
+    GridFileReader::GridFileReader( const GridFile& file , gridfs_offset offset ) :
+        _grid( file._grid ),
+        _length( file.getContentLength() ),
+        _chunkSize( file.getChunkSize() ),
+        _offset( 0 ),
+        _nextChunk( 0 ),
+        _chunkNumber( -1 ),
+        _chunkData( NULL ),
+        _chunkLen( 0 ) {
+        file._exists();
+        _query = BSON( "files_id" << file._obj["_id"] );
+        seek( offset );
+    }
+
+    GridFileReader::~GridFileReader() {
+    }
+
+    size_t GridFileReader::read( char* buf , size_t length ) {
+        size_t copied = 0;
+        while ( copied < length && !eof() ) {
+            const size_t size = min( length - copied , _loadChunk() );
+            memcpy( buf + copied , _current() , size );
+            copied += size;
+            _offset += size;
+        }
+        return copied;
+    }
+
+    gridfs_offset GridFileReader::write( ostream& out ) {
+        const gridfs_offset start = _offset;
+        while ( !eof() ) {
+            const size_t size = _loadChunk();
+            out.write( _current() , size );
+            _offset += size;
+        }
+        return _offset - start;
+    }
+
+    void GridFileReader::seek( gridfs_offset offset ) {
+        _offset = min( offset , _length );
+    }
+
+    size_t GridFileReader::_loadChunk() {
+        const int wanted = static_cast<int>( _offset / _chunkSize );
+
+        if ( wanted != _chunkNumber ) {
+            // _chunkData points into the cursor's batch, so forget it before the cursor goes.
+            _chunkNumber = -1;
+
+            // Chunks already received are skipped through; anything else is queried for, so
+            // that the chunks in between are never fetched.
+            if ( !_cursor.get() || wanted < _nextChunk ||
+                 wanted - _nextChunk > _cursor->objsLeftInBatch() ) {
+                BSONObjBuilder b;
+                b.appendElements( _query );
+                b << "n" << GTE << wanted;
+                const BSONObj fields = BSON( "n" << 1 << "data" << 1 << "_id" << 0 );
+
+                _cursor.reset();
+                _cursor = _grid->_client.query( _grid->_chunksNS , Query( b.obj() ).sort( "n" ) ,
+                                                0 , 0 , &fields );
+                uassert( 18756 , "GridFS chunk query failed" , _cursor.get() );
+                _cursor->setPrefetchFraction( kChunkPrefetchFraction );
+                _cursor->setAdaptiveBatchSizing( kMaxChunkBatchBytes );
+                _nextChunk = wanted;
+            }
+
+            while ( _nextChunk <= wanted ) {
+                uassert( 10014 , "chunk is empty!" , _cursor->more() );
+                _chunk = _cursor->nextSafe();
+                uassert( 10014 , "chunk is empty!" , _chunk["n"].numberInt() == _nextChunk );
+                ++_nextChunk;
+            }
+            _chunkNumber = wanted;
+            _chunkData = _chunk["data"].binDataClean( _chunkLen );
+        }
+
+        const gridfs_offset inChunk = _offset - static_cast<gridfs_offset>( _chunkNumber ) * _chunkSize;
+        uassert( 18757 ,
+                 str::stream() << "GridFS chunk " << _chunkNumber << " is too short" ,
+                 inChunk < static_cast<gridfs_offset>( _chunkLen ) );
+        return min( static_cast<size_t>( _chunkLen - inChunk ) ,
+                    static_cast<size_t>( _length - _offset ) );
+    }
+
+    const char* GridFileReader::_current() const {
+        return _chunkData + ( _offset - static_cast<gridfs_offset>( _chunkNumber ) * _chunkSize );
+    }
     
     GridFileBuilder::GridFileBuilder( GridFS* const grid ) :
         _grid( grid ),
@@ -290,7 +456,7 @@ namespace mongo {
             if ((chunkLen < _chunkSize) && (!forcePendingInsert))
                 break;
             GridFSChunk chunk( _fileIdObj, _currentChunk, data, chunkLen );
-            _grid->_insertChunk( chunk );
+            _grid->_insertChunk( &_chunks, chunk );
             ++_currentChunk;
             data += chunkLen;
             _fileLength += chunkLen;
@@ -318,7 +484,8 @@ namespace mongo {
             invariant( _pendingDataSize <= _chunkSize );
             if (_pendingDataSize == _chunkSize) {
                 _appendPendingData();
-                _appendChunk( data + size, length - size, false );
+                // the remainder starts a new run of chunks, possibly leaving pending data
+                appendChunk( data + size, length - size );
             }
         }
         else {
@@ -338,6 +505,7 @@ namespace mongo {
     BSONObj GridFileBuilder::buildFile( const string& remoteName,
                                         const string& contentType ) {
         _appendPendingData();
+        _grid->_flushChunks( &_chunks );
         BSONObj ret = _grid->insertFile( remoteName, _fileId, _fileLength,
                                          contentType );
         // resets the object to allow more data append for a GridFile
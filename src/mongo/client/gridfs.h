@@ -17,12 +17,16 @@
 
 #pragma once
 
+#include "boost/noncopyable.hpp"
 #include "boost/scoped_array.hpp"
+#include "boost/scoped_ptr.hpp"
+#include <vector>
 
 #include "mongo/bson/bsonelement.h"
 #include "mongo/bson/bsonobj.h"
 #include "mongo/client/dbclientinterface.h"
 #include "mongo/client/export_macros.h"
+#include "mongo/stdx/functional.h"
 
 namespace mongo {
 
@@ -31,6 +35,7 @@ namespace mongo {
     class GridFS;
     class GridFile;
     class GridFileBuilder;
+    class GridFileReader;
 
     class MONGO_CLIENT_API GridFSChunk {
     public:
@@ -59,6 +64,8 @@ namespace mongo {
      */
     class MONGO_CLIENT_API GridFS {
     public:
+        typedef stdx::function<DBClientBase* ()> ConnectionFactory;
+
         /**
          * @param client - db connection
          * @param dbName - root database name
@@ -74,6 +81,17 @@ namespace mongo {
 
         unsigned int getChunkSize() const;
 
+        /**
+         * Sends the chunks of files stored from now on over 'numConnections' connections of
+         * their own, opened through 'connectionFactory', instead of over the GridFS
+         * connection. Batches of chunks are then inserted in parallel, with an acknowledged
+         * write concern; the file object is still written, once they are all in, over the
+         * GridFS connection. The connections are kept until this is called again;
+         * 'numConnections' of 0 goes back to sending the chunks over the GridFS connection.
+         */
+        void setUploadConnections(const ConnectionFactory& connectionFactory,
+                                  size_t numConnections);
+
         /**
          * puts the file reference by fileName into the db
          * @param fileName local filename relative to process
@@ -131,15 +149,31 @@ namespace mongo {
         std::string _chunksNS;
         unsigned int _chunkSize;
 
+        // Chunks of one file waiting to be inserted over _client in a single batch.
+        struct ChunkBatch {
+            ChunkBatch() : bytes(0) {}
+            std::vector<BSONObj> chunks;
+            int bytes;
+        };
+
+        // Sends the chunks over the connections given to setUploadConnections(), if any.
+        class ChunkUploader;
+        boost::scoped_ptr<ChunkUploader> _uploader;
+
         // insert fileobject. All chunks must be in DB.
         BSONObj insertFile(const std::string& name, const OID& id, gridfs_offset length, const std::string& contentType);
 
-        // Insert a chunk into DB, this method is intended to be used by
-        // GridFileBuilder to incrementally insert chunks
-        void _insertChunk(const GridFSChunk& chunk);
+        // Queues a chunk for insertion, sending 'batch' first if it can't take the chunk
+        // within the server's message size and write batch limits. Also used by
+        // GridFileBuilder to incrementally insert chunks.
+        void _insertChunk(ChunkBatch* batch, const GridFSChunk& chunk);
+
+        // Sends what is left in 'batch' and waits until every chunk queued so far is in.
+        void _flushChunks(ChunkBatch* batch);
 
         friend class GridFile;
         friend class GridFileBuilder;
+        friend class GridFileReader;
     };
 
     /**
@@ -210,6 +244,75 @@ namespace mongo {
         BSONObj        _obj;
 
         friend class GridFS;
+        friend class GridFileReader;
+    };
+
+    /**
+     * Streams the contents of a GridFile from a single cursor over its chunks, sorted by "n",
+     * instead of querying for each chunk. Reading can start at any offset without fetching the
+     * chunks before it, and the next batch of chunks is requested while the current one is
+     * still being read.
+     *
+     * While a reader has chunks outstanding, the connection of its GridFS must not be used for
+     * anything else (see DBClientCursor::setPrefetchFraction()).
+     */
+    class MONGO_CLIENT_API GridFileReader : private boost::noncopyable {
+    public:
+        /**
+         * @param file - an existing file
+         * @param offset - where to start reading
+         */
+        explicit GridFileReader( const GridFile& file , gridfs_offset offset = 0 );
+        ~GridFileReader();
+
+        /**
+         * Copies up to 'length' bytes from the current position to 'buf' and moves past them.
+         * @return the number of bytes copied, which is less than 'length' only at the end of
+         *         the file
+         */
+        size_t read( char* buf , size_t length );
+
+        /**
+         * Writes the rest of the file, from the current position, to 'out'.
+         * @return the number of bytes written
+         */
+        gridfs_offset write( std::ostream& out );
+
+        /**
+         * Moves to 'offset'. Seeking into the chunks already received is free; anywhere else
+         * starts a new query at the chunk holding 'offset'.
+         */
+        void seek( gridfs_offset offset );
+
+        gridfs_offset tell() const { return _offset; }
+
+        gridfs_offset getContentLength() const { return _length; }
+
+        bool eof() const { return _offset >= _length; }
+
+    private:
+        // Makes the chunk holding _offset current, querying from it if necessary, and returns
+        // how many of its bytes are left from _offset on.
+        size_t _loadChunk();
+
+        // Where _offset lies in the current chunk.
+        const char* _current() const;
+
+        const GridFS* const _grid;
+        BSONObj _query; // { files_id : <id> }
+        const gridfs_offset _length;
+        const int _chunkSize;
+        gridfs_offset _offset;
+
+        std::auto_ptr<DBClientCursor> _cursor;
+        int _nextChunk; // what _cursor returns next
+
+        // The current chunk. It lies in _cursor's current batch, which stays in place until
+        // the cursor is advanced past the chunk.
+        BSONObj _chunk;
+        int _chunkNumber; // of _chunk, -1 if none
+        const char* _chunkData;
+        int _chunkLen;
     };
     
     /**
@@ -253,6 +356,7 @@ namespace mongo {
         boost::scoped_array<char> _pendingData; // pointer with _chunkSize space
         size_t _pendingDataSize;
         gridfs_offset _fileLength;
+        GridFS::ChunkBatch _chunks; // full chunks not yet sent
 
         const char* _appendChunk( const char* data, size_t length,
                                   bool forcePendingInsert );
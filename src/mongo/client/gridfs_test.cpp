@@ -0,0 +1,254 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/client/gridfs.h"
+
+#include <algorithm>
+#include <boost/scoped_ptr.hpp>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "mongo/client/dbclientinterface.h"
+#include "mongo/dbtests/mock/mock_wire_server.h"
+#include "mongo/unittest/unittest.h"
+#include "mongo/util/md5.hpp"
+#include "mongo/util/net/message.h"
+
+namespace {
+
+    using mongo::BSONObj;
+    using mongo::DBClientBase;
+    using mongo::GridFile;
+    using mongo::GridFileBuilder;
+    using mongo::GridFileReader;
+    using mongo::GridFS;
+    using mongo::MockWireServer;
+    using mongo::OID;
+
+    const char kChunksNS[] = "test.fs.chunks";
+    const char kFilesNS[] = "test.fs.files";
+
+    std::string makeData(size_t length) {
+        std::string data(length, '\0');
+        for (size_t i = 0; i < length; ++i)
+            data[i] = static_cast<char>(i * 31 + i / 7);
+        return data;
+    }
+
+    class GridFSTest : public mongo::unittest::Test {
+    protected:
+        void setUp() {
+            _conn.reset(_server.connect());
+            _gfs.reset(new GridFS(*_conn, "test"));
+            _gfs->setChunkSize(1024);
+        }
+
+        // Number of OP_INSERTs sent while storing 'data' as one file.
+        size_t insertsToStore(const std::string& data) {
+            const size_t before = _server.getOpCount(mongo::dbInsert);
+            const BSONObj file = _gfs->storeFile(data.data(), data.size(), "data");
+            EXPECT_EQ(mongo::md5simpledigest(data), file["md5"].str());
+            return _server.getOpCount(mongo::dbInsert) - before;
+        }
+
+        // Stores a file of 'numChunks' chunks of 'chunkSize' bytes directly on the server,
+        // leaving out the chunks before 'firstChunk' and chunk 'missingChunk'.
+        std::string storeRaw(const std::string& name, int chunkSize, int numChunks,
+                             int firstChunk = 0, int missingChunk = -1) {
+            const std::string data = makeData(chunkSize * numChunks);
+            const OID id = OID::gen();
+            for (int n = firstChunk; n < numChunks; ++n) {
+                if (n == missingChunk)
+                    continue;
+                _server.insert(kChunksNS, BSON("files_id" << id << "n" << n << "data"
+                                               << mongo::BSONBinData(data.data() + n * chunkSize,
+                                                                     chunkSize,
+                                                                     mongo::BinDataGeneral)));
+            }
+            _server.insert(kFilesNS, BSON("_id" << id << "filename" << name
+                                          << "chunkSize" << chunkSize
+                                          << "length" << static_cast<int>(data.size())));
+            return data;
+        }
+
+        size_t queries() const {
+            return _server.getOpCount(mongo::dbQuery);
+        }
+
+        MockWireServer _server;
+        boost::scoped_ptr<DBClientBase> _conn;
+        boost::scoped_ptr<GridFS> _gfs;
+    };
+
+    TEST_F(GridFSTest, BatchesChunks) {
+        const std::string data = makeData(10 * 1024 + 100);
+
+        // One insert for all the chunks, one for the file object.
+        ASSERT_EQUALS(2U, insertsToStore(data));
+        ASSERT_EQUALS(11U, _server.getDocuments(kChunksNS).size());
+        ASSERT_EQUALS(1U, _server.getDocuments(kFilesNS).size());
+    }
+
+    TEST_F(GridFSTest, SplitsBatchesAtMaxWriteBatchSize) {
+        _gfs->setChunkSize(1);
+        const std::string data = makeData(1500);
+
+        // maxWriteBatchSize is 1000
+        ASSERT_EQUALS(3U, insertsToStore(data));
+        ASSERT_EQUALS(1500U, _server.getDocuments(kChunksNS).size());
+    }
+
+    TEST_F(GridFSTest, BuilderBatchesChunks) {
+        const std::string data = makeData(5 * 1024 + 10);
+
+        const size_t before = _server.getOpCount(mongo::dbInsert);
+        GridFileBuilder builder(_gfs.get());
+        for (size_t offset = 0; offset < data.size(); offset += 700) {
+            builder.appendChunk(data.data() + offset, std::min<size_t>(700, data.size() - offset));
+        }
+        const BSONObj file = builder.buildFile("data");
+
+        ASSERT_EQUALS(2U, _server.getOpCount(mongo::dbInsert) - before);
+        ASSERT_EQUALS(mongo::md5simpledigest(data), file["md5"].str());
+        ASSERT_EQUALS(static_cast<int>(data.size()), file["length"].numberInt());
+        ASSERT_EQUALS(6U, _server.getDocuments(kChunksNS).size());
+    }
+
+    TEST_F(GridFSTest, UploadsOverSeveralConnections) {
+        _gfs->setChunkSize(1);
+        _gfs->setUploadConnections(mongo::stdx::bind(&MockWireServer::connect, &_server), 3);
+        const std::string data = makeData(3500);
+
+        const BSONObj file = _gfs->storeFile(data.data(), data.size(), "data");
+
+        ASSERT_EQUALS(mongo::md5simpledigest(data), file["md5"].str());
+        ASSERT_EQUALS(3500U, _server.getDocuments(kChunksNS).size());
+        ASSERT_EQUALS(1U, _server.getDocuments(kFilesNS).size());
+        ASSERT_EQUALS(4U, _server.getConnectionCount());
+
+        // The upload connections are kept for the next file.
+        _gfs->storeFile(data.data(), data.size(), "again");
+        ASSERT_EQUALS(4U, _server.getConnectionCount());
+
+        _gfs->setUploadConnections(GridFS::ConnectionFactory(), 0);
+        ASSERT_EQUALS(2U, insertsToStore(makeData(10)));
+    }
+
+    TEST_F(GridFSTest, WritesFileFromOneQuery) {
+        const std::string data = makeData(20 * 1024 + 1);
+        _gfs->storeFile(data.data(), data.size(), "data");
+        const GridFile file = _gfs->findFileByName("data");
+
+        const size_t before = queries();
+        std::stringstream out;
+        ASSERT_EQUALS(data.size(), file.write(out));
+
+        ASSERT_EQUALS(1U, queries() - before);
+        ASSERT_EQUALS(data, out.str());
+    }
+
+    TEST_F(GridFSTest, ReadsAcrossBatches) {
+        const std::string data = storeRaw("data", 16, 500);
+        const GridFile file = _gfs->findFileByName("data");
+
+        GridFileReader reader(file);
+        std::string read;
+        char buf[100];
+        while (size_t n = reader.read(buf, sizeof(buf)))
+            read.append(buf, n);
+
+        ASSERT_TRUE(reader.eof());
+        ASSERT_EQUALS(data, read);
+        ASSERT_GREATER_THAN(_server.getOpCount(mongo::dbGetMore), 0U);
+    }
+
+    TEST_F(GridFSTest, ReadsRangeWithoutEarlierChunks) {
+        // Reading from chunk 0 would find it missing.
+        const std::string data = storeRaw("data", 16, 10, 4);
+        const GridFile file = _gfs->findFileByName("data");
+
+        GridFileReader reader(file, 4 * 16 + 5);
+        char buf[40];
+        ASSERT_EQUALS(sizeof(buf), reader.read(buf, sizeof(buf)));
+        ASSERT_EQUALS(data.substr(4 * 16 + 5, sizeof(buf)), std::string(buf, sizeof(buf)));
+        ASSERT_EQUALS(static_cast<mongo::gridfs_offset>(4 * 16 + 5 + sizeof(buf)), reader.tell());
+
+        reader.seek(0);
+        ASSERT_THROWS(reader.read(buf, sizeof(buf)), mongo::UserException);
+    }
+
+    TEST_F(GridFSTest, SeeksWithinReceivedChunksWithoutQuerying) {
+        const std::string data = storeRaw("data", 16, 50);
+        const GridFile file = _gfs->findFileByName("data");
+
+        const size_t before = queries();
+        GridFileReader reader(file);
+        char buf[10];
+        reader.read(buf, sizeof(buf));
+
+        reader.seek(30 * 16 + 3);
+        ASSERT_EQUALS(sizeof(buf), reader.read(buf, sizeof(buf)));
+        ASSERT_EQUALS(data.substr(30 * 16 + 3, sizeof(buf)), std::string(buf, sizeof(buf)));
+        ASSERT_EQUALS(1U, queries() - before);
+
+        // Going back needs a new query.
+        reader.seek(7);
+        ASSERT_EQUALS(sizeof(buf), reader.read(buf, sizeof(buf)));
+        ASSERT_EQUALS(data.substr(7, sizeof(buf)), std::string(buf, sizeof(buf)));
+        ASSERT_EQUALS(2U, queries() - before);
+
+        reader.seek(data.size() - 4);
+        ASSERT_EQUALS(4U, reader.read(buf, sizeof(buf)));
+        ASSERT_EQUALS(0U, reader.read(buf, sizeof(buf)));
+        ASSERT_TRUE(reader.eof());
+    }
+
+    TEST(GridFileReader, FailedRequeryDoesNotKeepStaleChunk) {
+        boost::scoped_ptr<MockWireServer> server(new MockWireServer());
+        boost::scoped_ptr<DBClientBase> conn(server->connect());
+        GridFS gfs(*conn, "test");
+        gfs.setChunkSize(16);
+        const std::string data = makeData(16 * 50);
+        gfs.storeFile(data.data(), data.size(), "data");
+        const GridFile file = gfs.findFileByName("data");
+
+        GridFileReader reader(file, 30 * 16);
+        char buf[10];
+        ASSERT_EQUALS(sizeof(buf), reader.read(buf, sizeof(buf)));
+
+        // Going back needs a new query, which fails without a server.
+        server.reset();
+        reader.seek(0);
+        ASSERT_THROWS(reader.read(buf, sizeof(buf)), mongo::DBException);
+
+        // The chunk read before is gone with the old cursor.
+        reader.seek(30 * 16);
+        ASSERT_THROWS(reader.read(buf, sizeof(buf)), mongo::DBException);
+    }
+
+    TEST_F(GridFSTest, ReadFailsOnMissingChunk) {
+        storeRaw("data", 16, 10, 0, 6);
+        const GridFile file = _gfs->findFileByName("data");
+
+        GridFileReader reader(file);
+        char buf[16 * 6];
+        ASSERT_EQUALS(sizeof(buf), reader.read(buf, sizeof(buf)));
+        ASSERT_THROWS(reader.read(buf, 1), mongo::UserException);
+    }
+
+} // namespace
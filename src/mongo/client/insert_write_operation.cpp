@@ -49,8 +49,8 @@ namespace mongo {
         builder->appendStr(ns);
     }
 
-    void InsertWriteOperation::appendSelfToRequest(BufBuilder* builder) const {
-        _doc.appendSelfToBufBuilder(*builder);
+    void InsertWriteOperation::appendSelfToRequest(std::vector<BSONObj>* documents) const {
+        documents->push_back(_doc);
     }
 
     void InsertWriteOperation::startCommand(const std::string& ns, BSONObjBuilder* command) const {
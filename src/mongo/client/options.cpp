@@ -50,6 +50,7 @@ namespace client {
         , _defaultLocalThresholdMillis(kDefaultDefaultLocalThresholdMillis)
         , _minLoggedSeverity(logger::LogSeverity::Log())
         , _validateObjects(false)
+        , _validateUTF8(false)
     {}
 
     Options& Options::setCallShutdownAtExit(bool value) {
@@ -178,5 +179,14 @@ namespace client {
         return _validateObjects;
     }
 
+    Options& Options::setValidateUTF8(bool value) {
+        _validateUTF8 = value;
+        return *this;
+    }
+
+    bool Options::validateUTF8() const {
+        return _validateUTF8;
+    }
+
 } // namespace client
 } // namespace mongo
@@ -219,6 +219,14 @@ namespace client {
         Options& setValidateObjects(bool value = true);
         bool validateObjects() const;
 
+        /** Configure whether validated objects (see setValidateObjects) must also hold only
+         *  valid UTF-8 in their field names and strings.
+         *
+         *  Default: false
+         */
+        Options& setValidateUTF8(bool value = true);
+        bool validateUTF8() const;
+
     private:
         bool _callShutdownAtExit;
         unsigned int _autoShutdownGracePeriodMillis;
@@ -234,6 +242,7 @@ namespace client {
         LogAppenderFactory _appenderFactory;
         logger::LogSeverity _minLoggedSeverity;
         bool _validateObjects;
+        bool _validateUTF8;
     };
 
 } // namespace client
@@ -0,0 +1,189 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kNetworking
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/client/parallel_scan.h"
+
+#include <boost/thread/locks.hpp>
+
+#include "mongo/client/dbclientcursor.h"
+#include "mongo/util/assert_util.h"
+#include "mongo/util/log.h"
+
+namespace mongo {
+
+    ParallelScan::ParallelScan(DBClientBase* conn,
+                               const StringData& ns,
+                               int numCursors,
+                               const ConnectionFactory& connectionFactory)
+        : _conn(conn)
+        , _ns(ns.toString())
+        , _numCursors(numCursors)
+        , _connectionFactory(connectionFactory)
+        , _numCursorsReturned(0)
+        , _started(false)
+        , _cancelled(0)
+        , _maxQueuedDocuments(0)
+        , _activeWorkers(0)
+        , _status(Status::OK()) {
+    }
+
+    ParallelScan::~ParallelScan() {
+        DESTRUCTOR_GUARD(
+            cancel();
+            _finish();
+        );
+    }
+
+    Status ParallelScan::run(const DocumentCallback& callback) {
+        _start(callback);
+        _finish();
+
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        if (_status.isOK() && _cancelled.load())
+            return Status(ErrorCodes::CallbackCanceled, "parallel scan was cancelled");
+        return _status;
+    }
+
+    void ParallelScan::start(size_t maxQueuedDocuments) {
+        verify(maxQueuedDocuments > 0);
+        _maxQueuedDocuments = maxQueuedDocuments;
+        _start(stdx::bind(&ParallelScan::_enqueue, this, stdx::placeholders::_1));
+    }
+
+    bool ParallelScan::next(BSONObj* doc) {
+        boost::unique_lock<boost::mutex> lk(_mutex);
+        while (_queue.empty() && _activeWorkers > 0 && _status.isOK() && !_cancelled.load()) {
+            _notEmpty.wait(lk);
+        }
+
+        if (!_status.isOK())
+            uasserted(_status.code(), _status.reason());
+
+        if (_queue.empty() || _cancelled.load())
+            return false;
+
+        *doc = _queue.front();
+        _queue.pop_front();
+        _notFull.notify_one();
+        return true;
+    }
+
+    void ParallelScan::cancel() {
+        _cancelled.store(1);
+
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        _notEmpty.notify_all();
+        _notFull.notify_all();
+    }
+
+    void ParallelScan::_start(const DocumentCallback& sink) {
+        uassert(18733, "a parallel scan can only be started once", !_started);
+        _started = true;
+
+        _conn->parallelScan(_ns, _numCursors, &_cursors,
+                            stdx::bind(&ParallelScan::_makeConnection, this));
+        verify(_cursors.size() == _connections.size());
+        _numCursorsReturned = _cursors.size();
+
+        LOG(1) << "parallel scan of " << _ns << " using " << _cursors.size() << " cursors"
+               << std::endl;
+
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        for (size_t i = 0; i < _cursors.size(); ++i) {
+            _workers.create_thread(stdx::bind(&ParallelScan::_work, this, _cursors[i], sink));
+            ++_activeWorkers;
+        }
+    }
+
+    void ParallelScan::_work(DBClientCursor* cursor, DocumentCallback sink) {
+        try {
+            while (!_cancelled.load() && cursor->more()) {
+                sink(cursor->nextSafe());
+            }
+        }
+        catch (const DBException& ex) {
+            _fail(ex.toStatus());
+        }
+        catch (const std::exception& ex) {
+            _fail(Status(ErrorCodes::UnknownError, ex.what()));
+        }
+
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        if (--_activeWorkers == 0)
+            _notEmpty.notify_all();
+    }
+
+    void ParallelScan::_enqueue(const BSONObj& doc) {
+        BSONObj owned = doc.getOwned();
+
+        boost::unique_lock<boost::mutex> lk(_mutex);
+        while (_queue.size() >= _maxQueuedDocuments && !_cancelled.load()) {
+            _notFull.wait(lk);
+        }
+
+        if (_cancelled.load())
+            return;
+
+        _queue.push_back(owned);
+        _notEmpty.notify_one();
+    }
+
+    void ParallelScan::_fail(const Status& status) {
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            if (_status.isOK())
+                _status = status;
+        }
+        cancel();
+    }
+
+    void ParallelScan::_finish() {
+        _workers.join_all();
+
+        for (size_t i = 0; i < _cursors.size(); ++i) {
+            // A cursor that was stopped early is killed by its destructor, unless its
+            // connection is gone; then the only way to reach the server is our own connection.
+            const long long cursorId = _cursors[i]->getCursorId();
+            if (cursorId && _connections[i]->isFailed()) {
+                try {
+                    _conn->killCursor(cursorId);
+                }
+                catch (const DBException& ex) {
+                    warning() << "failed to kill cursor " << cursorId << " of parallel scan of "
+                              << _ns << ": " << ex.toString() << std::endl;
+                }
+                _cursors[i]->decouple();
+            }
+            delete _cursors[i];
+        }
+        _cursors.clear();
+
+        for (size_t i = 0; i < _connections.size(); ++i) {
+            delete _connections[i];
+        }
+        _connections.clear();
+    }
+
+    DBClientBase* ParallelScan::_makeConnection() {
+        DBClientBase* conn = _connectionFactory();
+        _connections.push_back(conn);
+        return conn;
+    }
+
+} // namespace mongo
@@ -0,0 +1,158 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "mongo/base/status.h"
+#include "mongo/base/string_data.h"
+#include "mongo/client/dbclientinterface.h"
+#include "mongo/client/export_macros.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/stdx/functional.h"
+
+namespace mongo {
+
+    /**
+     * Runs a parallelCollectionScan and drains all of its cursors concurrently, one worker
+     * thread and one connection per cursor.
+     *
+     * DBClientBase::parallelScan only hands back the cursors; threads, error handling and
+     * cleanup are left to the caller. A ParallelScan takes care of all of that. Documents are
+     * delivered either to a callback, which the workers invoke directly:
+     *
+     *   ParallelScan scan(&conn, "test.foo", 4, factory);
+     *   Status status = scan.run(callback);
+     *
+     * or through a bounded queue that any number of threads may consume from:
+     *
+     *   ParallelScan scan(&conn, "test.foo", 4, factory);
+     *   scan.start(10000);
+     *   BSONObj doc;
+     *   while (scan.next(&doc)) { ... }
+     *
+     * The first error, whether from a cursor or from the callback, stops all workers. Cursors
+     * left open on the server by a stopped worker are killed, through the original connection
+     * if the worker's own connection has failed.
+     */
+    class MONGO_CLIENT_API ParallelScan : private boost::noncopyable {
+    public:
+        typedef stdx::function<DBClientBase* ()> ConnectionFactory;
+
+        /**
+         * Receives each document of the scan. Called concurrently from the worker threads; the
+         * document is only valid for the duration of the call.
+         */
+        typedef stdx::function<void (const BSONObj&)> DocumentCallback;
+
+        /**
+         * @param conn Runs the parallelCollectionScan command. Must outlive the ParallelScan and
+         *  must not be used by anyone else while the scan is running.
+         * @param ns The namespace to scan.
+         * @param numCursors The number of cursors, and so of worker threads, to ask for. The
+         *  server may return fewer.
+         * @param connectionFactory Opens the connection for each cursor, as for
+         *  DBClientBase::parallelScan. The ParallelScan owns the connections it returns.
+         */
+        ParallelScan(DBClientBase* conn,
+                     const StringData& ns,
+                     int numCursors,
+                     const ConnectionFactory& connectionFactory);
+
+        /** Stops a scan that is still running and releases all cursors and connections. */
+        ~ParallelScan();
+
+        /**
+         * Scans the collection, passing every document to 'callback', and returns once all
+         * workers are done. Returns the first error encountered, or CallbackCanceled if
+         * cancel() was called.
+         *
+         * @throws OperationException if the parallelCollectionScan command fails.
+         */
+        Status run(const DocumentCallback& callback);
+
+        /**
+         * Starts the workers and returns immediately. The workers copy documents into a queue
+         * of at most 'maxQueuedDocuments', blocking while it is full; next() takes them out.
+         *
+         * @throws OperationException if the parallelCollectionScan command fails.
+         */
+        void start(size_t maxQueuedDocuments);
+
+        /**
+         * Waits for the next document of a scan begun with start(). Returns false once all
+         * workers are done and the queue is empty, or once the scan has been cancelled.
+         * Thread-safe.
+         *
+         * @throws UserException carrying the first error encountered by a worker.
+         */
+        bool next(BSONObj* doc);
+
+        /** Asks the workers to stop at the next document. Thread-safe. */
+        void cancel();
+
+        /** The number of cursors the server returned. Valid after run() or start(). */
+        size_t getNumCursors() const { return _numCursorsReturned; }
+
+    private:
+        // Runs the command and starts one worker per cursor, each feeding 'sink'.
+        void _start(const DocumentCallback& sink);
+
+        void _work(DBClientCursor* cursor, DocumentCallback sink);
+
+        // The sink used by start(): copies 'doc' into the queue.
+        void _enqueue(const BSONObj& doc);
+
+        // Records the first error and stops all workers.
+        void _fail(const Status& status);
+
+        // Waits for the workers and releases cursors and connections. Idempotent.
+        void _finish();
+
+        // Wraps the user's factory so that we own every connection it makes.
+        DBClientBase* _makeConnection();
+
+        DBClientBase* const _conn;
+        const std::string _ns;
+        const int _numCursors;
+        const ConnectionFactory _connectionFactory;
+
+        // _cursors[i] runs on _connections[i]
+        std::vector<DBClientCursor*> _cursors;
+        std::vector<DBClientBase*> _connections;
+        size_t _numCursorsReturned;
+
+        boost::thread_group _workers;
+        bool _started;
+        AtomicWord<int> _cancelled;
+
+        // Protects everything below
+        boost::mutex _mutex;
+        boost::condition_variable _notEmpty;
+        boost::condition_variable _notFull;
+        std::deque<BSONObj> _queue;
+        size_t _maxQueuedDocuments;
+        size_t _activeWorkers;
+        Status _status;
+    };
+
+} // namespace mongo
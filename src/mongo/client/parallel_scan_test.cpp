@@ -0,0 +1,150 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/client/parallel_scan.h"
+
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <string>
+
+#include "mongo/dbtests/mock/mock_wire_server.h"
+#include "mongo/unittest/unittest.h"
+#include "mongo/util/time_support.h"
+
+namespace {
+
+    using mongo::BSONObj;
+    using mongo::DBClientConnection;
+    using mongo::MockWireServer;
+    using mongo::ParallelScan;
+    using mongo::Status;
+
+    const char kNamespace[] = "test.foo";
+    const int kNumDocs = 1000;
+
+    // Sums up the _id of every document it is given; fails once 'failAfter' are seen.
+    class Collector {
+    public:
+        Collector() : count(0), idSum(0), failAfter(-1) { }
+
+        void onDocument(const BSONObj& doc) {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            if (count == failAfter)
+                mongo::uasserted(12345, "collector failure");
+            ++count;
+            idSum += doc["_id"].numberInt();
+        }
+
+        int count;
+        long long idSum;
+        int failAfter;
+
+    private:
+        boost::mutex _mutex;
+    };
+
+    class ParallelScanTest : public mongo::unittest::Test {
+    protected:
+        void setUp() {
+            for (int i = 0; i < kNumDocs; ++i) {
+                _server.insert(kNamespace, BSON("_id" << i));
+            }
+
+            std::string errmsg;
+            ASSERT_TRUE(_conn.connect(_server.getHostAndPort(), errmsg));
+        }
+
+        ParallelScan::ConnectionFactory factory() {
+            return mongo::stdx::bind(&MockWireServer::connect, &_server);
+        }
+
+        ParallelScan::DocumentCallback callback() {
+            return mongo::stdx::bind(&Collector::onDocument, &_collector,
+                                     mongo::stdx::placeholders::_1);
+        }
+
+        // The server processes killCursors asynchronously.
+        size_t waitForOpenCursors() {
+            for (int i = 0; i < 500 && _server.getOpenCursorCount() > 0; ++i) {
+                mongo::sleepmillis(10);
+            }
+            return _server.getOpenCursorCount();
+        }
+
+        MockWireServer _server;
+        DBClientConnection _conn;
+        Collector _collector;
+    };
+
+    TEST_F(ParallelScanTest, RunDeliversEveryDocument) {
+        ParallelScan scan(&_conn, kNamespace, 4, factory());
+        ASSERT_OK(scan.run(callback()));
+
+        ASSERT_EQUALS(4U, scan.getNumCursors());
+        ASSERT_EQUALS(kNumDocs, _collector.count);
+        ASSERT_EQUALS(kNumDocs * (kNumDocs - 1LL) / 2, _collector.idSum);
+        ASSERT_EQUALS(5U, _server.getConnectionCount());
+        ASSERT_EQUALS(0U, _server.getOpenCursorCount());
+    }
+
+    TEST_F(ParallelScanTest, QueueDeliversEveryDocument) {
+        ParallelScan scan(&_conn, kNamespace, 3, factory());
+        scan.start(16);
+
+        BSONObj doc;
+        while (scan.next(&doc)) {
+            _collector.onDocument(doc);
+        }
+
+        ASSERT_EQUALS(kNumDocs, _collector.count);
+        ASSERT_EQUALS(kNumDocs * (kNumDocs - 1LL) / 2, _collector.idSum);
+    }
+
+    TEST_F(ParallelScanTest, CallbackErrorStopsScanAndKillsCursors) {
+        _collector.failAfter = 10;
+
+        {
+            ParallelScan scan(&_conn, kNamespace, 4, factory());
+            Status status = scan.run(callback());
+            ASSERT_EQUALS(12345, status.code());
+        }
+
+        ASSERT_EQUALS(10, _collector.count);
+        ASSERT_EQUALS(0U, waitForOpenCursors());
+    }
+
+    TEST_F(ParallelScanTest, CancelStopsQueue) {
+        {
+            ParallelScan scan(&_conn, kNamespace, 4, factory());
+            scan.start(1);
+
+            BSONObj doc;
+            ASSERT_TRUE(scan.next(&doc));
+            scan.cancel();
+            ASSERT_FALSE(scan.next(&doc));
+        }
+
+        ASSERT_EQUALS(0U, waitForOpenCursors());
+    }
+
+    TEST_F(ParallelScanTest, CannotStartTwice) {
+        ParallelScan scan(&_conn, kNamespace, 2, factory());
+        ASSERT_OK(scan.run(callback()));
+        ASSERT_THROWS(scan.run(callback()), mongo::UserException);
+    }
+
+} // namespace
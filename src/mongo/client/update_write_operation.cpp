@@ -56,9 +56,9 @@ namespace mongo {
         builder->appendNum(_flags);
     }
 
-    void UpdateWriteOperation::appendSelfToRequest(BufBuilder* builder) const {
-        _selector.appendSelfToBufBuilder(*builder);
-        _update.appendSelfToBufBuilder(*builder);
+    void UpdateWriteOperation::appendSelfToRequest(std::vector<BSONObj>* documents) const {
+        documents->push_back(_selector);
+        documents->push_back(_update);
     }
 
     void UpdateWriteOperation::startCommand(const std::string& ns, BSONObjBuilder* command) const {
@@ -28,7 +28,7 @@ namespace mongo {
         virtual int incrementalSize() const;
 
         virtual void startRequest(const std::string& ns, bool ordered, BufBuilder* builder) const;
-        virtual void appendSelfToRequest(BufBuilder* builder) const;
+        virtual void appendSelfToRequest(std::vector<BSONObj>* documents) const;
 
         virtual void startCommand(const std::string& ns, BSONObjBuilder* command) const;
         virtual void appendSelfToCommand(BSONArrayBuilder* batch) const;
@@ -19,10 +19,22 @@
 
 #include "mongo/client/dbclientinterface.h"
 #include "mongo/client/write_result.h"
+#include "mongo/db/dbmessage.h"
 #include "mongo/db/namespace_string.h"
+#include "mongo/util/assert_util.h"
+#include "mongo/util/mongoutils/str.h"
 
 namespace mongo {
 
+    void assembleRequest( const std::string &ns, BSONObj query, int nToReturn, int nToSkip, const BSONObj *fieldsToReturn, int queryOptions, Message &toSend );
+
+    namespace {
+        // The most getLastError replies left unread while pipelining. Their replies are small
+        // enough that this many always fit in the socket buffers, so the server never blocks
+        // on writing them while we are still sending.
+        const size_t kMaxPendingGetLastErrors = 64;
+    } // namespace
+
     WireProtocolWriter::WireProtocolWriter(DBClientBase* client) : _client(client) {
     }
 
@@ -36,7 +48,16 @@ namespace mongo {
         // Effectively a map of batch relative indexes to WriteOperations
         std::vector<WriteOperation*> batchOps;
 
+        // The header and preamble of the request. The documents that follow them on the wire
+        // are not copied in here but sent straight from their own buffers.
         BufBuilder builder;
+        std::vector<BSONObj> documents;
+
+        // Unordered writes don't wait for each getLastError before sending the next request;
+        // the replies are read back in order, one round trip per window rather than per batch.
+        const bool pipelined = _pipelinable(ordered, writeConcern);
+        std::deque<PendingBatch> pending;
+        BSONObj failedGetLastError;
 
         std::vector<WriteOperation*>::const_iterator batch_begin = write_operations.begin();
         const std::vector<WriteOperation*>::const_iterator end = write_operations.end();
@@ -47,19 +68,22 @@ namespace mongo {
 
             // We must be able to fit the first item of the batch. Otherwise, the calling code
             // passed an over size write operation in violation of our contract.
-            invariant(_fits(&builder, *batch_iter));
+            invariant(_fits(0, *batch_iter));
 
             // Set the current operation type for this batch
             const WriteOpType batchOpType = (*batch_iter)->operationType();
 
             // Begin the command for this batch.
+            builder.skip(sizeof(MSGHEADER::Value));
             (*batch_iter)->startRequest(ns.toString(), ordered, &builder);
+            int requestSize = builder.len();
 
             while (true) {
 
                 // Always safe to append here: either we just entered the loop, or all the
                 // below checks passed.
-                (*batch_iter)->appendSelfToRequest(&builder);
+                (*batch_iter)->appendSelfToRequest(&documents);
+                requestSize += (*batch_iter)->incrementalSize();
 
                 // Associate batch index with WriteOperation
                 batchOps.push_back(*batch_iter);
@@ -85,56 +109,77 @@ namespace mongo {
                     break;
 
                 // If we can't put the next item into the current batch, issue what we have.
-                if (!_fits(&builder, *next))
+                if (!_fits(requestSize, *next))
                     break;
 
                 // OK to proceed to next op
                 batch_iter = next;
             }
 
-            // Issue the complete command.
-            BSONObj batchResult = _send(batchOpType, builder, writeConcern, ns);
+            if (pipelined) {
+                // Issue the complete command and its getLastError, but don't wait for it.
+                _say(batchOpType, &builder, documents, false);
+                pending.push_back(PendingBatch());
+                pending.back().ops.swap(batchOps);
+                pending.back().getLastErrorId = _sayGetLastError(writeConcern, ns);
 
-            // Merge this batch's result into the result for all batches written.
-            writeResult->_mergeGleResult(batchOps, batchResult);
-            batchOps.clear();
-
-            // Check write result for errors if we are doing ordered processing or last op
-            bool lastOp = *batch_iter == write_operations.back();
-            if (ordered || lastOp)
-                writeResult->_check(lastOp);
+                if (pending.size() >= kMaxPendingGetLastErrors)
+                    _receiveOldest(&pending, writeResult, &failedGetLastError);
+            }
+            else {
+                // Issue the complete command.
+                BSONObj batchResult = _send(batchOpType, &builder, documents, writeConcern, ns);
+
+                // Merge this batch's result into the result for all batches written.
+                writeResult->_mergeGleResult(batchOps, batchResult);
+                batchOps.clear();
+
+                // Check write result for errors if we are doing ordered processing or last op
+                bool lastOp = *batch_iter == write_operations.back();
+                if (ordered || lastOp)
+                    writeResult->_check(lastOp);
+            }
 
             // Reset the builder so we can build the next request.
             builder.reset();
+            documents.clear();
 
             // The next batch begins with the op after the last one in the just issued batch.
             batch_begin = ++batch_iter;
         }
 
+        if (pipelined) {
+            while (!pending.empty())
+                _receiveOldest(&pending, writeResult, &failedGetLastError);
+
+            if (!failedGetLastError.isEmpty())
+                throw OperationException(failedGetLastError);
+
+            writeResult->_check(true);
+        }
     }
 
-    bool WireProtocolWriter::_fits(BufBuilder* builder, WriteOperation* op) {
-        return (builder->len() + op->incrementalSize()) <= _client->getMaxMessageSizeBytes();
+    bool WireProtocolWriter::_fits(int requestSize, WriteOperation* op) {
+        return (requestSize + op->incrementalSize()) <= _client->getMaxMessageSizeBytes();
     }
 
     BSONObj WireProtocolWriter::_send(
         WriteOpType opCode,
-        const BufBuilder& builder,
+        BufBuilder* builder,
+        const std::vector<BSONObj>& documents,
         const WriteConcern* writeConcern,
         const StringData& ns
     ) {
-        Message request;
-        request.setData(opCode, builder.buf(), builder.len());
-        _client->say(request);
+        const bool piggyBack = !writeConcern->requiresConfirmation()
+            && _client->getPiggyBackUnacknowledgedWrites();
+        _say(opCode, builder, documents, piggyBack);
 
         BSONObj result;
 
         if (writeConcern->requiresConfirmation()) {
-            BSONObjBuilder bob;
-            bob.append("getlasterror", true);
-            bob.appendElements(writeConcern->obj());
-
-            bool commandWorked = _client->runCommand(nsToDatabase(ns), bob.obj(), result);
+            bool commandWorked = _client->runCommand(nsToDatabase(ns),
+                                                     _getLastErrorCommand(writeConcern),
+                                                     result);
 
             if (!commandWorked) throw OperationException(result);
         }
@@ -142,6 +187,99 @@ namespace mongo {
         return result;
     }
 
+    void WireProtocolWriter::_say(
+        WriteOpType opCode,
+        BufBuilder* builder,
+        const std::vector<BSONObj>& documents,
+        bool piggyBack
+    ) {
+        // The message borrows the header and preamble from 'builder' and the documents from
+        // the caller, so the whole request goes out in one gathering write without copies.
+        Message request;
+        request.appendBorrowedData(builder->buf(), builder->len());
+        for (std::vector<BSONObj>::const_iterator it = documents.begin();
+             it != documents.end(); ++it) {
+            request.appendBorrowedData(const_cast<char*>(it->objdata()), it->objsize());
+        }
+        request.header().setOperation(opCode);
+
+        // A piggybacked request is copied out if it is held back, so the borrowed buffers
+        // needn't outlive this call either way.
+        if (piggyBack)
+            _client->sayPiggyBack(request);
+        else
+            _client->say(request);
+    }
+
+    BSONObj WireProtocolWriter::_getLastErrorCommand(const WriteConcern* writeConcern) {
+        BSONObjBuilder bob;
+        bob.append("getlasterror", true);
+        bob.appendElements(writeConcern->obj());
+        return bob.obj();
+    }
+
+    bool WireProtocolWriter::_pipelinable(bool ordered, const WriteConcern* writeConcern) {
+        // An ordered write must see each error before sending the next request. Only a plain
+        // connection can have more than one reply outstanding: a replica set connection
+        // remembers just the last request it was asked to send.
+        return !ordered
+            && writeConcern->requiresConfirmation()
+            && _client->type() == ConnectionString::MASTER
+            && _client->lazySupported();
+    }
+
+    MSGID WireProtocolWriter::_sayGetLastError(
+        const WriteConcern* writeConcern,
+        const StringData& ns
+    ) {
+        BSONObj command = _getLastErrorCommand(writeConcern);
+
+        // Hooked the same way runCommand() would.
+        if (_client->getRunCommandHook()) {
+            BSONObjBuilder bob;
+            bob.appendElements(command);
+            _client->getRunCommandHook()(&bob);
+            command = bob.obj();
+        }
+
+        Message request;
+        assembleRequest(nsToDatabase(ns) + ".$cmd", command, -1, 0, NULL, 0, request);
+        _client->say(request);
+        return request.header().getId();
+    }
+
+    void WireProtocolWriter::_receiveOldest(
+        std::deque<PendingBatch>* pending,
+        WriteResult* writeResult,
+        BSONObj* failed
+    ) {
+        const PendingBatch& batch = pending->front();
+
+        Message response;
+        uassert(18738, "connection closed while reading a getLastError reply",
+                _client->recv(response));
+        uassert(18739, str::stream() << "getLastError reply is for request "
+                                     << response.header().getResponseTo() << ", expected "
+                                     << batch.getLastErrorId,
+                response.header().getResponseTo() == batch.getLastErrorId);
+
+        QueryResult::View reply = response.singleData().view2ptr();
+        uassert(18740, "getLastError returned no reply document", reply.getNReturned() == 1);
+        const BSONObj result = BSONObj(reply.data()).getOwned();
+
+        if (_client->getPostRunCommandHook())
+            _client->getPostRunCommandHook()(result, _client->getServerAddress());
+
+        if (result["ok"].trueValue()) {
+            writeResult->_mergeGleResult(batch.ops, result);
+        }
+        else if (failed->isEmpty()) {
+            *failed = result;
+        }
+
+        pending->pop_front();
+    }
+
     bool WireProtocolWriter::_batchableRequest(WriteOpType opCode, const WriteResult* const writeResult) {
         /*
          * In order to get detailed write information using the legacy MongoDB wire protocol
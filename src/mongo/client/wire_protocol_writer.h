@@ -15,7 +15,10 @@
 
 #pragma once
 
+#include <deque>
+
 #include "mongo/client/dbclient_writer.h"
+#include "mongo/util/net/message.h"
 
 namespace mongo {
 
@@ -34,15 +37,43 @@ namespace mongo {
         );
 
     private:
+        // A request that has been sent together with its getLastError, whose reply is
+        // still to be read.
+        struct PendingBatch {
+            std::vector<WriteOperation*> ops;
+            MSGID getLastErrorId;
+        };
+
         BSONObj _send(
             WriteOpType opCode,
-            const BufBuilder& builder,
+            BufBuilder* builder,
+            const std::vector<BSONObj>& documents,
             const WriteConcern* wc,
             const StringData& ns
         );
 
+        void _say(WriteOpType opCode,
+                  BufBuilder* builder,
+                  const std::vector<BSONObj>& documents,
+                  bool piggyBack);
+
+        BSONObj _getLastErrorCommand(const WriteConcern* writeConcern);
+
+        // Whether the getLastError of each request can be sent right behind it and read later.
+        bool _pipelinable(bool ordered, const WriteConcern* writeConcern);
+
+        // Sends the getLastError for the request just said and returns its request id.
+        MSGID _sayGetLastError(const WriteConcern* writeConcern, const StringData& ns);
+
+        // Reads the reply to the oldest pending getLastError and merges it into 'writeResult'.
+        // The first failed getLastError is kept in 'failed' rather than thrown, so that the
+        // replies behind it are still read off the connection.
+        void _receiveOldest(std::deque<PendingBatch>* pending,
+                            WriteResult* writeResult,
+                            BSONObj* failed);
+
         bool _batchableRequest(WriteOpType opCode, const WriteResult* const writeResult);
-        bool _fits(BufBuilder* builder, WriteOperation* operation);
+        bool _fits(int requestSize, WriteOperation* operation);
 
         DBClientBase* const _client;
     };
@@ -0,0 +1,158 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/client/wire_protocol_writer.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "mongo/client/bulk_operation_builder.h"
+#include "mongo/client/dbclientinterface.h"
+#include "mongo/client/exceptions.h"
+#include "mongo/dbtests/mock/mock_wire_server.h"
+#include "mongo/unittest/unittest.h"
+#include "mongo/util/time_support.h"
+
+namespace {
+
+    using mongo::BSONObj;
+    using mongo::BulkOperationBuilder;
+    using mongo::DBClientConnection;
+    using mongo::MockWireServer;
+    using mongo::WriteConcern;
+    using mongo::WriteResult;
+
+    const char kNamespace[] = "test.foo";
+
+    class WireProtocolWriterTest : public mongo::unittest::Test {
+    protected:
+        void setUp() {
+            std::string errmsg;
+            ASSERT_TRUE(_conn.connect(_server.getHostAndPort(), errmsg));
+            ASSERT_EQUALS(0, _conn.getMaxWireVersion());
+        }
+
+        MockWireServer _server;
+        DBClientConnection _conn;
+    };
+
+    TEST_F(WireProtocolWriterTest, BatchedInsertArrivesIntact) {
+        const std::string padding(1000, 'x');
+
+        std::vector<BSONObj> docs;
+        for (int i = 0; i < 1500; ++i) {
+            docs.push_back(BSON("_id" << i << "padding" << padding));
+        }
+        _conn.insert("test.foo", docs, 0, &WriteConcern::acknowledged);
+
+        // maxWriteBatchSize is 1000, so this takes two OP_INSERT messages.
+        ASSERT_EQUALS(2U, _server.getOpCount(mongo::dbInsert));
+
+        const std::vector<BSONObj> stored = _server.getDocuments("test.foo");
+        ASSERT_EQUALS(docs.size(), stored.size());
+        for (size_t i = 0; i < docs.size(); ++i) {
+            ASSERT_EQUALS(docs[i], stored[i]);
+        }
+    }
+
+    TEST_F(WireProtocolWriterTest, SingleInsert) {
+        _conn.insert("test.foo", BSON("_id" << 1), 0, &WriteConcern::acknowledged);
+
+        const std::vector<BSONObj> stored = _server.getDocuments("test.foo");
+        ASSERT_EQUALS(1U, stored.size());
+        ASSERT_EQUALS(BSON("_id" << 1), stored[0]);
+    }
+
+    TEST_F(WireProtocolWriterTest, PiggyBackedUnacknowledgedWrites) {
+        _conn.setPiggyBackUnacknowledgedWrites(true);
+        _conn.port().setPiggyBackBufferSize(64 * 1024);
+
+        for (int i = 0; i < 100; ++i) {
+            _conn.insert(kNamespace, BSON("_id" << i), 0, &WriteConcern::unacknowledged);
+        }
+
+        // All of them fit in the buffer, so none has been sent yet.
+        mongo::sleepmillis(50);
+        ASSERT_EQUALS(0U, _server.getOpCount(mongo::dbInsert));
+
+        // The next command takes them along.
+        ASSERT_EQUALS(100U, _conn.count(kNamespace));
+        ASSERT_EQUALS(100U, _server.getOpCount(mongo::dbInsert));
+    }
+
+    // Bulk inserts need a result per document, so each goes in a message of its own. Unordered,
+    // they are pipelined: many more than fit in one window of pending getLastErrors.
+    TEST_F(WireProtocolWriterTest, PipelinedUnorderedInserts) {
+        BulkOperationBuilder bulk = _conn.initializeUnorderedBulkOp(kNamespace);
+        for (int i = 0; i < 300; ++i) {
+            bulk.insert(BSON("_id" << i));
+        }
+
+        WriteResult result;
+        bulk.execute(&WriteConcern::acknowledged, &result);
+
+        ASSERT_EQUALS(300, result.nInserted());
+        ASSERT_FALSE(result.hasErrors());
+        ASSERT_EQUALS(300U, _server.getOpCount(mongo::dbInsert));
+        ASSERT_EQUALS(300U, _server.getDocuments(kNamespace).size());
+    }
+
+    TEST_F(WireProtocolWriterTest, PipelinedUnorderedInsertErrors) {
+        _server.insert(kNamespace, BSON("_id" << 10));
+        _server.insert(kNamespace, BSON("_id" << 150));
+
+        BulkOperationBuilder bulk = _conn.initializeUnorderedBulkOp(kNamespace);
+        for (int i = 0; i < 300; ++i) {
+            bulk.insert(BSON("_id" << i));
+        }
+
+        WriteResult result;
+        ASSERT_THROWS(bulk.execute(&WriteConcern::acknowledged, &result),
+                      mongo::OperationException);
+
+        ASSERT_EQUALS(298, result.nInserted());
+        // Unordered operations may be executed in any order.
+        ASSERT_EQUALS(2U, result.writeErrors().size());
+        const int first = result.writeErrors()[0]["index"].numberInt();
+        const int second = result.writeErrors()[1]["index"].numberInt();
+        ASSERT_EQUALS(10, std::min(first, second));
+        ASSERT_EQUALS(150, std::max(first, second));
+
+        // Every reply was read, so the connection is still usable.
+        ASSERT_EQUALS(300U, _conn.count(kNamespace));
+    }
+
+    TEST_F(WireProtocolWriterTest, OrderedInsertsStopAtFirstError) {
+        _server.insert(kNamespace, BSON("_id" << 10));
+
+        BulkOperationBuilder bulk = _conn.initializeOrderedBulkOp(kNamespace);
+        for (int i = 0; i < 300; ++i) {
+            bulk.insert(BSON("_id" << i));
+        }
+
+        WriteResult result;
+        ASSERT_THROWS(bulk.execute(&WriteConcern::acknowledged, &result),
+                      mongo::OperationException);
+
+        ASSERT_EQUALS(10, result.nInserted());
+        ASSERT_EQUALS(1U, result.writeErrors().size());
+        ASSERT_EQUALS(11U, _server.getOpCount(mongo::dbInsert));
+        ASSERT_EQUALS(11U, _server.getDocuments(kNamespace).size());
+    }
+
+} // namespace
@@ -62,9 +62,12 @@ namespace mongo {
         virtual void startRequest(const std::string& ns, bool ordered, BufBuilder* builder) const = 0;
 
         /**
-         * Appends a document (or documents in the case of update) which describe
-         * the write operation represented by an instance of this class into the
-         * supplied BufBuilder.
+         * Appends the document (or documents in the case of update) which describe
+         * the write operation represented by an instance of this class to the
+         * supplied vector, in wire protocol order.
+         *
+         * The documents are not copied: a WireProtocolWriter sends them to the socket
+         * straight from their own buffers, behind the preamble.
          *
          * This method may be called multiple times by a WireProtocolWriter in order
          * to batch operations of the same type into a single wire protocol request.
@@ -72,7 +75,7 @@ namespace mongo {
          * NOTE: The size of this portion of the message is flexible but the size of
          * the message itself is bounded by the server's maxMessageSizeBytes.
          */
-        virtual void appendSelfToRequest(BufBuilder* builder) const = 0;
+        virtual void appendSelfToRequest(std::vector<BSONObj>* documents) const = 0;
 
         /**
          * Appends the preamble for a write command into the supplied BSONObjBuilder.
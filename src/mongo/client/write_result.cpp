@@ -17,6 +17,8 @@
 
 #include "mongo/client/write_result.h"
 
+#include <algorithm>
+
 #include "mongo/client/exceptions.h"
 #include "mongo/client/write_operation.h"
 #include "mongo/db/jsobj.h"
@@ -27,6 +29,15 @@ namespace mongo {
     namespace {
         const int kUnknownError = 8;
         const int kWriteConcernErrorCode = 64;
+
+        bool byIndex(const BSONObj& lhs, const BSONObj& rhs) {
+            return lhs["index"].numberLong() < rhs["index"].numberLong();
+        }
+
+        void appendByIndex(const std::vector<BSONObj>& from, std::vector<BSONObj>* to) {
+            to->insert(to->end(), from.begin(), from.end());
+            std::stable_sort(to->begin(), to->end(), byIndex);
+        }
     } // namespace
 
     WriteResult::WriteResult()
@@ -135,6 +146,24 @@ namespace mongo {
         }
     }
 
+    void WriteResult::_merge(const WriteResult& other) {
+        _nInserted += other._nInserted;
+        _nUpserted += other._nUpserted;
+        _nMatched += other._nMatched;
+        _nRemoved += other._nRemoved;
+
+        _hasModifiedCount = _hasModifiedCount && other._hasModifiedCount;
+        if (_hasModifiedCount)
+            _nModified += other._nModified;
+
+        // The parts may have run in any order; keep their entries ordered by bulk index.
+        appendByIndex(other._upserted, &_upserted);
+        appendByIndex(other._writeErrors, &_writeErrors);
+        _writeConcernErrors.insert(_writeConcernErrors.end(),
+                                   other._writeConcernErrors.begin(),
+                                   other._writeConcernErrors.end());
+    }
+
     void WriteResult::_mergeGleResult(
         const std::vector<WriteOperation*>& ops,
         const BSONObj& result
@@ -145,6 +145,9 @@ namespace mongo {
         void _mergeCommandResult(const std::vector<WriteOperation*>& ops, const BSONObj& result);
         void _mergeGleResult(const std::vector<WriteOperation*>& ops, const BSONObj& result);
 
+        // Adds in the outcome of another part of the same bulk operation.
+        void _merge(const WriteResult& other);
+
         void _check(bool throwSoftErrors);
         void _setModified(const BSONObj& result);
         int _getIntOrDefault(const BSONObj& obj, const StringData& field, const int defaultValue = 0);
@@ -116,7 +116,8 @@ namespace mongo {
             _nextjsobj != NULL && _theEnd - _nextjsobj >= 5);
 
         if (client::Options::current().validateObjects()) {
-            Status status = validateBSON(_nextjsobj, _theEnd - _nextjsobj);
+            Status status = validateBSON(_nextjsobj, _theEnd - _nextjsobj,
+                                         client::Options::current().validateUTF8());
             massert(10307,
                 str::stream() << "Client Error: bad object in message: " << status.reason(),
                 status.isOK());
@@ -18,6 +18,10 @@
 #include <boost/scoped_ptr.hpp>
 #include <cerrno>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "mongo/base/parse_number.h"
 #include "mongo/db/jsobj.h"
 #include "mongo/platform/cstdint.h"
@@ -53,7 +57,6 @@ namespace mongo {
         PAT_RESERVE_SIZE = 4096,
         OPT_RESERVE_SIZE = 64,
         FIELD_RESERVE_SIZE = 4096,
-        STRINGVAL_RESERVE_SIZE = 4096,
         BINDATA_RESERVE_SIZE = 4096,
         BINDATATYPE_RESERVE_SIZE = 4096,
         NS_RESERVE_SIZE = 64,
@@ -74,6 +77,55 @@ namespace mongo {
                  *SINGLEQUOTE = "'",
                  *DOUBLEQUOTE = "\"";
 
+    // Largest buffer fromjson() sets aside up front, however long its input.
+    static const size_t kMaxInitialBuilderSize = 64 * 1024;
+
+    namespace {
+
+        inline bool isWhitespace(char c) {
+            // 'isspace()' takes an 'int' (signed), so (default signed) 'char's get sign-extended
+            // and therefore 'corrupted' unless we force them to be unsigned ... 0x80 becomes
+            // 0xffffff80 as seen by isspace when sign-extended ... we want it to be 0x00000080
+            return isspace(static_cast<unsigned char>(c));
+        }
+
+        inline bool isFieldChar(char c) {
+            return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || ('0' <= c && c <= '9')
+                || c == '_' || c == '$';
+        }
+
+        /**
+         * @return the first character in [p, end) that is 'terminal', a backslash or a control
+         * character, or 'end' if there is none. Everything before it is part of the string
+         * being read as it is. SSE2 is part of x86-64, so needs no runtime check.
+         */
+        const char* findStringSpecial(const char* p, const char* end, char terminal) {
+#if defined(__SSE2__)
+            const __m128i terminals = _mm_set1_epi8(terminal);
+            const __m128i backslashes = _mm_set1_epi8('\\');
+            const __m128i lastControl = _mm_set1_epi8(0x1F);
+            while (end - p >= 16) {
+                const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                const __m128i special =
+                    _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, terminals),
+                                              _mm_cmpeq_epi8(block, backslashes)),
+                                 // unsigned block <= 0x1F
+                                 _mm_cmpeq_epi8(_mm_max_epu8(block, lastControl), lastControl));
+                if (_mm_movemask_epi8(special))
+                    break;
+                p += 16;
+            }
+#endif
+            for (; p < end; ++p) {
+                const unsigned char c = *p;
+                if (c == terminal || c == '\\' || c <= 0x1F)
+                    break;
+            }
+            return p;
+        }
+
+    } // namespace
+
     JParse::JParse(const StringData& str)
         : _buf(str.rawData())
         , _input(_buf)
@@ -92,103 +144,101 @@ namespace mongo {
 
     Status JParse::value(const StringData& fieldName, BSONObjBuilder& builder) {
         MONGO_JSON_DEBUG("fieldName: " << fieldName);
-        if (peekToken(LBRACE)) {
-            Status ret = object(fieldName, builder);
-            if (ret != Status::OK()) {
-                return ret;
-            }
-        }
-        else if (peekToken(LBRACKET)) {
-            Status ret = array(fieldName, builder);
-            if (ret != Status::OK()) {
-                return ret;
-            }
-        }
-        else if (readToken("new")) {
-            Status ret = constructor(fieldName, builder);
-            if (ret != Status::OK()) {
-                return ret;
-            }
-        }
-        else if (readToken("Date")) {
-            Status ret = date(fieldName, builder);
-            if (ret != Status::OK()) {
-                return ret;
-            }
-        }
-        else if (readToken("Timestamp")) {
-            Status ret = timestamp(fieldName, builder);
-            if (ret != Status::OK()) {
-                return ret;
-            }
-        }
-        else if (readToken("ObjectId")) {
-            Status ret = objectId(fieldName, builder);
-            if (ret != Status::OK()) {
-                return ret;
-            }
-        }
-        else if (readToken("NumberLong")) {
-            Status ret = numberLong(fieldName, builder);
-            if (ret != Status::OK()) {
-                return ret;
-            }
-        }
-        else if (readToken("NumberInt")) {
-            Status ret = numberInt(fieldName, builder);
-            if (ret != Status::OK()) {
-                return ret;
-            }
-        }
-        else if (readToken("Dbref") || readToken("DBRef")) {
-            Status ret = dbRef(fieldName, builder);
-            if (ret != Status::OK()) {
-                return ret;
-            }
-        }
-        else if (peekToken(FORWARDSLASH)) {
-            Status ret = regex(fieldName, builder);
-            if (ret != Status::OK()) {
-                return ret;
-            }
-        }
-        else if (peekToken(DOUBLEQUOTE) || peekToken(SINGLEQUOTE)) {
-            std::string valueString;
-            valueString.reserve(STRINGVAL_RESERVE_SIZE);
-            Status ret = quotedString(&valueString);
-            if (ret != Status::OK()) {
-                return ret;
-            }
-            builder.append(fieldName, valueString);
-        }
-        else if (readToken("true")) {
-            builder.append(fieldName, true);
-        }
-        else if (readToken("false")) {
-            builder.append(fieldName, false);
-        }
-        else if (readToken("null")) {
-            builder.appendNull(fieldName);
-        }
-        else if (readToken("undefined")) {
-            builder.appendUndefined(fieldName);
-        }
-        else if (readToken("NaN")) {
-            builder.append(fieldName, std::numeric_limits<double>::quiet_NaN());
-        }
-        else if (readToken("Infinity")) {
-            builder.append(fieldName, std::numeric_limits<double>::infinity());
-        }
-        else if (readToken("-Infinity")) {
-            builder.append(fieldName, -std::numeric_limits<double>::infinity());
-        }
-        else {
-            Status ret = number(fieldName, builder);
-            if (ret != Status::OK()) {
-                return ret;
+        const char* next = _input;
+        while (next < _input_end && isWhitespace(*next)) {
+            ++next;
+        }
+        // Only the tokens that can start with the next character need to be tried; anything
+        // else is a number or an error.
+        switch (next < _input_end ? *next : '\0') {
+            case '{':
+                return object(fieldName, builder);
+            case '[':
+                return array(fieldName, builder);
+            case 'n':
+                if (readToken("new")) {
+                    return constructor(fieldName, builder);
+                }
+                if (readToken("null")) {
+                    builder.appendNull(fieldName);
+                    return Status::OK();
+                }
+                break;
+            case 'D':
+                if (readToken("Date")) {
+                    return date(fieldName, builder);
+                }
+                if (readToken("Dbref") || readToken("DBRef")) {
+                    return dbRef(fieldName, builder);
+                }
+                break;
+            case 'T':
+                if (readToken("Timestamp")) {
+                    return timestamp(fieldName, builder);
+                }
+                break;
+            case 'O':
+                if (readToken("ObjectId")) {
+                    return objectId(fieldName, builder);
+                }
+                break;
+            case 'N':
+                if (readToken("NumberLong")) {
+                    return numberLong(fieldName, builder);
+                }
+                if (readToken("NumberInt")) {
+                    return numberInt(fieldName, builder);
+                }
+                if (readToken("NaN")) {
+                    builder.append(fieldName, std::numeric_limits<double>::quiet_NaN());
+                    return Status::OK();
+                }
+                break;
+            case '/':
+                return regex(fieldName, builder);
+            case '"':
+            case '\'': {
+                StringData valueString;
+                std::string scratch;
+                Status ret = quotedString(&valueString, &scratch);
+                if (ret != Status::OK()) {
+                    return ret;
+                }
+                builder.append(fieldName, valueString);
+                return Status::OK();
             }
+            case 't':
+                if (readToken("true")) {
+                    builder.append(fieldName, true);
+                    return Status::OK();
+                }
+                break;
+            case 'f':
+                if (readToken("false")) {
+                    builder.append(fieldName, false);
+                    return Status::OK();
+                }
+                break;
+            case 'u':
+                if (readToken("undefined")) {
+                    builder.appendUndefined(fieldName);
+                    return Status::OK();
+                }
+                break;
+            case 'I':
+                if (readToken("Infinity")) {
+                    builder.append(fieldName, std::numeric_limits<double>::infinity());
+                    return Status::OK();
+                }
+                break;
+            case '-':
+                if (readToken("-Infinity")) {
+                    builder.append(fieldName, -std::numeric_limits<double>::infinity());
+                    return Status::OK();
+                }
+                break;
         }
-        return Status::OK();
+        return number(fieldName, builder);
     }
 
     Status JParse::parse(BSONObjBuilder& builder) {
@@ -211,9 +261,9 @@ namespace mongo {
         }
 
         // Special object
-        std::string firstField;
-        firstField.reserve(FIELD_RESERVE_SIZE);
-        Status ret = field(&firstField);
+        StringData firstField;
+        std::string firstFieldScratch;
+        Status ret = field(&firstField, &firstFieldScratch);
         if (ret != Status::OK()) {
             return ret;
         }
@@ -326,10 +376,10 @@ namespace mongo {
             if (valueRet != Status::OK()) {
                 return valueRet;
             }
+            StringData fieldName;
+            std::string fieldNameScratch;
             while (readToken(COMMA)) {
-                std::string fieldName;
-                fieldName.reserve(FIELD_RESERVE_SIZE);
-                Status fieldRet = field(&fieldName);
+                Status fieldRet = field(&fieldName, &fieldNameScratch);
                 if (fieldRet != Status::OK()) {
                     return fieldRet;
                 }
@@ -1013,19 +1063,25 @@ namespace mongo {
     }
 
     Status JParse::field(std::string* result) {
+        StringData str;
+        std::string scratch;
+        Status ret = field(&str, &scratch);
+        if (ret == Status::OK()) {
+            result->append(str.rawData(), str.size());
+        }
+        return ret;
+    }
+
+    Status JParse::field(StringData* result, std::string* scratch) {
         MONGO_JSON_DEBUG("");
         if (peekToken(DOUBLEQUOTE) || peekToken(SINGLEQUOTE)) {
             // Quoted key
             // TODO: make sure quoted field names cannot contain null characters
-            return quotedString(result);
+            return quotedString(result, scratch);
         }
         else {
             // Unquoted key
-            // 'isspace()' takes an 'int' (signed), so (default signed) 'char's get sign-extended
-            // and therefore 'corrupted' unless we force them to be unsigned ... 0x80 becomes
-            // 0xffffff80 as seen by isspace when sign-extended ... we want it to be 0x00000080
-            while (_input < _input_end &&
-                   isspace(*reinterpret_cast<const unsigned char*>(_input))) {
+            while (_input < _input_end && isWhitespace(*_input)) {
                 ++_input;
             }
             if (_input >= _input_end) {
@@ -1034,33 +1090,59 @@ namespace mongo {
             if (!match(*_input, ALPHA "_$")) {
                 return parseError("First character in field must be [A-Za-z$_]");
             }
-            return chars(result, "", ALPHA DIGIT "_$");
+            const char* q = _input;
+            while (q < _input_end && isFieldChar(*q)) {
+                ++q;
+            }
+            if (q >= _input_end) {
+                return parseError("Unexpected end of input");
+            }
+            *result = StringData(_input, q - _input);
+            _input = q;
+            return Status::OK();
         }
     }
 
     Status JParse::quotedString(std::string* result) {
+        StringData str;
+        std::string scratch;
+        Status ret = quotedString(&str, &scratch);
+        if (ret == Status::OK()) {
+            result->append(str.rawData(), str.size());
+        }
+        return ret;
+    }
+
+    Status JParse::quotedString(StringData* result, std::string* scratch) {
         MONGO_JSON_DEBUG("");
+        const char* quote;
         if (readToken(DOUBLEQUOTE)) {
-            Status ret = chars(result, "\"");
-            if (ret != Status::OK()) {
-                return ret;
-            }
-            if (!readToken(DOUBLEQUOTE)) {
-                return parseError("Expecting '\"'");
-            }
+            quote = DOUBLEQUOTE;
         }
         else if (readToken(SINGLEQUOTE)) {
-            Status ret = chars(result, "'");
-            if (ret != Status::OK()) {
-                return ret;
-            }
-            if (!readToken(SINGLEQUOTE)) {
-                return parseError("Expecting '''");
-            }
+            quote = SINGLEQUOTE;
         }
         else {
             return parseError("Expecting quoted string");
         }
+
+        // Without escapes the string is used where it is in the input, and nothing is copied.
+        const char* const end = findStringSpecial(_input, _input_end, *quote);
+        if (end < _input_end && *end == *quote) {
+            *result = StringData(_input, end - _input);
+            _input = end + 1;
+            return Status::OK();
+        }
+
+        scratch->clear();
+        Status ret = chars(scratch, quote);
+        if (ret != Status::OK()) {
+            return ret;
+        }
+        if (!readToken(quote)) {
+            return parseError(quote == DOUBLEQUOTE ? "Expecting '\"'" : "Expecting '''");
+        }
+        *result = *scratch;
         return Status::OK();
     }
 
@@ -1074,9 +1156,21 @@ namespace mongo {
         if (_input >= _input_end) {
             return parseError("Unexpected end of input");
         }
+        // With a single terminal character and no allowed set, whole runs of ordinary
+        // characters can be found and copied at once.
+        const bool copyRuns = allowedSet == NULL && terminalSet[0] != '\0' &&
+                              terminalSet[1] == '\0';
         const char* q = _input;
         while (q < _input_end && !match(*q, terminalSet)) {
             MONGO_JSON_DEBUG("q: " << q);
+            if (copyRuns) {
+                const char* const runEnd = findStringSpecial(q, _input_end, *terminalSet);
+                result->append(q, runEnd);
+                q = runEnd;
+                if (q >= _input_end || *q == *terminalSet) {
+                    break;
+                }
+            }
             if (allowedSet != NULL) {
                 if (!match(*q, allowedSet)) {
                     _input = q;
@@ -1177,10 +1271,7 @@ namespace mongo {
         if (token == NULL) {
             return false;
         }
-        // 'isspace()' takes an 'int' (signed), so (default signed) 'char's get sign-extended
-        // and therefore 'corrupted' unless we force them to be unsigned ... 0x80 becomes
-        // 0xffffff80 as seen by isspace when sign-extended ... we want it to be 0x00000080
-        while (check < _input_end && isspace(*reinterpret_cast<const unsigned char*>(check))) {
+        while (check < _input_end && isWhitespace(*check)) {
             ++check;
         }
         while (*token != '\0') {
@@ -1197,9 +1288,9 @@ namespace mongo {
 
     bool JParse::readField(const StringData& expectedField) {
         MONGO_JSON_DEBUG("expectedField: " << expectedField);
-        std::string nextField;
-        nextField.reserve(FIELD_RESERVE_SIZE);
-        Status ret = field(&nextField);
+        StringData nextField;
+        std::string scratch;
+        Status ret = field(&nextField, &scratch);
         if (ret != Status::OK()) {
             return false;
         }
@@ -1251,8 +1342,12 @@ namespace mongo {
             if (len) *len = 0;
             return BSONObj();
         }
-        JParse jparse(jsonString);
-        BSONObjBuilder builder;
+        const StringData input(jsonString);
+        JParse jparse(input);
+        // Documents are rarely much bigger as BSON than as JSON, so the builder seldom has to
+        // grow. The input may hold more than one document, so only so much is set aside.
+        BSONObjBuilder builder(static_cast<int>(std::min<size_t>(input.size(),
+                                                                 kMaxInitialBuilderSize)) + 64);
         Status ret = Status::OK();
         try {
             ret = jparse.parse(builder);
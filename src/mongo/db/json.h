@@ -349,6 +349,12 @@ namespace mongo {
              */
             Status field(std::string* result);
 
+            /**
+             * Reads a FIELD into 'result', which refers to the input where it can and otherwise
+             * to 'scratch', whose previous contents are lost.
+             */
+            Status field(StringData* result, std::string* scratch);
+
             /*
              * STRING :
              *     " "
@@ -358,6 +364,12 @@ namespace mongo {
              */
             Status quotedString(std::string* result);
 
+            /**
+             * Reads a STRING into 'result', which refers to the input where it can and otherwise
+             * to 'scratch', whose previous contents are lost.
+             */
+            Status quotedString(StringData* result, std::string* scratch);
+
             /*
              * CHARS :
              *     CHAR
@@ -0,0 +1,310 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/db/ndjson_reader.h"
+
+#include <algorithm>
+#include <boost/thread/thread.hpp>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <istream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mongo/db/json.h"
+#include "mongo/stdx/functional.h"
+#include "mongo/util/assert_util.h"
+#include "mongo/util/mongoutils/str.h"
+
+namespace mongo {
+
+    namespace {
+        // How much of a stream is read at a time. Lines longer than this are still read whole.
+        const size_t kStreamChunkSize = 1024 * 1024;
+
+        bool isBlank(const char* begin, const char* end) {
+            for (; begin != end; ++begin) {
+                if (!isspace(static_cast<unsigned char>(*begin)))
+                    return false;
+            }
+            return true;
+        }
+    } // namespace
+
+    const size_t NDJSONReader::kDefaultMaxBatchDocuments;
+    const size_t NDJSONReader::kDefaultMaxBatchBytes;
+
+    /** Hands out the input a line at a time. */
+    class NDJSONReader::Input {
+    public:
+        virtual ~Input() {}
+
+        /**
+         * Finds the next line, without its '\n'. It stays valid until the next call. Returns
+         * false at the end of the input.
+         */
+        bool nextLine(const char** line, size_t* length) {
+            while (true) {
+                const char* const newline = _next == _end ? NULL :
+                    static_cast<const char*>(std::memchr(_next, '\n', _end - _next));
+                if (newline) {
+                    *line = _next;
+                    *length = newline - _next;
+                    _next = newline + 1;
+                    return true;
+                }
+                if (!refill()) {
+                    if (_next == _end)
+                        return false;
+                    // The last line need not end in a newline.
+                    *line = _next;
+                    *length = _end - _next;
+                    _next = _end;
+                    return true;
+                }
+            }
+        }
+
+    protected:
+        Input() : _next(NULL), _end(NULL) {}
+
+        /**
+         * Makes more input available after [_next, _end), which may move. Returns false if
+         * there is no more.
+         */
+        virtual bool refill() = 0;
+
+        // The input that has not been handed out yet.
+        const char* _next;
+        const char* _end;
+    };
+
+    /** A whole file, memory mapped. */
+    class NDJSONReader::MappedFile : public NDJSONReader::Input {
+    public:
+        MappedFile(const void* data, size_t size) : _data(data), _size(size) {
+            _next = static_cast<const char*>(data);
+            _end = _next + size;
+        }
+
+        virtual ~MappedFile() {
+#ifndef _WIN32
+            if (_size > 0)
+                ::munmap(const_cast<void*>(_data), _size);
+#endif
+        }
+
+#ifndef _WIN32
+        /** Maps the file at 'path'. Returns NULL if that can't be done. */
+        static MappedFile* open(const std::string& path) {
+            const int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                return NULL;
+            struct stat info;
+            void* data = MAP_FAILED;
+            if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+                if (info.st_size == 0) {
+                    ::close(fd);
+                    return new MappedFile(NULL, 0);
+                }
+                data = ::mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            }
+            ::close(fd);
+            if (data == MAP_FAILED)
+                return NULL;
+            ::madvise(data, info.st_size, MADV_SEQUENTIAL);
+            return new MappedFile(data, info.st_size);
+        }
+#endif
+
+    protected:
+        virtual bool refill() { return false; }
+
+    private:
+        const void* const _data;
+        const size_t _size;
+    };
+
+    /** A stream, read a chunk at a time. */
+    class NDJSONReader::Stream : public NDJSONReader::Input {
+    public:
+        explicit Stream(std::istream* in) : _in(in) {}
+
+        /** Opens the file at 'path' to read through a stream. */
+        explicit Stream(const std::string& path)
+            : _file(new std::ifstream(path.c_str(), std::ios::in | std::ios::binary))
+            , _in(_file.get()) {
+            uassert(18753, str::stream() << "couldn't open file: " << path, _file->is_open());
+        }
+
+    protected:
+        virtual bool refill() {
+            if (!_in->good())
+                return false;
+
+            // Keeps the unfinished line, at the front, and fills the rest of the buffer.
+            const size_t kept = _end - _next;
+            if (_buffer.empty()) {
+                _buffer.resize(kStreamChunkSize);
+            }
+            else {
+                std::memmove(&_buffer[0], _next, kept);
+                if (kept == _buffer.size())
+                    _buffer.resize(_buffer.size() * 2);
+            }
+
+            _in->read(&_buffer[kept], _buffer.size() - kept);
+            const size_t got = _in->gcount();
+            _next = &_buffer[0];
+            _end = _next + kept + got;
+            return got > 0;
+        }
+
+    private:
+        boost::scoped_ptr<std::ifstream> _file;
+        std::istream* const _in;
+        std::vector<char> _buffer;
+    };
+
+    NDJSONReader::NDJSONReader(std::istream& in)
+        : _input(new Stream(&in))
+        , _maxBatchDocuments(kDefaultMaxBatchDocuments)
+        , _maxBatchBytes(kDefaultMaxBatchBytes)
+        , _parserThreads(1)
+        , _linesRead(0) {
+    }
+
+    NDJSONReader::NDJSONReader(const std::string& path)
+        : _maxBatchDocuments(kDefaultMaxBatchDocuments)
+        , _maxBatchBytes(kDefaultMaxBatchBytes)
+        , _parserThreads(1)
+        , _linesRead(0) {
+#ifndef _WIN32
+        _input.reset(MappedFile::open(path));
+#endif
+        if (!_input)
+            _input.reset(new Stream(path));
+    }
+
+    NDJSONReader::~NDJSONReader() {}
+
+    void NDJSONReader::setMaxBatchDocuments(size_t maxDocuments) {
+        uassert(18754, "a batch must be allowed at least one document", maxDocuments > 0);
+        _maxBatchDocuments = maxDocuments;
+    }
+
+    void NDJSONReader::setMaxBatchBytes(size_t maxBytes) {
+        _maxBatchBytes = maxBytes;
+    }
+
+    void NDJSONReader::setParserThreads(size_t threads) {
+        _parserThreads = std::max(threads, size_t(1));
+    }
+
+    bool NDJSONReader::nextBatch(std::vector<BSONObj>* batch) {
+        batch->clear();
+        _text.clear();
+        _lineStarts.clear();
+        _lineNumbers.clear();
+
+        // Copies the lines out of the input first: fromjson() needs them NUL terminated, and
+        // the parser threads need them to stay put.
+        size_t bytes = 0;
+        const char* line;
+        size_t length;
+        while (_lineStarts.size() < _maxBatchDocuments &&
+               (bytes < _maxBatchBytes || _lineStarts.empty()) &&
+               _input->nextLine(&line, &length)) {
+            ++_linesRead;
+            if (isBlank(line, line + length))
+                continue;
+            _lineStarts.push_back(_text.size());
+            _lineNumbers.push_back(_linesRead);
+            _text.append(line, length);
+            _text.push_back('\0');
+            bytes += length;
+        }
+
+        const size_t nLines = _lineStarts.size();
+        if (nLines == 0)
+            return false;
+        batch->resize(nLines);
+
+        // No point in a thread with just a few lines to parse.
+        const size_t nThreads = std::min(_parserThreads, (nLines + 15) / 16);
+        const size_t linesPerThread = (nLines + nThreads - 1) / nThreads;
+        std::vector<Status> statuses(nThreads, Status::OK());
+        if (nThreads == 1) {
+            _parseLines(0, nLines, batch, &statuses[0]);
+        }
+        else {
+            boost::thread_group workers;
+            try {
+                for (size_t i = 1; i < nThreads; ++i) {
+                    workers.create_thread(stdx::bind(&NDJSONReader::_parseLines, this,
+                                                     i * linesPerThread,
+                                                     std::min((i + 1) * linesPerThread, nLines),
+                                                     batch, &statuses[i]));
+                }
+                _parseLines(0, linesPerThread, batch, &statuses[0]);
+            }
+            catch (...) {
+                workers.join_all();
+                throw;
+            }
+            workers.join_all();
+        }
+
+        // The earliest error, if more than one thread hit one.
+        for (size_t i = 0; i < nThreads; ++i) {
+            if (!statuses[i].isOK()) {
+                batch->clear();
+                uasserted(18752, statuses[i].reason());
+            }
+        }
+        return true;
+    }
+
+    void NDJSONReader::_parseLines(size_t first, size_t last, std::vector<BSONObj>* batch,
+                                   Status* status) const {
+        for (size_t i = first; i < last; ++i) {
+            const char* const json = _text.data() + _lineStarts[i];
+            try {
+                int length = 0;
+                (*batch)[i] = fromjson(json, &length);
+                if (!isBlank(json + length, json + std::strlen(json))) {
+                    *status = Status(ErrorCodes::FailedToParse,
+                                     str::stream() << "line " << _lineNumbers[i]
+                                                   << ": more than one document");
+                    return;
+                }
+            }
+            catch (const DBException& e) {
+                *status = Status(ErrorCodes::FailedToParse,
+                                 str::stream() << "line " << _lineNumbers[i] << ": " << e.what());
+                return;
+            }
+        }
+    }
+
+} // namespace mongo
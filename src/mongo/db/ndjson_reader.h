@@ -0,0 +1,108 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "mongo/base/status.h"
+#include "mongo/bson/bsonobj.h"
+#include "mongo/client/export_macros.h"
+
+namespace mongo {
+
+    /**
+     * Reads newline-delimited JSON, one document per line as mongoexport writes it, in
+     * batches that can be passed straight to DBClientBase::insert():
+     *
+     *   NDJSONReader reader("export.json");
+     *   reader.setParserThreads(4);
+     *   std::vector<BSONObj> batch;
+     *   while (reader.nextBatch(&batch)) {
+     *       conn.insert("test.foo", batch);
+     *   }
+     *
+     * Each line is parsed by fromjson(), so anything it accepts may be used. Blank lines are
+     * skipped and Windows line endings are allowed. Files are memory mapped where possible;
+     * streams are read in large chunks. Only as much of the input as is needed for the batch
+     * being parsed is held at a time.
+     *
+     * With more than one parser thread, the lines of a batch are split between the threads
+     * and parsed concurrently. The documents of a batch are always in input order.
+     */
+    class MONGO_CLIENT_API NDJSONReader : private boost::noncopyable {
+    public:
+        static const size_t kDefaultMaxBatchDocuments = 1000;
+        static const size_t kDefaultMaxBatchBytes = 16 * 1024 * 1024;
+
+        /** Reads 'in', which must outlive the reader. */
+        explicit NDJSONReader(std::istream& in);
+
+        /**
+         * Reads the file at 'path'.
+         *
+         * @throws UserException if the file can't be opened.
+         */
+        explicit NDJSONReader(const std::string& path);
+
+        ~NDJSONReader();
+
+        /** A batch ends after this many documents. */
+        void setMaxBatchDocuments(size_t maxDocuments);
+
+        /** A batch ends once its lines add up to this many bytes of JSON. */
+        void setMaxBatchBytes(size_t maxBytes);
+
+        /** How many threads parse each batch, counting the caller's. The default is 1. */
+        void setParserThreads(size_t threads);
+
+        /**
+         * Replaces the contents of 'batch' with the documents on the next lines of the input.
+         * Returns false, with 'batch' empty, once the input has run out.
+         *
+         * @throws UserException naming the line if a line is not a valid document. The
+         *  documents on the lines before it in the batch are lost.
+         */
+        bool nextBatch(std::vector<BSONObj>* batch);
+
+        /** The number of lines taken from the input so far, blank lines included. */
+        long long linesRead() const { return _linesRead; }
+
+    private:
+        class Input;
+        class MappedFile;
+        class Stream;
+
+        // Parses lines [first, last) of the batch into 'batch', stopping at the first error.
+        void _parseLines(size_t first, size_t last, std::vector<BSONObj>* batch,
+                         Status* status) const;
+
+        boost::scoped_ptr<Input> _input;
+        size_t _maxBatchDocuments;
+        size_t _maxBatchBytes;
+        size_t _parserThreads;
+        long long _linesRead;
+
+        // The lines of the batch being parsed, each NUL terminated, and where they start.
+        std::string _text;
+        std::vector<size_t> _lineStarts;
+        std::vector<long long> _lineNumbers;
+    };
+
+} // namespace mongo
@@ -0,0 +1,173 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/db/ndjson_reader.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "mongo/db/jsobj.h"
+#include "mongo/unittest/unittest.h"
+
+namespace {
+
+    using namespace mongo;
+
+    std::string makeLines(int nDocuments) {
+        std::ostringstream lines;
+        for (int i = 0; i < nDocuments; ++i) {
+            lines << "{ \"_id\" : " << i << ", \"name\" : \"doc " << i << "\" }\n";
+        }
+        return lines.str();
+    }
+
+    // Reads the whole input, checking the documents are the ones makeLines() wrote.
+    void expectDocuments(NDJSONReader* reader, int nDocuments, size_t batchSize) {
+        std::vector<BSONObj> batch;
+        int next = 0;
+        while (reader->nextBatch(&batch)) {
+            ASSERT_EQUALS(std::min(batchSize, size_t(nDocuments - next)), batch.size());
+            for (size_t i = 0; i < batch.size(); ++i, ++next) {
+                const std::string name = str::stream() << "doc " << next;
+                ASSERT_EQUALS(BSON("_id" << next << "name" << name), batch[i]);
+            }
+        }
+        ASSERT_EQUALS(nDocuments, next);
+        ASSERT_TRUE(batch.empty());
+    }
+
+    TEST(NDJSONReader, ReadsBatches) {
+        std::istringstream in(makeLines(10));
+        NDJSONReader reader(in);
+        reader.setMaxBatchDocuments(4);
+        expectDocuments(&reader, 10, 4);
+        ASSERT_EQUALS(10, reader.linesRead());
+    }
+
+    TEST(NDJSONReader, BlankLinesAndLineEndings) {
+        std::istringstream in("\n{ a : 1 }\r\n   \n{ a : 2 }\n\n{ a : 3 }");
+        NDJSONReader reader(in);
+        std::vector<BSONObj> batch;
+        ASSERT_TRUE(reader.nextBatch(&batch));
+        ASSERT_EQUALS(3U, batch.size());
+        ASSERT_EQUALS(BSON("a" << 1), batch[0]);
+        ASSERT_EQUALS(BSON("a" << 2), batch[1]);
+        ASSERT_EQUALS(BSON("a" << 3), batch[2]);
+        ASSERT_FALSE(reader.nextBatch(&batch));
+        ASSERT_EQUALS(6, reader.linesRead());
+    }
+
+    TEST(NDJSONReader, EmptyInput) {
+        std::istringstream in("");
+        NDJSONReader reader(in);
+        std::vector<BSONObj> batch;
+        ASSERT_FALSE(reader.nextBatch(&batch));
+    }
+
+    TEST(NDJSONReader, BatchBytes) {
+        std::istringstream in(makeLines(10));
+        NDJSONReader reader(in);
+        reader.setMaxBatchBytes(1);
+        expectDocuments(&reader, 10, 1);
+    }
+
+    TEST(NDJSONReader, LinesLongerThanAChunk) {
+        const std::string big(3 * 1024 * 1024, 'x');
+        std::istringstream in("{ a : \"" + big + "\" }\n{ a : 1 }\n");
+        NDJSONReader reader(in);
+        std::vector<BSONObj> batch;
+        ASSERT_TRUE(reader.nextBatch(&batch));
+        ASSERT_EQUALS(2U, batch.size());
+        ASSERT_EQUALS(big, batch[0]["a"].String());
+        ASSERT_EQUALS(BSON("a" << 1), batch[1]);
+    }
+
+    TEST(NDJSONReader, ErrorsNameTheLine) {
+        std::istringstream in("{ a : 1 }\n{ a : 2 }\n{ a : }\n");
+        NDJSONReader reader(in);
+        std::vector<BSONObj> batch;
+        try {
+            reader.nextBatch(&batch);
+            FAIL() << "expected a UserException";
+        }
+        catch (const UserException& e) {
+            ASSERT_EQUALS(18752, e.getCode());
+            ASSERT_EQUALS(0U, std::string(e.what()).find("line 3: "));
+        }
+        ASSERT_TRUE(batch.empty());
+    }
+
+    TEST(NDJSONReader, OneDocumentPerLine) {
+        std::istringstream in("{ a : 1 } { a : 2 }\n");
+        NDJSONReader reader(in);
+        std::vector<BSONObj> batch;
+        ASSERT_THROWS(reader.nextBatch(&batch), UserException);
+    }
+
+    TEST(NDJSONReader, ParserThreadsKeepOrder) {
+        std::istringstream in(makeLines(5000));
+        NDJSONReader reader(in);
+        reader.setParserThreads(4);
+        expectDocuments(&reader, 5000, NDJSONReader::kDefaultMaxBatchDocuments);
+    }
+
+    TEST(NDJSONReader, ParserThreadsReportTheFirstError) {
+        std::string lines = makeLines(1000);
+        lines += "{ bad\n";
+        lines.insert(0, "{ bad\n");
+        std::istringstream in(lines);
+        NDJSONReader reader(in);
+        reader.setParserThreads(4);
+        reader.setMaxBatchDocuments(2000);
+        std::vector<BSONObj> batch;
+        try {
+            reader.nextBatch(&batch);
+            FAIL() << "expected a UserException";
+        }
+        catch (const UserException& e) {
+            ASSERT_EQUALS(0U, std::string(e.what()).find("line 1: "));
+        }
+    }
+
+#ifndef _WIN32
+    TEST(NDJSONReader, ReadsFiles) {
+        char path[] = "/tmp/ndjson.XXXXXXXX";
+        const int fd = mkstemp(path);
+        ASSERT_NOT_EQUALS(-1, fd);
+        close(fd);
+        {
+            std::ofstream out(path, std::ios::binary);
+            out << makeLines(2500);
+        }
+
+        {
+            NDJSONReader reader(path);
+            expectDocuments(&reader, 2500, NDJSONReader::kDefaultMaxBatchDocuments);
+        }
+        std::remove(path);
+    }
+#endif
+
+    TEST(NDJSONReader, MissingFile) {
+        ASSERT_THROWS(NDJSONReader("/no/such/file.json"), UserException);
+    }
+
+} // namespace
@@ -526,6 +526,47 @@ namespace JsonTests {
             }
         }; DBTEST_SHIM_TEST(NullString);
 
+        class IntegralDoubles {
+        public:
+            void run() {
+                ASSERT_EQUALS( "{ \"a\" : 0, \"b\" : -0, \"c\" : 1000000000000000, "
+                               "\"d\" : 1e+16, \"e\" : -42, \"f\" : 0.5 }",
+                               BSON( "a" << 0.0 << "b" << -0.0 << "c" << 1e15 << "d" << 1e16
+                                     << "e" << -42.0 << "f" << 0.5 ).jsonString() );
+            }
+        }; DBTEST_SHIM_TEST(IntegralDoubles);
+
+        class ToStringBuilder {
+        public:
+            void run() {
+                const BSONObj o = BSON( "a" << BSON_ARRAY( 1 << "x" ) << "b" << BSON( "c" << 2.5 )
+                                        << "d" << Date_t( 1000 ) );
+                StringBuilder s;
+                s << "prefix ";
+                o.jsonString( s, TenGen, 1 );
+                ASSERT_EQUALS( "prefix " + o.jsonString( TenGen, 1 ), s.str() );
+
+                // Reused, the builder keeps its buffer.
+                s.reset();
+                o["a"].jsonString( s, Strict );
+                ASSERT_EQUALS( o["a"].jsonString( Strict ), s.stringData().toString() );
+
+                s.reset();
+                BSON_ARRAY( 1 << 2 ).jsonString( s, Strict, 0, true );
+                ASSERT_EQUALS( "[ 1, 2 ]", s.str() );
+            }
+        }; DBTEST_SHIM_TEST(ToStringBuilder);
+
+        class ToStream {
+        public:
+            void run() {
+                const BSONObj o = BSON( "a" << 1 << "b" << "two" );
+                stringstream ss;
+                o.jsonString( ss, JS );
+                ASSERT_EQUALS( o.jsonString( JS ), ss.str() );
+            }
+        }; DBTEST_SHIM_TEST(ToStream);
+
         class AllTypes {
         public:
             void run() {
@@ -941,6 +982,45 @@ namespace JsonTests {
             }
         }; DBTEST_SHIM_TEST(InvalidControlCharacter);
 
+        // Strings long enough to be scanned a block at a time, with the characters that end a
+        // run at every position in and around the first block.
+        class LongStrings {
+        public:
+            void run() {
+                const string text = "abcdefghijklmnopqrstuvwxyz0123456789";
+                for ( size_t i = 0; i <= text.size(); ++i ) {
+                    const string before = text.substr( 0, i );
+                    const string after = text.substr( i );
+
+                    ASSERT_EQUALS( BSON( "a" << text ),
+                                   fromjson( "{ \"a\" : \"" + text + "\" }" ) );
+                    ASSERT_EQUALS( BSON( "a" << before + "\"" + after ),
+                                   fromjson( "{ \"a\" : \"" + before + "\\\"" + after + "\" }" ) );
+                    ASSERT_EQUALS( BSON( "a" << before + "\n" + after ),
+                                   fromjson( "{ \"a\" : \"" + before + "\\n" + after + "\" }" ) );
+                    ASSERT_EQUALS( BSON( "a" << before + "\"" + after ),
+                                   fromjson( "{ 'a' : '" + before + "\"" + after + "' }" ) );
+                    ASSERT_EQUALS( BSON( before + "_" + after << 1 ),
+                                   fromjson( "{ \"" + before + "_" + after + "\" : 1 }" ) );
+                    ASSERT_EQUALS( BSON( "a" << BSONRegEx( before + "/" + after, "i" ) ),
+                                   fromjson( "{ \"a\" : /" + before + "\\/" + after + "/i }" ) );
+
+                    ASSERT_THROWS( fromjson( "{ \"a\" : \"" + before + "\x1f" + after + "\" }" ),
+                                   MsgAssertionException );
+                    ASSERT_THROWS( fromjson( "{ \"a\" : \"" + before ), MsgAssertionException );
+                }
+            }
+        }; DBTEST_SHIM_TEST(LongStrings);
+
+        class LongUnquotedFieldName {
+        public:
+            void run() {
+                const string name = "$abcdefghijklmnopqrstuvwxyz_0123456789";
+                ASSERT_EQUALS( BSON( name << "b" << "c" << 1 ),
+                               fromjson( "{ " + name + " : \"b\", c : 1 }" ) );
+            }
+        }; DBTEST_SHIM_TEST(LongUnquotedFieldName);
+
         class NumbersInFieldName : public Base {
             virtual BSONObj bson() const {
                 BSONObjBuilder b;
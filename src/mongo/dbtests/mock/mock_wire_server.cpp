@@ -0,0 +1,580 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/dbtests/mock/mock_wire_server.h"
+
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <memory>
+
+#include "mongo/client/dbclientinterface.h"
+#include "mongo/client/write_options.h"
+#include "mongo/db/dbmessage.h"
+#include "mongo/util/assert_util.h"
+#include "mongo/util/md5.hpp"
+#include "mongo/util/mongoutils/str.h"
+#include "mongo/util/net/message_compressor.h"
+#include "mongo/util/net/message_port.h"
+#include "mongo/util/net/socket_poll.h"
+#include "mongo/util/time_support.h"
+
+namespace mongo {
+
+    using std::string;
+    using std::vector;
+
+    namespace {
+        const int kMaxBsonObjectSize = 16 * 1024 * 1024;
+        const int kMaxMessageSizeBytes = 48 * 1000 * 1000;
+
+        // Whether 'doc' satisfies 'filter', whose top-level fields are compared for equality or
+        // with $gt, $gte, $lt and $lte. Other operators are not understood and match anything.
+        bool matches(const BSONObj& doc, const BSONObj& filter) {
+            BSONObjIterator it(filter);
+            while (it.more()) {
+                const BSONElement cond = it.next();
+                if (cond.fieldName()[0] == '$')
+                    continue;
+
+                const BSONElement value = doc[cond.fieldName()];
+                if (cond.type() != Object || cond.Obj().firstElementFieldName()[0] != '$') {
+                    if (value.eoo() || value.woCompare(cond, false) != 0)
+                        return false;
+                    continue;
+                }
+
+                BSONObjIterator ops(cond.Obj());
+                while (ops.more()) {
+                    const BSONElement op = ops.next();
+                    const StringData name(op.fieldName());
+                    const int cmp = value.woCompare(op, false);
+                    if ((name == "$gt" && cmp <= 0) || (name == "$gte" && cmp < 0) ||
+                        (name == "$lt" && cmp >= 0) || (name == "$lte" && cmp > 0))
+                        return false;
+                }
+            }
+            return true;
+        }
+
+        // Orders documents by the first field of an "orderby" specification.
+        class FieldOrder {
+        public:
+            explicit FieldOrder(const BSONElement& key)
+                : _field(key.fieldName())
+                , _direction(key.number() < 0 ? -1 : 1) {
+            }
+
+            bool operator()(const BSONObj& a, const BSONObj& b) const {
+                return _direction * a[_field].woCompare(b[_field], false) < 0;
+            }
+
+        private:
+            string _field;
+            int _direction;
+        };
+    }
+
+    MockWireServer::MockWireServer()
+        : _listenSock(INVALID_SOCKET)
+        , _port(0)
+        , _killedCursorCount(0)
+        , _nextCursorId(1000)
+        , _replyDelayMillis(0)
+        , _splitReplyMillis(0)
+        , _maxWireVersion(0)
+        , _compressionEnabled(true)
+        , _lastInsertCount(0)
+        , _lastInsertDuplicate(false) {
+
+        SockAddr addr("127.0.0.1", 0);
+        _listenSock = ::socket(addr.getType(), SOCK_STREAM, 0);
+        fassert(18718, _listenSock != INVALID_SOCKET);
+
+        fassert(18719, ::bind(_listenSock, addr.raw(), addr.addressSize) == 0);
+        fassert(18720, ::listen(_listenSock, 128) == 0);
+
+        SockAddr bound;
+        fassert(18721, ::getsockname(_listenSock, bound.raw(), &bound.addressSize) == 0);
+        _port = bound.getPort();
+
+        _threads.create_thread(boost::bind(&MockWireServer::_acceptLoop, this));
+    }
+
+    MockWireServer::~MockWireServer() {
+        _shutdown.store(1);
+
+        vector<boost::shared_ptr<MessagingPort> > connections;
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            connections = _connections;
+        }
+        for (size_t i = 0; i < connections.size(); ++i) {
+            connections[i]->shutdown();
+        }
+
+        _threads.join_all();
+        closesocket(_listenSock);
+    }
+
+    HostAndPort MockWireServer::getHostAndPort() const {
+        return HostAndPort("127.0.0.1", _port);
+    }
+
+    DBClientConnection* MockWireServer::connect() {
+        std::auto_ptr<DBClientConnection> conn(new DBClientConnection());
+        string errmsg;
+        if (!conn->connect(getHostAndPort(), errmsg))
+            uasserted(ErrorCodes::HostUnreachable, errmsg);
+        return conn.release();
+    }
+
+    void MockWireServer::insert(const string& ns, const BSONObj& obj) {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        _collections[ns].push_back(obj.getOwned());
+    }
+
+    vector<BSONObj> MockWireServer::getDocuments(const string& ns) const {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        std::map<string, vector<BSONObj> >::const_iterator it = _collections.find(ns);
+        return it == _collections.end() ? vector<BSONObj>() : it->second;
+    }
+
+    void MockWireServer::setReplyDelayMillis(int millis) {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        _replyDelayMillis = millis;
+    }
+
+    void MockWireServer::setSplitReply(const string& name, int millis) {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        _splitReplyCommand = name;
+        _splitReplyMillis = millis;
+    }
+
+    void MockWireServer::setQueryFailure(const string& name) {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        _queryFailureCommand = name;
+    }
+
+    void MockWireServer::setMaxWireVersion(int version) {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        _maxWireVersion = version;
+    }
+
+    size_t MockWireServer::getOpCount(int op) const {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        std::map<int, size_t>::const_iterator it = _opCounts.find(op);
+        return it == _opCounts.end() ? 0 : it->second;
+    }
+
+    size_t MockWireServer::getKilledCursorCount() const {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        return _killedCursorCount;
+    }
+
+    size_t MockWireServer::getOpenCursorCount() const {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        return _cursors.size();
+    }
+
+    size_t MockWireServer::getConnectionCount() const {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        return _connections.size();
+    }
+
+    void MockWireServer::setCompressionEnabled(bool enabled) {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        _compressionEnabled = enabled;
+    }
+
+    long long MockWireServer::getBytesReceived() const {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        long long bytes = 0;
+        for (size_t i = 0; i < _connections.size(); ++i) {
+            bytes += _connections[i]->psock->getBytesIn();
+        }
+        return bytes;
+    }
+
+    void MockWireServer::_acceptLoop() {
+        while (!_shutdown.load()) {
+            pollfd pfd;
+            pfd.fd = _listenSock;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+
+            if (socketPoll(&pfd, 1, 50) <= 0)
+                continue;
+
+            SockAddr from;
+            int fd = ::accept(_listenSock, from.raw(), &from.addressSize);
+            if (fd < 0)
+                continue;
+
+            boost::shared_ptr<Socket> sock(new Socket(fd, from));
+            sock->setHandshakeReceived();
+            boost::shared_ptr<MessagingPort> port(new MessagingPort(sock));
+
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            if (_shutdown.load()) {
+                port->shutdown();
+                break;
+            }
+            _connections.push_back(port);
+            _threads.create_thread(boost::bind(&MockWireServer::_serve, this, port));
+        }
+    }
+
+    void MockWireServer::_serve(boost::shared_ptr<MessagingPort> port) {
+        Message request;
+        while (!_shutdown.load() && port->recv(request)) {
+            int delay;
+            {
+                boost::lock_guard<boost::mutex> lk(_mutex);
+                ++_opCounts[request.operation()];
+                delay = _replyDelayMillis;
+            }
+            if (delay > 0)
+                sleepmillis(delay);
+
+            try {
+                switch (request.operation()) {
+                case dbQuery: _handleQuery(port.get(), request); break;
+                case dbGetMore: _handleGetMore(port.get(), request); break;
+                case dbInsert: _handleInsert(request); break;
+                case dbKillCursors: _handleKillCursors(request); break;
+                default: break;
+                }
+            }
+            catch (const SocketException&) {
+                break;
+            }
+
+            request.reset();
+        }
+    }
+
+    void MockWireServer::_handleQuery(MessagingPort* port, Message& request) {
+        DbMessage d(request);
+        QueryMessage q(d);
+
+        const string ns(q.ns);
+        const size_t dot = ns.find('.');
+        if (dot != string::npos && ns.substr(dot + 1) == "$cmd") {
+            _handleCommand(port, request, ns.substr(0, dot), q.query);
+            return;
+        }
+
+        BSONObj filter = q.query;
+        BSONObj orderBy;
+        if (filter.hasField("$query") || filter.hasField("query")) {
+            orderBy = filter.getObjectField("orderby");
+            filter = filter.getObjectField(filter.hasField("$query") ? "$query" : "query");
+        }
+
+        const vector<BSONObj> all = getDocuments(ns);
+        vector<BSONObj> docs;
+        for (size_t i = 0; i < all.size(); ++i) {
+            if (matches(all[i], filter))
+                docs.push_back(all[i]);
+        }
+        if (!orderBy.isEmpty())
+            std::stable_sort(docs.begin(), docs.end(), FieldOrder(orderBy.firstElement()));
+
+        const int skip = std::min(static_cast<size_t>(q.ntoskip), docs.size());
+        docs.erase(docs.begin(), docs.begin() + skip);
+
+        const bool singleBatch = q.ntoreturn < 0;
+        int batchSize = std::abs(q.ntoreturn);
+        if (batchSize == 0)
+            batchSize = kDefaultBatchSize;
+        _replyWithBatch(port, request, ns, docs, batchSize, singleBatch, 0);
+    }
+
+    void MockWireServer::_handleCommand(MessagingPort* port, Message& request,
+                                        const string& db, const BSONObj& query) {
+        BSONObj cmd = query;
+        if (cmd.hasField("$query"))
+            cmd = cmd["$query"].Obj();
+
+        const string name = cmd.firstElementFieldName();
+        BSONObjBuilder reply;
+
+        bool queryFailure;
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            queryFailure = name == _queryFailureCommand;
+        }
+        if (queryFailure) {
+            replyToQuery(ResultFlag_ErrSet, port, request,
+                         BSON("$err" << "mock query failure" << "code" << 13));
+            return;
+        }
+
+        // Only switched to once the isMaster reply is out.
+        const MessageCompressor* compressor = NULL;
+
+        if (name == "ismaster" || name == "isMaster") {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            if (_compressionEnabled && cmd.hasField("compression")) {
+                BSONArrayBuilder accepted(reply.subarrayStart("compression"));
+                BSONObjIterator it(cmd.getObjectField("compression"));
+                while (it.more()) {
+                    const MessageCompressor* known = MessageCompressor::forName(it.next().str());
+                    if (!known)
+                        continue;
+                    accepted.append(known->getName());
+                    if (!compressor)
+                        compressor = known;
+                }
+            }
+            reply.append("ismaster", true);
+            reply.append("maxBsonObjectSize", kMaxBsonObjectSize);
+            reply.append("maxMessageSizeBytes", kMaxMessageSizeBytes);
+            reply.append("maxWriteBatchSize", 1000);
+            reply.append("minWireVersion", 0);
+            reply.append("maxWireVersion", _maxWireVersion);
+            reply.append("ok", 1.0);
+        }
+        else if (name == "getlasterror" || name == "getLastError") {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            reply.append("n", _lastInsertCount);
+            if (_lastInsertDuplicate) {
+                reply.append("err", "E11000 duplicate key error");
+                reply.append("code", ErrorCodes::DuplicateKey);
+            }
+            else {
+                reply.appendNull("err");
+            }
+            reply.append("ok", 1.0);
+        }
+        else if (name == "ping") {
+            reply.append("ok", 1.0);
+        }
+        else if (name == "insert") {
+            // Documents whose _id is already taken are rejected with a duplicate key error.
+            const string ns = db + "." + cmd.firstElement().str();
+            const vector<BSONElement> docs = cmd["documents"].Array();
+            const bool ordered = !cmd.hasField("ordered") || cmd["ordered"].trueValue();
+
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            vector<BSONObj>& collection = _collections[ns];
+            BSONObjSet ids;
+            for (size_t i = 0; i < collection.size(); ++i) {
+                ids.insert(collection[i]["_id"].wrap());
+            }
+
+            int n = 0;
+            BSONArrayBuilder writeErrors;
+            for (size_t i = 0; i < docs.size(); ++i) {
+                const BSONObj doc = docs[i].Obj();
+                if (doc.hasField("_id") && !ids.insert(doc["_id"].wrap()).second) {
+                    writeErrors.append(BSON("index" << static_cast<int>(i)
+                                            << "code" << ErrorCodes::DuplicateKey
+                                            << "errmsg" << "E11000 duplicate key error"));
+                    if (ordered)
+                        break;
+                    continue;
+                }
+                collection.push_back(doc.getOwned());
+                ++n;
+            }
+            _lastInsertCount = n;
+            _lastInsertDuplicate = false;
+            reply.append("n", n);
+            if (writeErrors.arrSize())
+                reply.append("writeErrors", writeErrors.arr());
+            reply.append("ok", 1.0);
+        }
+        else if (name == "parallelCollectionScan") {
+            // Splits the collection into up to numCursors contiguous ranges, one cursor each.
+            const string ns = db + "." + cmd.firstElement().str();
+            const vector<BSONObj> docs = getDocuments(ns);
+            const size_t numCursors = std::max(1, cmd["numCursors"].numberInt());
+            const size_t perCursor = (docs.size() + numCursors - 1) / numCursors;
+
+            BSONArrayBuilder cursors(reply.subarrayStart("cursors"));
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            for (size_t begin = 0; begin < docs.size(); begin += perCursor) {
+                const long long cursorId = _nextCursorId++;
+                Cursor& cursor = _cursors[cursorId];
+                cursor.ns = ns;
+                cursor.remaining.assign(docs.begin() + begin,
+                                        docs.begin() + std::min(begin + perCursor, docs.size()));
+
+                cursors.append(BSON("cursor" << BSON("id" << cursorId
+                                                     << "ns" << ns
+                                                     << "firstBatch" << BSONArray())
+                                    << "ok" << true));
+            }
+            cursors.done();
+            reply.append("ok", 1.0);
+        }
+        else if (name == "filemd5") {
+            // Hashes the file's chunks in order, as mongod does.
+            const string root = cmd.hasField("root") ? cmd["root"].str() : string("fs");
+            const vector<BSONObj> docs = getDocuments(db + "." + root + ".chunks");
+            std::map<int, BSONObj> chunks;
+            for (size_t i = 0; i < docs.size(); ++i) {
+                if (docs[i]["files_id"].valuesEqual(cmd.firstElement()))
+                    chunks[docs[i]["n"].numberInt()] = docs[i];
+            }
+
+            md5_state_t st;
+            md5_init(&st);
+            for (std::map<int, BSONObj>::const_iterator it = chunks.begin();
+                 it != chunks.end(); ++it) {
+                int len;
+                const char* data = it->second["data"].binDataClean(len);
+                md5_append(&st, reinterpret_cast<const md5_byte_t*>(data), len);
+            }
+            md5digest digest;
+            md5_finish(&st, digest);
+
+            reply.append("numChunks", static_cast<int>(chunks.size()));
+            reply.append("md5", digestToString(digest));
+            reply.append("ok", 1.0);
+        }
+        else if (name == "count") {
+            const string ns = db + "." + cmd.firstElement().str();
+            reply.append("n", static_cast<double>(getDocuments(ns).size()));
+            reply.append("ok", 1.0);
+        }
+        else {
+            reply.append("ok", 0.0);
+            reply.append("errmsg", str::stream() << "no such cmd: " << name);
+            reply.append("code", ErrorCodes::CommandNotFound);
+        }
+
+        string splitCommand;
+        int splitMillis;
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            splitCommand = _splitReplyCommand;
+            splitMillis = _splitReplyMillis;
+        }
+
+        if (name == splitCommand) {
+            Message response;
+            replyToQuery(0, response, reply.obj());
+            response.header().setId(nextMessageId());
+            response.header().setResponseTo(request.header().getId());
+
+            const char* data = response.singleData().view2ptr();
+            const int len = response.header().getLen();
+            port->psock->send(data, len / 2, "split reply");
+            sleepmillis(splitMillis);
+            port->psock->send(data + len / 2, len - len / 2, "split reply");
+        }
+        else {
+            replyToQuery(0, port, request, reply.obj());
+        }
+
+        if (compressor)
+            port->setCompressor(compressor);
+    }
+
+    void MockWireServer::_handleGetMore(MessagingPort* port, Message& request) {
+        DbMessage d(request);
+        const string ns = d.getns();
+        const int ntoreturn = d.pullInt();
+        const long long cursorId = d.pullInt64();
+
+        vector<BSONObj> docs;
+        {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            std::map<long long, Cursor>::iterator it = _cursors.find(cursorId);
+            if (it == _cursors.end()) {
+                replyToQuery(ResultFlag_CursorNotFound, port, request, 0, 0, 0);
+                return;
+            }
+            docs.swap(it->second.remaining);
+            _cursors.erase(it);
+        }
+
+        const int batchSize = ntoreturn == 0 ? static_cast<int>(docs.size()) : std::abs(ntoreturn);
+        _replyWithBatch(port, request, ns, docs, batchSize, false, cursorId);
+    }
+
+    void MockWireServer::_handleInsert(Message& request) {
+        DbMessage d(request);
+        const string ns = d.getns();
+
+        const bool continueOnError = d.reservedField() & InsertOption_ContinueOnError;
+
+        // Like the insert command, rejects documents whose _id is already taken; the
+        // error is reported by the next getLastError.
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        vector<BSONObj>& collection = _collections[ns];
+        BSONObjSet ids;
+        for (size_t i = 0; i < collection.size(); ++i) {
+            ids.insert(collection[i]["_id"].wrap());
+        }
+
+        int count = 0;
+        _lastInsertDuplicate = false;
+        while (d.moreJSObjs()) {
+            const BSONObj doc = d.nextJsObj();
+            if (doc.hasField("_id") && !ids.insert(doc["_id"].wrap()).second) {
+                _lastInsertDuplicate = true;
+                if (!continueOnError)
+                    break;
+                continue;
+            }
+            collection.push_back(doc.getOwned());
+            ++count;
+        }
+        _lastInsertCount = count;
+    }
+
+    void MockWireServer::_handleKillCursors(Message& request) {
+        DbMessage d(request);
+        const int n = d.pullInt();
+
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        for (int i = 0; i < n; ++i) {
+            _cursors.erase(d.pullInt64());
+            ++_killedCursorCount;
+        }
+    }
+
+    void MockWireServer::_replyWithBatch(MessagingPort* port, Message& request,
+                                         const string& ns, vector<BSONObj> docs,
+                                         int batchSize, bool singleBatch,
+                                         long long cursorId) {
+        const size_t count = std::min(static_cast<size_t>(batchSize), docs.size());
+
+        BufBuilder b;
+        for (size_t i = 0; i < count; ++i) {
+            b.appendBuf(docs[i].objdata(), docs[i].objsize());
+        }
+
+        if (count < docs.size() && !singleBatch) {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            if (cursorId == 0)
+                cursorId = _nextCursorId++;
+            Cursor& cursor = _cursors[cursorId];
+            cursor.ns = ns;
+            cursor.remaining.assign(docs.begin() + count, docs.end());
+        }
+        else {
+            cursorId = 0;
+        }
+
+        replyToQuery(0, port, request, b.buf(), b.len(), count, 0, cursorId);
+    }
+
+} // namespace mongo
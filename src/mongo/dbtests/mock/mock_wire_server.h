@@ -0,0 +1,163 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mongo/db/jsobj.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/util/net/hostandport.h"
+#include "mongo/util/net/message.h"
+#include "mongo/util/net/sock.h"
+
+namespace mongo {
+
+    class DBClientConnection;
+    class MessagingPort;
+
+    /**
+     * A very small MongoDB server speaking the legacy wire protocol over real TCP sockets on the
+     * loopback interface. Unlike MockRemoteDBServer, which replaces DBClientConnection
+     * altogether, this lets tests exercise the driver's actual networking code (MessagingPort,
+     * DBClientConnection, DBClientCursor) end to end.
+     *
+     * Supported operations:
+     *  - OP_INSERT stores documents per namespace.
+     *  - OP_QUERY on a collection returns the stored documents of that namespace that match
+     *    the top-level equality, $gt, $gte, $lt and $lte conditions of the query predicate,
+     *    ordered by the first field of "orderby" if given. Skip and the requested batch size
+     *    are honored, projections are not, and a cursor is opened if documents remain.
+     *  - OP_GET_MORE and OP_KILL_CURSORS operate on those cursors.
+     *  - OP_QUERY on '$cmd' answers isMaster, ping, getLastError, count, the insert write
+     *    command (which reports duplicate _ids as write errors), parallelCollectionScan and
+     *    GridFS's filemd5.
+     *  - isMaster accepts all the compressors of the build that the client asks for, after
+     *    which the connection is compressed in both directions.
+     *
+     * Note: All state is protected by a lock; each accepted connection is served by its own
+     * thread.
+     */
+    class MockWireServer {
+    public:
+        // Batch size used when a query does not ask for a specific number of documents.
+        static const int kDefaultBatchSize = 101;
+
+        /** Starts listening on an ephemeral loopback port. */
+        MockWireServer();
+
+        /** Closes the listening socket and all accepted connections. */
+        ~MockWireServer();
+
+        /** The address clients should connect to. */
+        HostAndPort getHostAndPort() const;
+
+        /**
+         * Returns a new connection to this server, owned by the caller. Throws if it can't
+         * connect. Tests bind to this wherever the driver takes a connection factory.
+         */
+        DBClientConnection* connect();
+
+        /** Adds a document to 'ns' as if it had been inserted by a client. */
+        void insert(const std::string& ns, const BSONObj& obj);
+
+        /** Returns the documents stored in 'ns'. */
+        std::vector<BSONObj> getDocuments(const std::string& ns) const;
+
+        /** Delays every reply by 'millis'. */
+        void setReplyDelayMillis(int millis);
+
+        /**
+         * Sends replies to the command 'name' in two halves, the second 'millis' after the
+         * first, as a slow network would. Replies are always sent uncompressed this way.
+         */
+        void setSplitReply(const std::string& name, int millis);
+
+        /** Answers the command 'name' with a { $err: ... } query failure. */
+        void setQueryFailure(const std::string& name);
+
+        /** Sets the maxWireVersion reported by isMaster. Defaults to 0. */
+        void setMaxWireVersion(int version);
+
+        /** Whether isMaster agrees to compression. Defaults to true. */
+        void setCompressionEnabled(bool enabled);
+
+        /** Number of messages received with the given opcode, after decompression. */
+        size_t getOpCount(int op) const;
+
+        /** Number of cursor ids received in OP_KILL_CURSORS messages. */
+        size_t getKilledCursorCount() const;
+
+        /** Number of server cursors that are still open. */
+        size_t getOpenCursorCount() const;
+
+        /** Number of connections accepted so far. */
+        size_t getConnectionCount() const;
+
+        /** Number of bytes received on the wire, over all connections. */
+        long long getBytesReceived() const;
+
+    private:
+        struct Cursor {
+            std::string ns;
+            std::vector<BSONObj> remaining;
+        };
+
+        void _acceptLoop();
+        void _serve(boost::shared_ptr<MessagingPort> port);
+
+        void _handleQuery(MessagingPort* port, Message& request);
+        void _handleCommand(MessagingPort* port, Message& request,
+                            const std::string& db, const BSONObj& cmd);
+        void _handleGetMore(MessagingPort* port, Message& request);
+        void _handleInsert(Message& request);
+        void _handleKillCursors(Message& request);
+
+        // Sends up to 'batchSize' documents from the front of 'docs', opening or
+        // keeping a cursor if documents remain. 'cursorId' is 0 for a new query.
+        void _replyWithBatch(MessagingPort* port, Message& request,
+                             const std::string& ns, std::vector<BSONObj> docs,
+                             int batchSize, bool singleBatch,
+                             long long cursorId);
+
+        SOCKET _listenSock;
+        int _port;
+        AtomicWord<int> _shutdown;
+
+        mutable boost::mutex _mutex;
+        std::map<std::string, std::vector<BSONObj> > _collections;
+        std::map<long long, Cursor> _cursors;
+        std::map<int, size_t> _opCounts;
+        std::vector<boost::shared_ptr<MessagingPort> > _connections;
+        size_t _killedCursorCount;
+        long long _nextCursorId;
+        int _replyDelayMillis;
+        std::string _splitReplyCommand;
+        int _splitReplyMillis;
+        std::string _queryFailureCommand;
+        int _maxWireVersion;
+        bool _compressionEnabled;
+        int _lastInsertCount;
+        bool _lastInsertDuplicate;
+
+        boost::thread_group _threads;
+    };
+
+} // namespace mongo
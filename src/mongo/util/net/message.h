@@ -25,6 +25,7 @@
 #include "mongo/base/encoded_value_storage.h"
 #include "mongo/util/mongoutils/str.h"
 #include "mongo/util/net/hostandport.h"
+#include "mongo/util/net/message_buffer_pool.h"
 #include "mongo/util/net/operation.h"
 #include "mongo/util/net/sock.h"
 
@@ -54,6 +55,7 @@ namespace mongo {
         case dbGetMore: return "getmore";
         case dbDelete: return "remove";
         case dbKillCursors: return "killcursors";
+        case dbCompressed: return "compressed";
         default:
             massert( 16141, str::stream() << "cannot translate opcode " << op, !op );
             return "";
@@ -69,6 +71,7 @@ namespace mongo {
         case dbQuery:
         case dbGetMore:
         case dbKillCursors:
+        case dbCompressed:
             return false;
 
         case dbUpdate:
@@ -298,12 +301,12 @@ namespace mongo {
     class Message {
     public:
         // we assume here that a vector with initial size 0 does no allocation (0 is the default, but wanted to make it explicit).
-        Message() : _buf( 0 ), _data( 0 ), _freeIt( false ) {}
+        Message() : _buf( 0 ), _data( 0 ), _freeIt( false ), _poolCapacity( 0 ) {}
         Message( void * data , bool freeIt ) :
-            _buf( 0 ), _data( 0 ), _freeIt( false ) {
+            _buf( 0 ), _data( 0 ), _freeIt( false ), _poolCapacity( 0 ) {
             _setData( reinterpret_cast< char* >( data ), freeIt );
         };
-        Message(Message& r) : _buf( 0 ), _data( 0 ), _freeIt( false ) {
+        Message(Message& r) : _buf( 0 ), _data( 0 ), _freeIt( false ), _poolCapacity( 0 ) {
             *this = r;
         }
         ~Message() {
@@ -326,6 +329,8 @@ namespace mongo {
 
         bool empty() const { return !_buf && _data.empty(); }
 
+        bool isMultiBuffer() const { return !_data.empty(); }
+
         int size() const {
             int res = 0;
             if ( _buf ) {
@@ -341,6 +346,27 @@ namespace mongo {
 
         int dataSize() const { return size() - sizeof(MSGHEADER::Value); }
 
+        // copies the whole message, header included, to 'dest', which must hold size() bytes
+        void copyTo(char* dest) const {
+            if ( _buf ) {
+                memcpy( dest, _buf, MsgData::ConstView(_buf).getLen() );
+                return;
+            }
+            for (MsgVec::const_iterator it = _data.begin(); it != _data.end(); ++it) {
+                memcpy( dest, it->first, it->second );
+                dest += it->second;
+            }
+        }
+
+        // appends the message's buffers to 'buffers', for a gathering write along with others
+        void appendBuffersTo(std::vector< std::pair< char *, int > >* buffers) const {
+            if ( _buf ) {
+                buffers->push_back(std::make_pair(_buf, MsgData::ConstView(_buf).getLen()));
+                return;
+            }
+            buffers->insert(buffers->end(), _data.begin(), _data.end());
+        }
+
         // concat multiple buffers - noop if <2 buffers already, otherwise can be expensive copy
         // can get rid of this if we make response handling smarter
         void concat() {
@@ -371,6 +397,8 @@ namespace mongo {
             verify( r._freeIt );
             _buf = r._buf;
             r._buf = 0;
+            _poolCapacity = r._poolCapacity;
+            r._poolCapacity = 0;
             if ( r._data.size() > 0 ) {
                 _data.swap( r._data );
             }
@@ -381,7 +409,10 @@ namespace mongo {
 
         void reset() {
             if ( _freeIt ) {
-                if ( _buf ) {
+                if ( _poolCapacity ) {
+                    MessageBufferPool::global().release( _buf, _poolCapacity );
+                }
+                else if ( _buf ) {
                     free( _buf );
                 }
                 for (std::vector< std::pair< char *, int > >::const_iterator i = _data.begin();
@@ -392,6 +423,7 @@ namespace mongo {
             _buf = 0;
             _data.clear();
             _freeIt = false;
+            _poolCapacity = 0;
         }
 
         // use to add a buffer
@@ -407,6 +439,31 @@ namespace mongo {
                 return;
             }
             verify( _freeIt );
+            // buffers in _data are released with free(), so pooled buffers can't go there
+            verify( !_poolCapacity );
+            if ( _buf ) {
+                _data.push_back(std::make_pair(_buf, MsgData::ConstView(_buf).getLen()));
+                _buf = 0;
+            }
+            _data.push_back(std::make_pair(d, size));
+            header().setLen(header().getLen() + size);
+        }
+
+        // use to add a buffer owned by the caller, which must stay valid and unchanged until the
+        // message is reset. The buffers are sent with one gathering write, so a request can be
+        // assembled from existing buffers without copying them. The first buffer must hold at
+        // least a full MsgData header.
+        void appendBorrowedData(char *d, int size) {
+            if ( size <= 0 ) {
+                return;
+            }
+            if ( empty() ) {
+                MsgData::View md = d;
+                md.setLen(size); // can be updated later if more buffers added
+                _setData( md.view2ptr(), false );
+                return;
+            }
+            verify( !_freeIt );
             if ( _buf ) {
                 _data.push_back(std::make_pair(_buf, MsgData::ConstView(_buf).getLen()));
                 _buf = 0;
@@ -420,6 +477,13 @@ namespace mongo {
             verify( empty() );
             _setData( d, freeIt );
         }
+        // use to set first buffer if empty, taking ownership of a buffer of size 'capacity'
+        // obtained from MessageBufferPool::global()
+        void setPooledData(char* d, size_t capacity) {
+            verify( empty() );
+            _setData( d, true );
+            _poolCapacity = capacity;
+        }
         void setData(int operation, const char *msgtxt) {
             setData(operation, msgtxt, strlen(msgtxt)+1);
         }
@@ -452,6 +516,8 @@ namespace mongo {
         typedef std::vector< std::pair< char*, int > > MsgVec;
         MsgVec _data;
         bool _freeIt;
+        // non-zero if _buf belongs to MessageBufferPool::global()
+        size_t _poolCapacity;
     };
 
 
@@ -0,0 +1,176 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/util/net/message_buffer_pool.h"
+
+#include <boost/thread/locks.hpp>
+#include <cstdlib>
+
+#include "mongo/util/assert_util.h"
+
+namespace mongo {
+
+    namespace {
+        // Intentionally leaked: Messages may still be released during static destruction.
+        MessageBufferPool* const globalPool = new MessageBufferPool(0);
+
+        const size_t kStepsPerPowerOfTwo = 4;
+    }
+
+    MessageBufferPool::MessageBufferPool(size_t maxRetainedBytes)
+        : _numFreeLists(_numSizeClasses())
+        , _freeLists(new FreeList[_numFreeLists])
+        , _maxRetainedBytes(maxRetainedBytes) {
+    }
+
+    MessageBufferPool::~MessageBufferPool() {
+        clear();
+    }
+
+    MessageBufferPool& MessageBufferPool::global() {
+        return *globalPool;
+    }
+
+    size_t MessageBufferPool::roundUpToSizeClass(size_t size) {
+        size_t capacity;
+        _sizeClass(size, &capacity);
+        return capacity;
+    }
+
+    size_t MessageBufferPool::_sizeClass(size_t size, size_t* capacity) {
+        if (size <= kMinBufferSize) {
+            *capacity = kMinBufferSize;
+            return 0;
+        }
+
+        // Find the power of two 'base' with base < size <= 2 * base, then the smallest of the
+        // steps base + step, base + 2 * step, ... that fits.
+        size_t base = kMinBufferSize;
+        size_t doublings = 0;
+        while (base * 2 < size) {
+            base *= 2;
+            ++doublings;
+        }
+
+        const size_t step = base / kStepsPerPowerOfTwo;
+        const size_t steps = (size - base + step - 1) / step;
+        *capacity = base + steps * step;
+        return 1 + doublings * kStepsPerPowerOfTwo + (steps - 1);
+    }
+
+    size_t MessageBufferPool::_numSizeClasses() {
+        size_t capacity;
+        return _sizeClass(kMaxPooledBufferSize, &capacity) + 1;
+    }
+
+    size_t MessageBufferPool::_capacityOf(size_t sizeClass) {
+        if (sizeClass == 0)
+            return kMinBufferSize;
+
+        const size_t base = kMinBufferSize << ((sizeClass - 1) / kStepsPerPowerOfTwo);
+        const size_t steps = (sizeClass - 1) % kStepsPerPowerOfTwo + 1;
+        return base + steps * (base / kStepsPerPowerOfTwo);
+    }
+
+    char* MessageBufferPool::allocate(size_t size, size_t* capacity) {
+        const size_t sizeClass = _sizeClass(size, capacity);
+
+        if (sizeClass < _numFreeLists) {
+            // Nothing cached anywhere: don't bother locking.
+            if (_retainedBytes.load() > 0) {
+                char* buf = NULL;
+                {
+                    FreeList& freeList = _freeLists[sizeClass];
+                    boost::lock_guard<boost::mutex> lk(freeList.mutex);
+                    if (!freeList.buffers.empty()) {
+                        buf = freeList.buffers.back();
+                        freeList.buffers.pop_back();
+                    }
+                }
+                if (buf) {
+                    _retainedBytes.subtractAndFetch(*capacity);
+                    _numHits.addAndFetch(1);
+                    return buf;
+                }
+            }
+            _numMisses.addAndFetch(1);
+        }
+
+        char* buf = static_cast<char*>(std::malloc(*capacity));
+        if (!buf)
+            msgasserted(18728, "out of memory MessageBufferPool::allocate");
+        return buf;
+    }
+
+    void MessageBufferPool::release(char* buf, size_t capacity) {
+        if (!buf)
+            return;
+
+        size_t classCapacity;
+        const size_t sizeClass = _sizeClass(capacity, &classCapacity);
+        verify(classCapacity == capacity);
+
+        if (sizeClass < _numFreeLists && _maxRetainedBytes.load() > 0) {
+            // Reserve room under the limit before caching the buffer.
+            if (_retainedBytes.addAndFetch(capacity) <= _maxRetainedBytes.load()) {
+                FreeList& freeList = _freeLists[sizeClass];
+                boost::lock_guard<boost::mutex> lk(freeList.mutex);
+                freeList.buffers.push_back(buf);
+                return;
+            }
+            _retainedBytes.subtractAndFetch(capacity);
+        }
+
+        std::free(buf);
+    }
+
+    void MessageBufferPool::setMaxRetainedBytes(size_t maxRetainedBytes) {
+        _maxRetainedBytes.store(maxRetainedBytes);
+        _trimTo(maxRetainedBytes);
+    }
+
+    void MessageBufferPool::clear() {
+        _trimTo(0);
+    }
+
+    size_t MessageBufferPool::getRetainedBytes() const {
+        return _retainedBytes.load();
+    }
+
+    size_t MessageBufferPool::getNumHits() const {
+        return _numHits.load();
+    }
+
+    size_t MessageBufferPool::getNumMisses() const {
+        return _numMisses.load();
+    }
+
+    void MessageBufferPool::_trimTo(size_t limit) {
+        for (size_t i = _numFreeLists; i > 0 && _retainedBytes.load() > limit; --i) {
+            FreeList& freeList = _freeLists[i - 1];
+            const size_t capacity = _capacityOf(i - 1);
+
+            boost::lock_guard<boost::mutex> lk(freeList.mutex);
+            while (!freeList.buffers.empty() && _retainedBytes.load() > limit) {
+                std::free(freeList.buffers.back());
+                freeList.buffers.pop_back();
+                _retainedBytes.subtractAndFetch(capacity);
+            }
+        }
+    }
+
+} // namespace mongo
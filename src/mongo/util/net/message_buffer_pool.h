@@ -0,0 +1,125 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cstddef>
+#include <vector>
+
+#include "mongo/client/export_macros.h"
+#include "mongo/platform/atomic_word.h"
+
+namespace mongo {
+
+    /**
+     * A cache of receive buffers, grouped into size classes.
+     *
+     * MessagingPort::recv() used to malloc a fresh buffer for every incoming message and Message
+     * freed it again on reset(). For cursor-heavy workloads that is one large allocation per
+     * batch, and allocations above the allocator's mmap threshold also mean fresh page faults
+     * every time. Buffers obtained from a pool are instead handed back to it when their Message
+     * is reset, and the next message of a similar size reuses them.
+     *
+     * Requested sizes are rounded up to a size class: powers of two from kMinBufferSize, each
+     * split into four equal steps, so no more than 25% of a buffer is ever wasted. A pool keeps
+     * released buffers until 'maxRetainedBytes' are cached; beyond that released buffers are
+     * freed.
+     *
+     * Each size class has its own lock, so threads receiving messages of different sizes don't
+     * contend, and a pool with nothing cached takes no lock at all. The global pool caches
+     * nothing until an application opts in with setMaxRetainedBytes(); 64MB, for instance, keeps
+     * one maximum-sized message around.
+     *
+     * All methods are thread-safe.
+     */
+    class MONGO_CLIENT_API MessageBufferPool : private boost::noncopyable {
+    public:
+        static const size_t kMinBufferSize = 1024;
+
+        // Buffers larger than this are never cached. Covers MaxMessageSizeBytes.
+        static const size_t kMaxPooledBufferSize = 64 * 1024 * 1024;
+
+        explicit MessageBufferPool(size_t maxRetainedBytes);
+
+        /** Frees all cached buffers. */
+        ~MessageBufferPool();
+
+        /**
+         * The pool used by MessagingPort::recv(). It is never destroyed and retains nothing
+         * unless setMaxRetainedBytes() is called on it.
+         */
+        static MessageBufferPool& global();
+
+        /** Rounds 'size' up to the capacity of its size class. */
+        static size_t roundUpToSizeClass(size_t size);
+
+        /**
+         * Returns a buffer of at least 'size' bytes and stores its actual size in '*capacity'.
+         * The buffer must be given back with release() along with that capacity.
+         */
+        char* allocate(size_t size, size_t* capacity);
+
+        /** Returns 'buf', of size 'capacity', to the pool. */
+        void release(char* buf, size_t capacity);
+
+        /** Changes the cache limit, freeing cached buffers as needed to honor it. */
+        void setMaxRetainedBytes(size_t maxRetainedBytes);
+
+        /** Frees all cached buffers. */
+        void clear();
+
+        /** Total size of the buffers currently cached. */
+        size_t getRetainedBytes() const;
+
+        /** Number of allocate() calls satisfied from the cache. */
+        size_t getNumHits() const;
+
+        /** Number of allocate() calls that had to allocate memory. */
+        size_t getNumMisses() const;
+
+    private:
+        struct FreeList {
+            boost::mutex mutex;
+            std::vector<char*> buffers;
+        };
+
+        // Returns the index of the size class 'size' falls into and sets '*capacity' to that
+        // class's buffer size.
+        static size_t _sizeClass(size_t size, size_t* capacity);
+
+        // The number of size classes that are cached.
+        static size_t _numSizeClasses();
+
+        // The buffer size of size class 'sizeClass'.
+        static size_t _capacityOf(size_t sizeClass);
+
+        // Frees cached buffers, largest first, until at most 'limit' bytes remain.
+        void _trimTo(size_t limit);
+
+        const size_t _numFreeLists;
+        boost::scoped_array<FreeList> _freeLists;
+
+        // Counts buffers that are cached or about to be, so it may briefly exceed what the
+        // free lists hold.
+        AtomicUInt64 _retainedBytes;
+        AtomicUInt64 _maxRetainedBytes;
+        AtomicUInt64 _numHits;
+        AtomicUInt64 _numMisses;
+    };
+
+} // namespace mongo
@@ -0,0 +1,150 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/util/net/message_buffer_pool.h"
+
+#include <boost/thread/thread.hpp>
+
+#include "mongo/stdx/functional.h"
+#include "mongo/unittest/unittest.h"
+#include "mongo/util/net/message.h"
+
+namespace {
+
+    using mongo::MessageBufferPool;
+
+    TEST(MessageBufferPool, SizeClasses) {
+        ASSERT_EQUALS(1024U, MessageBufferPool::roundUpToSizeClass(0));
+        ASSERT_EQUALS(1024U, MessageBufferPool::roundUpToSizeClass(1024));
+        ASSERT_EQUALS(1280U, MessageBufferPool::roundUpToSizeClass(1025));
+        ASSERT_EQUALS(2048U, MessageBufferPool::roundUpToSizeClass(2048));
+        ASSERT_EQUALS(2560U, MessageBufferPool::roundUpToSizeClass(2049));
+        ASSERT_EQUALS(48U * 1024 * 1024,
+                      MessageBufferPool::roundUpToSizeClass(mongo::MaxMessageSizeBytes));
+
+        // No size class wastes more than a quarter of its buffer.
+        for (size_t size = 1025; size < 1024 * 1024; size += 4097) {
+            const size_t capacity = MessageBufferPool::roundUpToSizeClass(size);
+            ASSERT_GREATER_THAN_OR_EQUALS(capacity, size);
+            ASSERT_LESS_THAN_OR_EQUALS(capacity - size, capacity / 4);
+        }
+    }
+
+    TEST(MessageBufferPool, ReleasedBufferIsReused) {
+        MessageBufferPool pool(1024 * 1024);
+
+        size_t capacity;
+        char* buf = pool.allocate(100 * 1024, &capacity);
+        ASSERT_GREATER_THAN_OR_EQUALS(capacity, 100U * 1024);
+        pool.release(buf, capacity);
+        ASSERT_EQUALS(capacity, pool.getRetainedBytes());
+
+        // Any size in the same class gets the cached buffer back.
+        size_t again;
+        char* reused = pool.allocate(capacity - 10, &again);
+        ASSERT_EQUALS(buf, reused);
+        ASSERT_EQUALS(capacity, again);
+        ASSERT_EQUALS(1U, pool.getNumHits());
+        ASSERT_EQUALS(1U, pool.getNumMisses());
+        ASSERT_EQUALS(0U, pool.getRetainedBytes());
+
+        pool.release(reused, again);
+    }
+
+    TEST(MessageBufferPool, RetainedBytesAreBounded) {
+        MessageBufferPool pool(4096);
+
+        size_t capacity;
+        char* first = pool.allocate(4096, &capacity);
+        char* second = pool.allocate(4096, &capacity);
+        pool.release(first, capacity);
+        pool.release(second, capacity);
+        ASSERT_EQUALS(4096U, pool.getRetainedBytes());
+
+        pool.setMaxRetainedBytes(0);
+        ASSERT_EQUALS(0U, pool.getRetainedBytes());
+    }
+
+    TEST(MessageBufferPool, OversizedBuffersAreNotCached) {
+        MessageBufferPool pool(1024 * 1024 * 1024);
+
+        size_t capacity;
+        char* buf = pool.allocate(MessageBufferPool::kMaxPooledBufferSize + 1, &capacity);
+        pool.release(buf, capacity);
+        ASSERT_EQUALS(0U, pool.getRetainedBytes());
+    }
+
+    // Allocates and releases buffers of a size that depends on 'seed'.
+    void churn(MessageBufferPool* pool, size_t seed) {
+        for (size_t i = 0; i < 10000; ++i) {
+            size_t capacity;
+            char* buf = pool->allocate(1024 * (1 + (seed + i) % 16), &capacity);
+            buf[0] = 1;
+            pool->release(buf, capacity);
+        }
+    }
+
+    TEST(MessageBufferPool, ConcurrentUse) {
+        MessageBufferPool pool(64 * 1024);
+
+        boost::thread_group threads;
+        for (size_t i = 0; i < 8; ++i) {
+            threads.create_thread(mongo::stdx::bind(&churn, &pool, i));
+        }
+        threads.join_all();
+
+        ASSERT_EQUALS(80000U, pool.getNumHits() + pool.getNumMisses());
+        ASSERT_LESS_THAN_OR_EQUALS(pool.getRetainedBytes(), 64U * 1024);
+        pool.clear();
+        ASSERT_EQUALS(0U, pool.getRetainedBytes());
+    }
+
+    TEST(MessageBufferPool, GlobalPoolRetainsNothingByDefault) {
+        MessageBufferPool& pool = MessageBufferPool::global();
+
+        size_t capacity;
+        char* buf = pool.allocate(8192, &capacity);
+        pool.release(buf, capacity);
+        ASSERT_EQUALS(0U, pool.getRetainedBytes());
+    }
+
+    TEST(MessageBufferPool, MessageReturnsPooledBuffer) {
+        MessageBufferPool& pool = MessageBufferPool::global();
+        pool.setMaxRetainedBytes(1024 * 1024);
+
+        size_t capacity;
+        char* buf = pool.allocate(8192, &capacity);
+        mongo::MsgData::View(buf).setLen(8192);
+
+        mongo::Message first;
+        first.setPooledData(buf, capacity);
+
+        // Ownership of the pooled buffer moves along with the message.
+        mongo::Message second;
+        second = first;
+        ASSERT_EQUALS(0U, pool.getRetainedBytes());
+        first.reset();
+        ASSERT_EQUALS(0U, pool.getRetainedBytes());
+
+        second.reset();
+        ASSERT_EQUALS(capacity, pool.getRetainedBytes());
+
+        pool.setMaxRetainedBytes(0);
+        ASSERT_EQUALS(0U, pool.getRetainedBytes());
+    }
+
+} // namespace
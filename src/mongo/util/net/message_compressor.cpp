@@ -0,0 +1,243 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/util/net/message_compressor.h"
+
+#include <cstring>
+
+#ifdef MONGO_SNAPPY
+#include <snappy.h>
+#endif
+#ifdef MONGO_ZLIB
+#include <zlib.h>
+#endif
+
+#include "mongo/base/data_view.h"
+#include "mongo/util/assert_util.h"
+#include "mongo/util/mongoutils/str.h"
+#include "mongo/util/net/message.h"
+#include "mongo/util/net/message_buffer_pool.h"
+#include "mongo/util/scopeguard.h"
+
+namespace mongo {
+
+    namespace {
+
+        const size_t kHeaderSize = sizeof(MSGHEADER::Value);
+
+#ifdef MONGO_SNAPPY
+        class SnappyMessageCompressor : public MessageCompressor {
+        public:
+            SnappyMessageCompressor() : MessageCompressor("snappy", 1) {}
+
+            virtual size_t getMaxCompressedSize(size_t inputSize) const {
+                return snappy::MaxCompressedLength(inputSize);
+            }
+
+            virtual size_t compress(const char* input, size_t inputSize,
+                                    char* output, size_t outputCapacity) const {
+                size_t compressedSize;
+                snappy::RawCompress(input, inputSize, output, &compressedSize);
+                return compressedSize;
+            }
+
+            virtual bool decompress(const char* input, size_t inputSize,
+                                    char* output, size_t outputSize) const {
+                size_t expandedSize;
+                if (!snappy::GetUncompressedLength(input, inputSize, &expandedSize) ||
+                    expandedSize != outputSize) {
+                    return false;
+                }
+                return snappy::RawUncompress(input, inputSize, output);
+            }
+        };
+#endif // MONGO_SNAPPY
+
+#ifdef MONGO_ZLIB
+        class ZlibMessageCompressor : public MessageCompressor {
+        public:
+            ZlibMessageCompressor() : MessageCompressor("zlib", 2) {}
+
+            virtual size_t getMaxCompressedSize(size_t inputSize) const {
+                return ::compressBound(inputSize);
+            }
+
+            virtual size_t compress(const char* input, size_t inputSize,
+                                    char* output, size_t outputCapacity) const {
+                uLongf compressedSize = outputCapacity;
+                const int rc = ::compress2(reinterpret_cast<Bytef*>(output), &compressedSize,
+                                           reinterpret_cast<const Bytef*>(input), inputSize,
+                                           Z_DEFAULT_COMPRESSION);
+                uassert(18741, str::stream() << "zlib compression failed with error " << rc,
+                        rc == Z_OK);
+                return compressedSize;
+            }
+
+            virtual bool decompress(const char* input, size_t inputSize,
+                                    char* output, size_t outputSize) const {
+                uLongf expandedSize = outputSize;
+                const int rc = ::uncompress(reinterpret_cast<Bytef*>(output), &expandedSize,
+                                            reinterpret_cast<const Bytef*>(input), inputSize);
+                return rc == Z_OK && expandedSize == outputSize;
+            }
+        };
+#endif // MONGO_ZLIB
+
+        // The codecs of this build, most preferred first: snappy is much cheaper than zlib for
+        // a similar ratio on BSON. Empty unless built with at least one of them.
+        std::vector<const MessageCompressor*> builtInCompressors() {
+            std::vector<const MessageCompressor*> all;
+#ifdef MONGO_SNAPPY
+            static const SnappyMessageCompressor snappyCompressor;
+            all.push_back(&snappyCompressor);
+#endif
+#ifdef MONGO_ZLIB
+            static const ZlibMessageCompressor zlibCompressor;
+            all.push_back(&zlibCompressor);
+#endif
+            return all;
+        }
+
+        // The built-in codecs followed by those added with registerCompressor().
+        std::vector<const MessageCompressor*>& compressors() {
+            static std::vector<const MessageCompressor*> all = builtInCompressors();
+            return all;
+        }
+
+        // Builds the list before any threads are started.
+        const std::vector<const MessageCompressor*>& initCompressors = compressors();
+
+        void releaseMessageBuffer(char* buf, size_t capacity) {
+            MessageBufferPool::global().release(buf, capacity);
+        }
+
+    } // namespace
+
+    const MessageCompressor* MessageCompressor::forName(const StringData& name) {
+        for (size_t i = 0; i < compressors().size(); ++i) {
+            if (compressors()[i]->getName() == name)
+                return compressors()[i];
+        }
+        return NULL;
+    }
+
+    const MessageCompressor* MessageCompressor::forId(uint8_t id) {
+        for (size_t i = 0; i < compressors().size(); ++i) {
+            if (compressors()[i]->getId() == id)
+                return compressors()[i];
+        }
+        return NULL;
+    }
+
+    void MessageCompressor::registerCompressor(const MessageCompressor* compressor) {
+        verify(!forName(compressor->getName()) && !forId(compressor->getId()));
+        compressors().push_back(compressor);
+    }
+
+    std::vector<std::string> MessageCompressor::getSupportedNames() {
+        std::vector<std::string> names;
+        for (size_t i = 0; i < compressors().size(); ++i) {
+            names.push_back(compressors()[i]->getName());
+        }
+        return names;
+    }
+
+    bool MessageCompressor::compressMessage(const Message& message,
+                                            const MessageCompressor& compressor,
+                                            std::vector<char>* scratch,
+                                            std::vector<char>* output) {
+        const size_t messageSize = message.size();
+        const size_t bodySize = messageSize - kHeaderSize;
+
+        const char* body;
+        if (message.isMultiBuffer()) {
+            if (scratch->size() < messageSize)
+                scratch->resize(messageSize);
+            message.copyTo(&(*scratch)[0]);
+            body = &(*scratch)[kHeaderSize];
+        }
+        else {
+            body = message.singleData().data();
+        }
+
+        const size_t maxCompressedSize = compressor.getMaxCompressedSize(bodySize);
+        if (output->size() < kHeaderSize + kEnvelopeSize + maxCompressedSize)
+            output->resize(kHeaderSize + kEnvelopeSize + maxCompressedSize);
+
+        MsgData::View envelope(&(*output)[0]);
+        const size_t compressedSize = compressor.compress(
+            body, bodySize, envelope.data() + kEnvelopeSize, maxCompressedSize);
+
+        const size_t envelopeSize = kHeaderSize + kEnvelopeSize + compressedSize;
+        if (envelopeSize >= messageSize)
+            return false;
+
+        const MsgData::View original = message.header();
+        envelope.setLen(envelopeSize);
+        envelope.setId(original.getId());
+        envelope.setResponseTo(original.getResponseTo());
+        envelope.setOperation(dbCompressed);
+
+        DataView(envelope.data())
+            .writeLE<int32_t>(original.getOperation(), 0)
+            .writeLE<int32_t>(bodySize, 4)
+            .writeLE<uint8_t>(compressor.getId(), 8);
+        return true;
+    }
+
+    void MessageCompressor::decompressMessage(Message* message) {
+        const MsgData::View envelope = message->singleData();
+        verify(envelope.getOperation() == dbCompressed);
+        uassert(18742, "compressed message is too short",
+                static_cast<size_t>(envelope.getLen()) >= kHeaderSize + kEnvelopeSize);
+
+        const ConstDataView fields(envelope.data());
+        const int32_t operation = fields.readLE<int32_t>(0);
+        const int32_t bodySize = fields.readLE<int32_t>(4);
+        const uint8_t compressorId = fields.readLE<uint8_t>(8);
+
+        uassert(18743, str::stream() << "invalid uncompressed message size " << bodySize,
+                bodySize >= 0 &&
+                static_cast<size_t>(bodySize) <= MaxMessageSizeBytes - kHeaderSize);
+
+        const MessageCompressor* compressor = forId(compressorId);
+        uassert(18744, str::stream() << "message compressed with unknown compressor id "
+                                     << static_cast<int>(compressorId),
+                compressor);
+
+        size_t capacity;
+        MsgData::View expanded = MessageBufferPool::global().allocate(kHeaderSize + bodySize,
+                                                                      &capacity);
+        ScopeGuard guard = MakeGuard(releaseMessageBuffer, expanded.view2ptr(), capacity);
+
+        uassert(18745, str::stream() << "failed to decompress message with "
+                                     << compressor->getName(),
+                compressor->decompress(envelope.data() + kEnvelopeSize,
+                                       envelope.getLen() - kHeaderSize - kEnvelopeSize,
+                                       expanded.data(), bodySize));
+
+        expanded.setLen(kHeaderSize + bodySize);
+        expanded.setId(envelope.getId());
+        expanded.setResponseTo(envelope.getResponseTo());
+        expanded.setOperation(operation);
+
+        guard.Dismiss();
+        message->reset();
+        message->setPooledData(expanded.view2ptr(), capacity);
+    }
+
+} // namespace mongo
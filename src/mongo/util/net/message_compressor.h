@@ -0,0 +1,125 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "mongo/base/string_data.h"
+#include "mongo/client/export_macros.h"
+#include "mongo/platform/cstdint.h"
+
+namespace mongo {
+
+    class Message;
+
+    /**
+     * A codec for wire protocol compression.
+     *
+     * A compressed message is sent as an OP_COMPRESSED envelope: the standard header, with the
+     * requestID and responseTo of the original message, followed by
+     *
+     *   int32 originalOpcode
+     *   int32 uncompressedSize   // of the original message, not counting its header
+     *   uint8 compressorId
+     *   ...                      // the original message body, compressed
+     *
+     * Which codec to use is negotiated when connecting: the client lists the ones it wants in
+     * the "compression" field of its isMaster and the server answers with those it accepts.
+     * Either side may then compress any message it sends, and MessagingPort::recv() expands
+     * OP_COMPRESSED messages of any codec it knows, so compression is transparent above it.
+     *
+     * The codecs available depend on the build: see the --use-snappy and --use-zlib options.
+     * Codecs are stateless and shared; all methods are thread-safe.
+     */
+    class MONGO_CLIENT_API MessageCompressor : private boost::noncopyable {
+    public:
+        // Size of the envelope fields that follow the standard header.
+        static const size_t kEnvelopeSize = 9;
+
+        virtual ~MessageCompressor() {}
+
+        /** The name used in isMaster: "snappy" or "zlib". */
+        const std::string& getName() const { return _name; }
+
+        /** The id stored in the envelope. */
+        uint8_t getId() const { return _id; }
+
+        /** An upper bound on the compressed size of 'inputSize' bytes. */
+        virtual size_t getMaxCompressedSize(size_t inputSize) const = 0;
+
+        /**
+         * Compresses 'inputSize' bytes at 'input' into 'output', which must hold at least
+         * getMaxCompressedSize(inputSize) bytes. Returns the compressed size.
+         */
+        virtual size_t compress(const char* input, size_t inputSize,
+                                char* output, size_t outputCapacity) const = 0;
+
+        /**
+         * Expands 'inputSize' bytes at 'input' into exactly 'outputSize' bytes at 'output'.
+         * Returns false if the input is corrupt or doesn't expand to 'outputSize' bytes.
+         */
+        virtual bool decompress(const char* input, size_t inputSize,
+                                char* output, size_t outputSize) const = 0;
+
+        /** The codec called 'name', or NULL if this build doesn't have it. */
+        static const MessageCompressor* forName(const StringData& name);
+
+        /** The codec with id 'id', or NULL if this build doesn't have it. */
+        static const MessageCompressor* forId(uint8_t id);
+
+        /** The names of the codecs in this build, most preferred first. */
+        static std::vector<std::string> getSupportedNames();
+
+        /**
+         * Adds 'compressor', which must outlive every use of it, as the least preferred codec.
+         * Meant for tests: it must be called before any other thread uses compression.
+         */
+        static void registerCompressor(const MessageCompressor* compressor);
+
+        /**
+         * Writes the OP_COMPRESSED form of 'message', whose header must be complete, into
+         * 'output'. 'scratch' is only used to join the buffers of a multi-buffer message. Both
+         * vectors only ever grow, so a caller reusing them allocates only for its largest
+         * message. Returns false, leaving 'output' unspecified, if compression would not make
+         * the message smaller.
+         */
+        static bool compressMessage(const Message& message,
+                                    const MessageCompressor& compressor,
+                                    std::vector<char>* scratch,
+                                    std::vector<char>* output);
+
+        /**
+         * Replaces the OP_COMPRESSED 'message' by the message it holds, which keeps the header
+         * fields of the envelope. The expanded message is held in a buffer from the global
+         * MessageBufferPool.
+         *
+         * @throws UserException if the envelope is malformed, names an unknown codec or
+         *  doesn't expand to the size it claims.
+         */
+        static void decompressMessage(Message* message);
+
+    protected:
+        MessageCompressor(const std::string& name, uint8_t id) : _name(name), _id(id) {}
+
+    private:
+        const std::string _name;
+        const uint8_t _id;
+    };
+
+} // namespace mongo
@@ -0,0 +1,365 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/util/net/message_compressor.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "mongo/client/dbclientcursor.h"
+#include "mongo/client/dbclientinterface.h"
+#include "mongo/dbtests/mock/mock_wire_server.h"
+#include "mongo/platform/random.h"
+#include "mongo/unittest/unittest.h"
+#include "mongo/util/net/message.h"
+
+namespace {
+
+    using mongo::BSONObj;
+    using mongo::DBClientConnection;
+    using mongo::Message;
+    using mongo::MessageCompressor;
+    using mongo::MockWireServer;
+    using mongo::MsgData::View;
+
+    const size_t kHeaderSize = sizeof(mongo::MSGHEADER::Value);
+
+    // A message with the given body, as it would leave MessagingPort::say().
+    void makeMessage(const std::string& body, Message* message) {
+        message->setData(mongo::dbInsert, body.data(), body.size());
+        message->header().setId(42);
+        message->header().setResponseTo(7);
+    }
+
+    // What the receiving end reads off the wire.
+    void receive(const std::vector<char>& envelope, Message* message) {
+        const size_t len = View(const_cast<char*>(&envelope[0])).getLen();
+        char* buf = static_cast<char*>(std::malloc(len));
+        std::memcpy(buf, &envelope[0], len);
+        message->setData(buf, true);
+    }
+
+    // A small LZ77 codec, so the envelope and negotiation run without snappy or zlib. Literal
+    // runs are a 0 tag, a uint16 length and the bytes; matches a 1 tag, a uint32 distance and a
+    // uint32 length.
+    class TestMessageCompressor : public MessageCompressor {
+    public:
+        TestMessageCompressor() : MessageCompressor("test", 250) {}
+
+        virtual size_t getMaxCompressedSize(size_t inputSize) const {
+            return inputSize + 3 * (inputSize / kMinMatch + 2);
+        }
+
+        virtual size_t compress(const char* input, size_t inputSize,
+                                char* output, size_t outputCapacity) const {
+            std::vector<size_t> lastSeen(kHashSize, inputSize);
+            char* out = output;
+            size_t literalStart = 0;
+            size_t pos = 0;
+            while (pos + kMinMatch <= inputSize) {
+                uint32_t key;
+                std::memcpy(&key, input + pos, sizeof(key));
+                const size_t slot = (key * 2654435761U) >> 20 & (kHashSize - 1);
+                const size_t candidate = lastSeen[slot];
+                lastSeen[slot] = pos;
+
+                size_t length = 0;
+                if (candidate < pos) {
+                    while (pos + length < inputSize
+                           && input[candidate + length] == input[pos + length])
+                        ++length;
+                }
+                if (length < kMinMatch) {
+                    ++pos;
+                    continue;
+                }
+
+                out = putLiterals(input + literalStart, pos - literalStart, out);
+                const uint32_t match[2] = { static_cast<uint32_t>(pos - candidate),
+                                            static_cast<uint32_t>(length) };
+                *out++ = 1;
+                std::memcpy(out, match, sizeof(match));
+                out += sizeof(match);
+                pos += length;
+                literalStart = pos;
+            }
+            out = putLiterals(input + literalStart, inputSize - literalStart, out);
+            verify(static_cast<size_t>(out - output) <= outputCapacity);
+            return out - output;
+        }
+
+        virtual bool decompress(const char* input, size_t inputSize,
+                                char* output, size_t outputSize) const {
+            const char* const end = input + inputSize;
+            size_t written = 0;
+            while (input < end) {
+                const char tag = *input++;
+                if (tag == 0 && end - input >= 2) {
+                    uint16_t length;
+                    std::memcpy(&length, input, sizeof(length));
+                    input += sizeof(length);
+                    if (length > end - input || length > outputSize - written)
+                        return false;
+                    std::memcpy(output + written, input, length);
+                    input += length;
+                    written += length;
+                }
+                else if (tag == 1 && end - input >= 8) {
+                    uint32_t match[2];
+                    std::memcpy(match, input, sizeof(match));
+                    input += sizeof(match);
+                    if (match[0] == 0 || match[0] > written || match[1] > outputSize - written)
+                        return false;
+                    for (uint32_t i = 0; i < match[1]; ++i, ++written)
+                        output[written] = output[written - match[0]];
+                }
+                else {
+                    return false;
+                }
+            }
+            return written == outputSize;
+        }
+
+    private:
+        static const size_t kMinMatch = 12;
+        static const size_t kHashSize = 4096;
+
+        static char* putLiterals(const char* literals, size_t count, char* out) {
+            while (count > 0) {
+                const uint16_t length = static_cast<uint16_t>(std::min<size_t>(count, 0xffff));
+                *out++ = 0;
+                std::memcpy(out, &length, sizeof(length));
+                out += sizeof(length);
+                std::memcpy(out, literals, length);
+                out += length;
+                literals += length;
+                count -= length;
+            }
+            return out;
+        }
+    };
+
+    // Registered by this test only, after the codecs of the build.
+    const TestMessageCompressor testCompressor;
+    const bool testCompressorRegistered =
+        (MessageCompressor::registerCompressor(&testCompressor), true);
+
+    std::string compressibleBody() {
+        std::string body;
+        for (int i = 0; i < 1000; ++i) {
+            body += "{ _id: ..., name: 'some repetitive content' }";
+        }
+        return body;
+    }
+
+    TEST(MessageCompressor, LookupByNameAndId) {
+        const std::vector<std::string> names = MessageCompressor::getSupportedNames();
+        ASSERT_EQUALS("test", names.back());
+        for (size_t i = 0; i < names.size(); ++i) {
+            const MessageCompressor* compressor = MessageCompressor::forName(names[i]);
+            ASSERT(compressor);
+            ASSERT_EQUALS(compressor, MessageCompressor::forId(compressor->getId()));
+        }
+        ASSERT(!MessageCompressor::forName("lzma"));
+        ASSERT(!MessageCompressor::forId(200));
+    }
+
+    TEST(MessageCompressor, RoundTrip) {
+        const std::string body = compressibleBody();
+        const std::vector<std::string> names = MessageCompressor::getSupportedNames();
+
+        for (size_t i = 0; i < names.size(); ++i) {
+            const MessageCompressor& compressor = *MessageCompressor::forName(names[i]);
+
+            Message original;
+            makeMessage(body, &original);
+
+            std::vector<char> scratch;
+            std::vector<char> envelope;
+            ASSERT_TRUE(MessageCompressor::compressMessage(original, compressor,
+                                                           &scratch, &envelope));
+            ASSERT_TRUE(scratch.empty());
+
+            Message received;
+            receive(envelope, &received);
+            ASSERT_EQUALS(mongo::dbCompressed, received.operation());
+            ASSERT_LESS_THAN(received.size(), original.size() / 4);
+
+            MessageCompressor::decompressMessage(&received);
+            ASSERT_EQUALS(mongo::dbInsert, received.operation());
+            ASSERT_EQUALS(42U, received.header().getId());
+            ASSERT_EQUALS(7U, received.header().getResponseTo());
+            ASSERT_EQUALS(original.size(), received.size());
+            ASSERT_EQUALS(body, std::string(received.singleData().data(), body.size()));
+        }
+    }
+
+    TEST(MessageCompressor, RoundTripOfMultiBufferMessage) {
+        const std::string body = compressibleBody();
+        const std::vector<std::string> names = MessageCompressor::getSupportedNames();
+
+        for (size_t i = 0; i < names.size(); ++i) {
+            const MessageCompressor& compressor = *MessageCompressor::forName(names[i]);
+
+            // The header in one buffer, the body split across two more.
+            std::vector<char> header(kHeaderSize);
+            std::string first = body.substr(0, 100);
+            std::string second = body.substr(100);
+
+            Message original;
+            original.appendBorrowedData(&header[0], header.size());
+            original.appendBorrowedData(&first[0], first.size());
+            original.appendBorrowedData(&second[0], second.size());
+            original.header().setOperation(mongo::dbInsert);
+            original.header().setId(42);
+
+            std::vector<char> scratch;
+            std::vector<char> envelope;
+            ASSERT_TRUE(MessageCompressor::compressMessage(original, compressor,
+                                                           &scratch, &envelope));
+
+            Message received;
+            receive(envelope, &received);
+            MessageCompressor::decompressMessage(&received);
+            ASSERT_EQUALS(mongo::dbInsert, received.operation());
+            ASSERT_EQUALS(body, std::string(received.singleData().data(), body.size()));
+        }
+    }
+
+    TEST(MessageCompressor, IncompressibleMessageIsNotCompressed) {
+        mongo::PseudoRandom random(1234);
+        std::string body;
+        for (int i = 0; i < 4096; ++i) {
+            body += static_cast<char>(random.nextInt32());
+        }
+
+        const std::vector<std::string> names = MessageCompressor::getSupportedNames();
+        for (size_t i = 0; i < names.size(); ++i) {
+            Message original;
+            makeMessage(body, &original);
+
+            std::vector<char> scratch;
+            std::vector<char> envelope;
+            ASSERT_FALSE(MessageCompressor::compressMessage(
+                original, *MessageCompressor::forName(names[i]), &scratch, &envelope));
+        }
+    }
+
+    TEST(MessageCompressor, CorruptMessagesAreRejected) {
+        const std::vector<std::string> names = MessageCompressor::getSupportedNames();
+        ASSERT_FALSE(names.empty());
+
+        Message original;
+        makeMessage(compressibleBody(), &original);
+
+        std::vector<char> scratch;
+        std::vector<char> envelope;
+        ASSERT_TRUE(MessageCompressor::compressMessage(
+            original, *MessageCompressor::forName(names[0]), &scratch, &envelope));
+
+        // An unknown compressor id.
+        std::vector<char> unknownId(envelope);
+        unknownId[kHeaderSize + 8] = static_cast<char>(200);
+        Message received;
+        receive(unknownId, &received);
+        ASSERT_THROWS(MessageCompressor::decompressMessage(&received), mongo::UserException);
+
+        // A size that doesn't match the data.
+        std::vector<char> wrongSize(envelope);
+        wrongSize[kHeaderSize + 4] ^= 1;
+        received.reset();
+        receive(wrongSize, &received);
+        ASSERT_THROWS(MessageCompressor::decompressMessage(&received), mongo::UserException);
+
+        // Garbage instead of compressed data.
+        std::vector<char> garbage(envelope);
+        std::memset(&garbage[kHeaderSize + MessageCompressor::kEnvelopeSize], 0xff,
+                    View(&garbage[0]).getLen() - kHeaderSize - MessageCompressor::kEnvelopeSize);
+        received.reset();
+        receive(garbage, &received);
+        ASSERT_THROWS(MessageCompressor::decompressMessage(&received), mongo::UserException);
+    }
+
+    class CompressedConnectionTest : public mongo::unittest::Test {
+    protected:
+        void connect(DBClientConnection* conn, bool compress) {
+            if (compress)
+                conn->setCompressors(MessageCompressor::getSupportedNames());
+            std::string errmsg;
+            ASSERT_TRUE(conn->connect(_server.getHostAndPort(), errmsg));
+        }
+
+        // Inserts compressible documents and returns how many bytes the server received.
+        long long insertDocuments(DBClientConnection* conn, const std::string& ns) {
+            const long long before = _server.getBytesReceived();
+            for (int i = 0; i < 20; ++i) {
+                conn->insert(ns, BSON("_id" << i << "text" << compressibleBody()));
+            }
+            return _server.getBytesReceived() - before;
+        }
+
+        MockWireServer _server;
+    };
+
+    TEST_F(CompressedConnectionTest, NegotiatesAndCompressesBothWays) {
+        const std::vector<std::string> names = MessageCompressor::getSupportedNames();
+        ASSERT_FALSE(names.empty());
+
+        DBClientConnection plain;
+        connect(&plain, false);
+        ASSERT_EQUALS("", plain.getCompressor());
+
+        DBClientConnection compressed;
+        connect(&compressed, true);
+        ASSERT_EQUALS(names[0], compressed.getCompressor());
+
+        const long long plainBytes = insertDocuments(&plain, "test.plain");
+        const long long compressedBytes = insertDocuments(&compressed, "test.foo");
+        ASSERT_LESS_THAN(compressedBytes, plainBytes / 4);
+
+        // Replies, from the server's compressed end, come back intact.
+        std::auto_ptr<mongo::DBClientCursor> cursor = compressed.query("test.foo");
+        int count = 0;
+        while (cursor->more()) {
+            const BSONObj doc = cursor->next();
+            ASSERT_EQUALS(compressibleBody(), doc["text"].str());
+            ++count;
+        }
+        ASSERT_EQUALS(20, count);
+    }
+
+    TEST_F(CompressedConnectionTest, ServerWithoutCompression) {
+        _server.setCompressionEnabled(false);
+
+        DBClientConnection conn;
+        connect(&conn, true);
+        ASSERT_EQUALS("", conn.getCompressor());
+
+        conn.insert("test.foo", BSON("_id" << 1));
+        ASSERT_EQUALS(1U, conn.count("test.foo"));
+    }
+
+    TEST(CompressedConnection, UnknownCompressorIsRejected) {
+        DBClientConnection conn;
+        ASSERT_THROWS(conn.setCompressors(std::vector<std::string>(1, "lzma")),
+                      mongo::UserException);
+    }
+
+} // namespace
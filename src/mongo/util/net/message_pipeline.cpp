@@ -0,0 +1,202 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kNetworking
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/util/net/message_pipeline.h"
+
+#include "mongo/util/assert_util.h"
+#include "mongo/util/log.h"
+#include "mongo/util/net/message_port.h"
+
+namespace mongo {
+
+    MSGID MessagePipeline::PendingReply::getRequestId() const {
+        verify(_slot);
+        return _slot->id;
+    }
+
+    bool MessagePipeline::PendingReply::ready() const {
+        verify(_pipeline);
+        boost::lock_guard<boost::mutex> lk(_pipeline->_mutex);
+        return _slot->done;
+    }
+
+    bool MessagePipeline::PendingReply::get(Message& response) {
+        verify(_pipeline);
+        boost::unique_lock<boost::mutex> lk(_pipeline->_mutex);
+        uassert(18715, "reply to a pipelined request may only be retrieved once", !_slot->taken);
+
+        try {
+            if (!_pipeline->_waitFor_inlock(lk, _slot.get()))
+                return false;
+        }
+        catch (const SocketException&) {
+            // The pipeline has failed, as for any other receive failure.
+            return false;
+        }
+
+        _slot->taken = true;
+        response.reset();
+        response = _slot->reply;
+        return true;
+    }
+
+    MessagePipeline::MessagePipeline(MessagingPort* port, size_t maxInFlight)
+        : _port(port)
+        , _maxInFlight(maxInFlight)
+        , _numInFlight(0)
+        , _reading(false)
+        , _failed(false) {
+        verify(_maxInFlight > 0);
+    }
+
+    MessagePipeline::~MessagePipeline() {
+        DESTRUCTOR_GUARD(
+            boost::unique_lock<boost::mutex> lk(_mutex);
+            while (_numInFlight > 0 && !_failed) {
+                if (_reading) {
+                    _progress.wait(lk);
+                    continue;
+                }
+                _readOne_inlock(lk);
+            }
+        );
+    }
+
+    MessagePipeline::PendingReply MessagePipeline::submit(Message& toSend) {
+        uassert(18716, str::stream() << "can't pipeline " << opToString(toSend.operation())
+                                     << " messages, they get no response",
+                doesOpGetAResponse(toSend.operation()));
+
+        boost::shared_ptr<Slot> slot(new Slot);
+        {
+            boost::unique_lock<boost::mutex> lk(_mutex);
+            while (_numInFlight >= _maxInFlight && !_failed) {
+                if (_reading) {
+                    _progress.wait(lk);
+                    continue;
+                }
+                _readOne_inlock(lk);
+            }
+            uassert(18717, "can't submit to a failed message pipeline", !_failed);
+
+            // Reserve our place in the window before sending so concurrent submitters see it.
+            ++_numInFlight;
+        }
+
+        try {
+            boost::lock_guard<boost::mutex> sendLock(_sendMutex);
+            _port->say(toSend);
+        }
+        catch (...) {
+            boost::lock_guard<boost::mutex> lk(_mutex);
+            --_numInFlight;
+            _fail_inlock();
+            throw;
+        }
+
+        slot->id = toSend.header().getId();
+
+        boost::lock_guard<boost::mutex> lk(_mutex);
+
+        // Another thread may already have read our reply while we were registering.
+        std::map<MSGID, boost::shared_ptr<Message> >::iterator early = _unclaimed.find(slot->id);
+        if (early != _unclaimed.end()) {
+            slot->reply = *early->second;
+            slot->done = true;
+            _unclaimed.erase(early);
+        }
+        else {
+            _inFlight[slot->id] = slot;
+        }
+
+        return PendingReply(this, slot);
+    }
+
+    size_t MessagePipeline::numInFlight() const {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        return _numInFlight;
+    }
+
+    bool MessagePipeline::isFailed() const {
+        boost::lock_guard<boost::mutex> lk(_mutex);
+        return _failed;
+    }
+
+    bool MessagePipeline::_waitFor_inlock(boost::unique_lock<boost::mutex>& lk, Slot* slot) {
+        while (!slot->done && !_failed) {
+            if (_reading) {
+                _progress.wait(lk);
+                continue;
+            }
+            _readOne_inlock(lk);
+        }
+        return slot->done;
+    }
+
+    void MessagePipeline::_readOne_inlock(boost::unique_lock<boost::mutex>& lk) {
+        verify(!_reading);
+        _reading = true;
+        lk.unlock();
+
+        boost::shared_ptr<Message> reply(new Message);
+        bool ok = false;
+        try {
+            ok = _port->recv(*reply);
+        }
+        catch (...) {
+            lk.lock();
+            _reading = false;
+            _fail_inlock();
+            throw;
+        }
+
+        lk.lock();
+        _reading = false;
+
+        if (!ok) {
+            _fail_inlock();
+            return;
+        }
+
+        const MSGID responseTo = reply->header().getResponseTo();
+        --_numInFlight;
+
+        SlotMap::iterator it = _inFlight.find(responseTo);
+        if (it != _inFlight.end()) {
+            it->second->reply = *reply;
+            it->second->done = true;
+            _inFlight.erase(it);
+        }
+        else {
+            _unclaimed[responseTo] = reply;
+        }
+
+        _progress.notify_all();
+    }
+
+    void MessagePipeline::_fail_inlock() {
+        if (!_failed) {
+            LOG(1) << "message pipeline failed with " << _numInFlight << " requests in flight"
+                   << std::endl;
+        }
+        _failed = true;
+        _progress.notify_all();
+    }
+
+} // namespace mongo
@@ -0,0 +1,153 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <map>
+
+#include "mongo/client/export_macros.h"
+#include "mongo/util/net/message.h"
+
+namespace mongo {
+
+    class MessagingPort;
+
+    /**
+     * Keeps several request/reply exchanges in flight on a single MessagingPort.
+     *
+     * MessagingPort::call() sends one message and blocks until its reply arrives, so a
+     * connection carries one request per round trip. A MessagePipeline instead lets callers
+     * submit() any number of messages that expect a reply (OP_QUERY, OP_GET_MORE) and later
+     * collect each reply through the returned PendingReply. Replies are matched to requests by
+     * their responseTo field, so they may be collected in any order and from any thread.
+     *
+     * There is no background thread: whichever caller is waiting for a reply reads from the
+     * socket on behalf of everyone and hands replies belonging to other requests to their
+     * owners.
+     *
+     * At most 'maxInFlight' requests are outstanding at once; submit() reads replies before
+     * sending once the window is full. This keeps the unread data on both ends of the socket
+     * bounded, so the server never blocks writing replies while we block writing requests.
+     *
+     * While a pipeline is attached to a port, all traffic on that port that expects a reply must
+     * go through the pipeline. Fire-and-forget messages may still be sent with
+     * MessagingPort::say().
+     */
+    class MONGO_CLIENT_API MessagePipeline : private boost::noncopyable {
+    private:
+        struct Slot;
+
+    public:
+        static const size_t kDefaultMaxInFlight = 16;
+
+        /**
+         * Handle to the reply of a submitted request. Copies refer to the same reply. Handles
+         * must not be used after their pipeline is destroyed.
+         */
+        class MONGO_CLIENT_API PendingReply {
+        public:
+            PendingReply() : _pipeline(NULL) {}
+
+            /** The requestID assigned to the submitted message. */
+            MSGID getRequestId() const;
+
+            /** true if the reply has arrived, i.e. get() would not block. */
+            bool ready() const;
+
+            /**
+             * Blocks until the reply arrives and transfers it into 'response'. May be called only
+             * once per request. Returns false if the connection failed before the reply arrived,
+             * including by a SocketException while this thread was reading. Other exceptions
+             * from the port, such as a failed SSL handshake, propagate.
+             */
+            bool get(Message& response);
+
+        private:
+            friend class MessagePipeline;
+            PendingReply(MessagePipeline* pipeline, const boost::shared_ptr<Slot>& slot)
+                : _pipeline(pipeline), _slot(slot) {}
+
+            MessagePipeline* _pipeline;
+            boost::shared_ptr<Slot> _slot;
+        };
+
+        /** 'port' must outlive the pipeline. */
+        explicit MessagePipeline(MessagingPort* port, size_t maxInFlight = kDefaultMaxInFlight);
+
+        /** Reads and discards any replies still in flight, leaving the port usable. */
+        ~MessagePipeline();
+
+        /**
+         * Sends 'toSend', which must be an operation that gets a response, and returns a handle
+         * to its reply. Blocks only while the in-flight window is full.
+         *
+         * @throws SocketException if the message can't be sent.
+         */
+        PendingReply submit(Message& toSend);
+
+        /** Number of submitted requests whose replies have not been read off the socket yet. */
+        size_t numInFlight() const;
+
+        /** true once a receive has failed. All outstanding and future requests fail. */
+        bool isFailed() const;
+
+    private:
+        struct Slot {
+            Slot() : id(0), done(false), taken(false) {}
+
+            MSGID id;
+            bool done;
+            bool taken;
+            Message reply;
+        };
+
+        typedef std::map<MSGID, boost::shared_ptr<Slot> > SlotMap;
+
+        // Waits, reading from the port if no one else is, until 'slot' is done or the pipeline
+        // has failed. Returns true if 'slot' is done.
+        bool _waitFor_inlock(boost::unique_lock<boost::mutex>& lk, Slot* slot);
+
+        // Reads a single reply from the port and hands it to its slot. 'lk' must be held and
+        // no other thread may be reading; this sets _reading for the duration of the read and
+        // releases 'lk' meanwhile. Fails the pipeline and rethrows if the read throws.
+        void _readOne_inlock(boost::unique_lock<boost::mutex>& lk);
+
+        void _fail_inlock();
+
+        MessagingPort* const _port;
+        const size_t _maxInFlight;
+
+        // Serializes writes to the port. Never held together with _mutex.
+        boost::mutex _sendMutex;
+
+        mutable boost::mutex _mutex;
+        boost::condition_variable _progress;
+        SlotMap _inFlight;
+
+        // Replies that arrived before submit() registered their request.
+        std::map<MSGID, boost::shared_ptr<Message> > _unclaimed;
+
+        // Requests sent, or about to be sent, whose replies have not been read yet.
+        size_t _numInFlight;
+
+        bool _reading;
+        bool _failed;
+    };
+
+} // namespace mongo
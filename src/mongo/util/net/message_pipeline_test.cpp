@@ -0,0 +1,205 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/util/net/message_pipeline.h"
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <cstring>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/types.h>
+#endif
+
+#include "mongo/unittest/unittest.h"
+#include "mongo/util/net/message_port.h"
+
+namespace {
+
+    using namespace mongo;
+
+    typedef boost::shared_ptr<Socket> SocketPtr;
+
+    // The payload of a request and of its reply is a single int, so the tests can tell which
+    // reply answers which request regardless of message ids.
+    void makeRequest(int value, Message* toSend) {
+        toSend->setData(dbQuery, reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    int payloadOf(const Message& m) {
+        int value;
+        std::memcpy(&value, m.singleData().data(), sizeof(value));
+        return value;
+    }
+
+    // Reads 'count' requests, then answers them in reverse order echoing each payload.
+    void serveReversed(MessagingPort* server, int count) {
+        std::vector<MSGID> ids;
+        std::vector<int> payloads;
+        for (int i = 0; i < count; ++i) {
+            Message request;
+            if (!server->recv(request))
+                return;
+            ids.push_back(request.header().getId());
+            payloads.push_back(payloadOf(request));
+        }
+        for (int i = count - 1; i >= 0; --i) {
+            Message response;
+            response.setData(opReply,
+                             reinterpret_cast<const char*>(&payloads[i]),
+                             sizeof(payloads[i]));
+            server->say(response, ids[i]);
+        }
+    }
+
+    // Echoes each request as soon as it arrives, until the connection closes.
+    void serveEcho(MessagingPort* server) {
+        Message request;
+        while (server->recv(request)) {
+            Message response;
+            const int value = payloadOf(request);
+            response.setData(opReply, reinterpret_cast<const char*>(&value), sizeof(value));
+            server->reply(request, response);
+            request.reset();
+        }
+    }
+
+#ifndef _WIN32
+    class MessagePipelineTest : public unittest::Test {
+    protected:
+        void setUp() {
+            int socks[2];
+            ASSERT_EQUALS(0, ::socketpair(PF_UNIX, SOCK_STREAM, 0, socks));
+
+            SocketPtr clientSock(new Socket(socks[0], SockAddr()));
+            SocketPtr serverSock(new Socket(socks[1], SockAddr()));
+            clientSock->setHandshakeReceived();
+            serverSock->setHandshakeReceived();
+
+            _client.reset(new MessagingPort(clientSock));
+            _server.reset(new MessagingPort(serverSock));
+        }
+
+        void tearDown() {
+            _client.reset();
+            _server.reset();
+        }
+
+        boost::scoped_ptr<MessagingPort> _client;
+        boost::scoped_ptr<MessagingPort> _server;
+    };
+
+    TEST_F(MessagePipelineTest, RepliesAreMatchedByResponseTo) {
+        const int kRequests = 8;
+        boost::thread server(boost::bind(&serveReversed, _server.get(), kRequests));
+
+        MessagePipeline pipeline(_client.get(), kRequests);
+        std::vector<MessagePipeline::PendingReply> pending;
+        for (int i = 0; i < kRequests; ++i) {
+            Message toSend;
+            makeRequest(i, &toSend);
+            pending.push_back(pipeline.submit(toSend));
+        }
+        ASSERT_EQUALS(static_cast<size_t>(kRequests), pipeline.numInFlight());
+
+        for (int i = 0; i < kRequests; ++i) {
+            Message response;
+            ASSERT_TRUE(pending[i].get(response));
+            ASSERT_EQUALS(i, payloadOf(response));
+            ASSERT_EQUALS(pending[i].getRequestId(),
+                          static_cast<MSGID>(response.header().getResponseTo()));
+        }
+
+        server.join();
+        ASSERT_EQUALS(0U, pipeline.numInFlight());
+    }
+
+    TEST_F(MessagePipelineTest, WindowBoundsRequestsInFlight) {
+        boost::thread server(boost::bind(&serveEcho, _server.get()));
+
+        {
+            MessagePipeline pipeline(_client.get(), 2);
+            std::vector<MessagePipeline::PendingReply> pending;
+            for (int i = 0; i < 10; ++i) {
+                Message toSend;
+                makeRequest(i, &toSend);
+                pending.push_back(pipeline.submit(toSend));
+                ASSERT_LESS_THAN_OR_EQUALS(pipeline.numInFlight(), 2U);
+            }
+
+            for (int i = 9; i >= 0; --i) {
+                Message response;
+                ASSERT_TRUE(pending[i].get(response));
+                ASSERT_EQUALS(i, payloadOf(response));
+            }
+        }
+
+        _client->shutdown();
+        server.join();
+    }
+
+    TEST_F(MessagePipelineTest, DestructorDrainsOutstandingReplies) {
+        boost::thread server(boost::bind(&serveEcho, _server.get()));
+
+        {
+            MessagePipeline pipeline(_client.get());
+            for (int i = 0; i < 4; ++i) {
+                Message toSend;
+                makeRequest(i, &toSend);
+                pipeline.submit(toSend);
+            }
+        }
+
+        // The port must be back in lockstep for ordinary call() use.
+        Message toSend;
+        makeRequest(42, &toSend);
+        Message response;
+        ASSERT_TRUE(_client->call(toSend, response));
+        ASSERT_EQUALS(42, payloadOf(response));
+
+        _client->shutdown();
+        server.join();
+    }
+
+    TEST_F(MessagePipelineTest, ClosedConnectionFailsPendingReplies) {
+        MessagePipeline pipeline(_client.get());
+
+        Message toSend;
+        makeRequest(1, &toSend);
+        MessagePipeline::PendingReply pending = pipeline.submit(toSend);
+
+        _server->shutdown();
+
+        Message response;
+        ASSERT_FALSE(pending.get(response));
+        ASSERT_TRUE(pipeline.isFailed());
+    }
+
+    TEST_F(MessagePipelineTest, RejectsMessagesWithoutResponse) {
+        MessagePipeline pipeline(_client.get());
+
+        Message toSend;
+        const int value = 0;
+        toSend.setData(dbKillCursors, reinterpret_cast<const char*>(&value), sizeof(value));
+        ASSERT_THROWS(pipeline.submit(toSend), UserException);
+    }
+#endif
+
+} // namespace
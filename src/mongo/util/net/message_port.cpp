@@ -27,10 +27,13 @@
 #include <set>
 #include <time.h>
 
+#include "mongo/bson/bsonobj.h"
 #include "mongo/client/options.h"
 #include "mongo/util/background.h"
 #include "mongo/util/log.h"
 #include "mongo/util/net/message.h"
+#include "mongo/util/net/message_buffer_pool.h"
+#include "mongo/util/net/message_compressor.h"
 #include "mongo/util/net/ssl_manager.h"
 #include "mongo/util/scopeguard.h"
 #include "mongo/util/time_support.h"
@@ -55,6 +58,8 @@ namespace mongo {
 // if you want trace output:
 #define mmm(x)
 
+    const size_t MessagingPort::kDefaultPiggyBackBufferSize;
+
     void AbstractMessagingPort::setConnectionId( long long connectionId ) { 
         verify( _connectionId == 0 );
         _connectionId = connectionId; 
@@ -62,45 +67,100 @@ namespace mongo {
 
     /* messagingport -------------------------------------------------------------- */
 
+    namespace {
+        void releaseMessageBuffer(char* buf, size_t capacity) {
+            MessageBufferPool::global().release(buf, capacity);
+        }
+
+        // Commands of the handshake and of authentication are always sent uncompressed.
+        const char* const kUncompressedCommands[] = {
+            "ismaster", "isMaster", "saslStart", "saslContinue", "getnonce", "authenticate",
+            "createUser", "updateUser", "copydbSaslStart", "copydbgetnonce", "copydb"
+        };
+
+        bool mayCompress(const Message& m) {
+            if ( m.operation() != dbQuery || m.isMultiBuffer() )
+                return true;
+
+            // flags, then the namespace, skip, limit and the query itself
+            const char* ns = m.singleData().data() + sizeof(int32_t);
+            const StringData nsData(ns);
+            if ( !nsData.endsWith(".$cmd") )
+                return true;
+
+            BSONObj command(ns + nsData.size() + 1 + 2 * sizeof(int32_t));
+            if ( command.hasField("$query") )
+                command = command["$query"].Obj();
+
+            const StringData name = command.firstElementFieldName();
+            const size_t n = sizeof(kUncompressedCommands) / sizeof(kUncompressedCommands[0]);
+            for (size_t i = 0; i < n; ++i) {
+                if ( name == kUncompressedCommands[i] )
+                    return false;
+            }
+            return true;
+        }
+    }
+
+    // Holds back small messages so that several go out in a single write: until the buffer is
+    // full, until the next say(), or until flushed explicitly.
     class PiggyBackData {
     public:
-        PiggyBackData( MessagingPort * port ) {
-            _port = port;
-            _buf = new char[1300];
-            _cur = _buf;
+        PiggyBackData( MessagingPort * port , size_t capacity )
+            : _port( port ) , _buf( capacity ) , _len( 0 ) {
         }
 
         ~PiggyBackData() {
             DESTRUCTOR_GUARD (
                 flush();
-                delete[]( _cur );
             );
         }
 
+        void setCapacity( size_t capacity ) {
+            flush();
+            std::vector<char>( capacity ).swap( _buf );
+        }
+
+        size_t capacity() const { return _buf.size(); }
+
+        // 'm' must fit in an empty buffer
         void append( Message& m ) {
-            verify( m.header().getLen() <= 1300 );
+            const size_t size = m.size();
+            verify( size <= _buf.size() );
 
-            if ( len() + m.header().getLen() > 1300 )
+            if ( _len + size > _buf.size() )
                 flush();
 
-            memcpy( _cur , m.singleData().view2ptr() , m.header().getLen() );
-            _cur += m.header().getLen();
+            m.copyTo( &_buf[_len] );
+            _len += size;
         }
 
         void flush() {
-            if ( _buf == _cur )
+            if ( _len == 0 )
                 return;
 
-            _port->send( _buf , len(), "flush" );
-            _cur = _buf;
+            // Nothing is sent twice, even if this throws.
+            const int len = _len;
+            _len = 0;
+            _port->send( &_buf[0] , len, "flush" );
         }
 
-        int len() const { return _cur - _buf; }
+        // Sends what is buffered followed by 'm' with one gathering write.
+        void flushWith( Message& m ) {
+            std::vector< std::pair< char *, int > > buffers;
+            buffers.push_back( std::make_pair( &_buf[0], static_cast<int>( _len ) ) );
+            m.appendBuffersTo( &buffers );
+
+            _len = 0;
+            _port->send( buffers, "say" );
+        }
+
+        size_t len() const { return _len; }
 
     private:
         MessagingPort* _port;
-        char * _buf;
-        char * _cur;
+        std::vector<char> _buf;
+        size_t _len;
     };
 
     class Ports {
@@ -135,18 +195,21 @@ namespace mongo {
     }
 
     MessagingPort::MessagingPort(int fd, const SockAddr& remote) 
-        : psock( new Socket( fd , remote ) ) , piggyBackData(0) {
+        : psock( new Socket( fd , remote ) ) , piggyBackData(0) ,
+          _piggyBackBufferSize( kDefaultPiggyBackBufferSize ) , _compressor(NULL) {
         ports.insert(this);
     }
 
     MessagingPort::MessagingPort( double timeout, logger::LogSeverity ll ) 
-        : psock( new Socket( timeout, ll ) ) {
+        : psock( new Socket( timeout, ll ) ) ,
+          _piggyBackBufferSize( kDefaultPiggyBackBufferSize ) , _compressor(NULL) {
         ports.insert(this);
         piggyBackData = 0;
     }
 
     MessagingPort::MessagingPort( boost::shared_ptr<Socket> sock )
-        : psock( sock ), piggyBackData( 0 ) {
+        : psock( sock ), piggyBackData( 0 ),
+          _piggyBackBufferSize( kDefaultPiggyBackBufferSize ), _compressor( NULL ) {
         ports.insert(this);
     }
 
@@ -222,11 +285,9 @@ again:
             }
 
             psock->setHandshakeReceived();
-            int z = (len+1023)&0xfffffc00;
-            verify(z>=len);
-            MsgData::View md = reinterpret_cast<char *>(malloc(z));
-            ScopeGuard guard = MakeGuard(free, md.view2ptr());
-            verify(md.view2ptr());
+            size_t capacity;
+            MsgData::View md = MessageBufferPool::global().allocate(len, &capacity);
+            ScopeGuard guard = MakeGuard(releaseMessageBuffer, md.view2ptr(), capacity);
 
             memcpy(md.view2ptr(), &header, headerLen);
             int left = len - headerLen;
@@ -234,7 +295,18 @@ again:
             psock->recv( md.data(), left );
 
             guard.Dismiss();
-            m.setData(md.view2ptr(), true);
+            m.setPooledData(md.view2ptr(), capacity);
+
+            if ( m.operation() == dbCompressed ) {
+                try {
+                    MessageCompressor::decompressMessage(&m);
+                }
+                catch ( const DBException& e ) {
+                    LOG(0) << "recv(): can't expand compressed message: " << e.what();
+                    m.reset();
+                    return false;
+                }
+            }
             return true;
 
         }
@@ -294,27 +366,30 @@ again:
         toSend.header().setId(nextMessageId());
         toSend.header().setResponseTo(responseTo);
 
+        Message compressed;
+        Message* out = &toSend;
+        if ( _compressor && mayCompress(toSend) &&
+             MessageCompressor::compressMessage(toSend, *_compressor,
+                                                &_compressionScratch, &_compressedMessage) ) {
+            compressed.appendBorrowedData( &_compressedMessage[0],
+                                           MsgData::ConstView(&_compressedMessage[0]).getLen() );
+            out = &compressed;
+        }
+
         if ( piggyBackData && piggyBackData->len() ) {
             mmm( log() << "*     have piggy back" << endl; )
-            if ( ( piggyBackData->len() + toSend.header().getLen() ) > 1300 ) {
-                // won't fit in a packet - so just send it off
-                piggyBackData->flush();
-            }
-            else {
-                piggyBackData->append( toSend );
-                piggyBackData->flush();
-                return;
-            }
+            piggyBackData->flushWith( *out );
+            return;
         }
 
-        toSend.send( *this, "say" );
+        out->send( *this, "say" );
     }
 
     void MessagingPort::piggyBack( Message& toSend , int responseTo ) {
 
-        if ( toSend.header().getLen() > 1300 ) {
-            // not worth saving because its almost an entire packet
-            say( toSend );
+        if ( static_cast<size_t>( toSend.size() ) > _piggyBackBufferSize ) {
+            // not worth holding back, and goes out along with anything that is
+            say( toSend, responseTo );
             return;
         }
 
@@ -323,11 +398,22 @@ again:
         toSend.header().setResponseTo(responseTo);
 
         if ( ! piggyBackData )
-            piggyBackData = new PiggyBackData( this );
+            piggyBackData = new PiggyBackData( this, _piggyBackBufferSize );
 
         piggyBackData->append( toSend );
     }
 
+    void MessagingPort::setPiggyBackBufferSize( size_t bytes ) {
+        _piggyBackBufferSize = bytes;
+        if ( piggyBackData )
+            piggyBackData->setCapacity( bytes );
+    }
+
+    void MessagingPort::flushPiggyBack() {
+        if ( piggyBackData )
+            piggyBackData->flush();
+    }
+
     HostAndPort MessagingPort::remote() const {
         if ( ! _remoteParsed.hasPort() ) {
             SockAddr sa = psock->remoteAddr();
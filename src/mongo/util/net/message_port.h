@@ -28,6 +28,7 @@
 
 namespace mongo {
 
+    class MessageCompressor;
     class MessagingPort;
     class PiggyBackData;
 
@@ -104,8 +105,23 @@ namespace mongo {
          */
         bool recv( const Message& sent , Message& response );
 
+        /**
+         * Like say(), but may hold 'toSend' back to send it along with later messages: it goes
+         * out with the next say(), once the messages held back fill the buffer, or on
+         * flushPiggyBack(). Messages larger than the buffer are sent right away.
+         */
         void piggyBack( Message& toSend , int responseTo = 0 );
 
+        // About one packet.
+        static const size_t kDefaultPiggyBackBufferSize = 1300;
+
+        /** Sets how many bytes of messages piggyBack() may hold back. */
+        void setPiggyBackBufferSize( size_t bytes );
+        size_t getPiggyBackBufferSize() const { return _piggyBackBufferSize; }
+
+        /** Sends the messages held back by piggyBack(), if any. */
+        void flushPiggyBack();
+
         unsigned remotePort() const { return psock->remotePort(); }
         virtual HostAndPort remote() const;
         virtual SockAddr remoteAddr() const;
@@ -135,6 +151,14 @@ namespace mongo {
         }
 #endif
 
+        /**
+         * Compresses the messages sent from now on with 'compressor', or stops compressing if
+         * it is NULL. Compressed messages are always expanded by recv(), whatever the codec,
+         * so each end can switch as soon as both have agreed on one.
+         */
+        void setCompressor(const MessageCompressor* compressor) { _compressor = compressor; }
+        const MessageCompressor* getCompressor() const { return _compressor; }
+
         bool isStillConnected() {
             return psock->isStillConnected();
         }
@@ -146,6 +170,13 @@ namespace mongo {
     private:
         
         PiggyBackData * piggyBackData;
+        size_t _piggyBackBufferSize;
+
+        const MessageCompressor* _compressor;
+
+        // Reused by say() when compressing, so only the largest message allocates.
+        std::vector<char> _compressionScratch;
+        std::vector<char> _compressedMessage;
 
         // this is the parsed version of remote
         // mutable because its initialized only on call to remote()
@@ -0,0 +1,154 @@
+/*    Copyright 2014 MongoDB Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/util/net/message_port.h"
+
+#include <boost/scoped_ptr.hpp>
+#include <cstring>
+#include <string>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/types.h>
+#endif
+
+#include "mongo/unittest/unittest.h"
+
+namespace {
+
+    using namespace mongo;
+
+    typedef boost::shared_ptr<Socket> SocketPtr;
+
+    // A fire-and-forget message whose payload is 'value' followed by 'padding' bytes.
+    void makeMessage(int value, size_t padding, Message* toSend) {
+        std::string payload(sizeof(value) + padding, 'x');
+        std::memcpy(&payload[0], &value, sizeof(value));
+        toSend->setData(dbKillCursors, payload.data(), payload.size());
+    }
+
+    int payloadOf(const Message& m) {
+        int value;
+        std::memcpy(&value, m.singleData().data(), sizeof(value));
+        return value;
+    }
+
+#ifndef _WIN32
+    class PiggyBackTest : public unittest::Test {
+    protected:
+        void setUp() {
+            int socks[2];
+            ASSERT_EQUALS(0, ::socketpair(PF_UNIX, SOCK_STREAM, 0, socks));
+            _serverFd = socks[1];
+
+            SocketPtr clientSock(new Socket(socks[0], SockAddr()));
+            SocketPtr serverSock(new Socket(socks[1], SockAddr()));
+            clientSock->setHandshakeReceived();
+            serverSock->setHandshakeReceived();
+
+            _client.reset(new MessagingPort(clientSock));
+            _server.reset(new MessagingPort(serverSock));
+        }
+
+        void tearDown() {
+            _client.reset();
+            _server.reset();
+        }
+
+        // Whether anything has arrived at the server end.
+        bool serverHasData() {
+            char c;
+            return ::recv(_serverFd, &c, 1, MSG_PEEK | MSG_DONTWAIT) > 0;
+        }
+
+        void expectMessages(int first, int last) {
+            for (int i = first; i <= last; ++i) {
+                Message received;
+                ASSERT_TRUE(_server->recv(received));
+                ASSERT_EQUALS(i, payloadOf(received));
+            }
+        }
+
+        int _serverFd;
+        boost::scoped_ptr<MessagingPort> _client;
+        boost::scoped_ptr<MessagingPort> _server;
+    };
+
+    TEST_F(PiggyBackTest, HeldBackUntilFlushed) {
+        Message toSend;
+        makeMessage(1, 0, &toSend);
+        _client->piggyBack(toSend);
+        ASSERT_FALSE(serverHasData());
+
+        _client->flushPiggyBack();
+        expectMessages(1, 1);
+    }
+
+    TEST_F(PiggyBackTest, SentAlongWithNextSay) {
+        for (int i = 0; i < 3; ++i) {
+            Message toSend;
+            makeMessage(i, 0, &toSend);
+            _client->piggyBack(toSend);
+        }
+
+        // Larger than the buffer, so it can't be copied in: goes out in the same write.
+        Message toSend;
+        makeMessage(3, 10 * 1024, &toSend);
+        _client->say(toSend);
+
+        expectMessages(0, 3);
+    }
+
+    TEST_F(PiggyBackTest, FullBufferIsSent) {
+        _client->setPiggyBackBufferSize(64 * 1024);
+
+        // 1000 messages of a little over 100 bytes fill the buffer once.
+        for (int i = 0; i < 1000; ++i) {
+            Message toSend;
+            makeMessage(i, 100, &toSend);
+            _client->piggyBack(toSend);
+        }
+        ASSERT_TRUE(serverHasData());
+
+        _client->flushPiggyBack();
+        expectMessages(0, 999);
+    }
+
+    TEST_F(PiggyBackTest, LargeMessageIsSentRightAway) {
+        Message small;
+        makeMessage(1, 0, &small);
+        _client->piggyBack(small);
+
+        Message large;
+        makeMessage(2, 64 * 1024, &large);
+        _client->piggyBack(large);
+
+        expectMessages(1, 2);
+    }
+
+    TEST_F(PiggyBackTest, ShrinkingBufferFlushes) {
+        Message toSend;
+        makeMessage(1, 0, &toSend);
+        _client->piggyBack(toSend);
+
+        _client->setPiggyBackBufferSize(16);
+        ASSERT_EQUALS(16U, _client->getPiggyBackBufferSize());
+        expectMessages(1, 1);
+    }
+#endif
+
+} // namespace
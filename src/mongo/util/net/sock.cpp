@@ -29,12 +29,15 @@
 # include <netinet/tcp.h>
 # include <arpa/inet.h>
 # include <errno.h>
+# include <limits.h>
 # include <netdb.h>
 # if defined(__openbsd__)
 #  include <sys/uio.h>
 # endif
 #endif
 
+#include <boost/scoped_array.hpp>
+
 #include "mongo/client/private/options.h"
 #include "mongo/util/background.h"
 #include "mongo/util/debug_util.h"
@@ -55,6 +58,15 @@ namespace mongo {
 
     MONGO_FP_DECLARE(throwSockExcep);
     MONGO_FP_DECLARE(notStillConnected);
+    MONGO_FP_DECLARE(joinSendBuffers); // send(vector) as with SSL and on Windows
+
+#if !defined(_WIN32)
+#if defined(IOV_MAX)
+    static const size_t kMaxIovecsPerSend = IOV_MAX;
+#else
+    static const size_t kMaxIovecsPerSend = 16; // _XOPEN_IOV_MAX, the least POSIX allows
+#endif
+#endif
 
     static bool ipv6 = false;
     void enableIPv6(bool state) { ipv6 = state; }
@@ -597,13 +609,28 @@ namespace mongo {
     }
 
     void Socket::_send( const vector< pair< char *, int > > &data, const char *context ) {
+        if ( data.size() == 1 ) {
+            send( data[0].first, data[0].second, context );
+            return;
+        }
+
+        // Sending each buffer on its own would cost a system call, or a TLS record, apiece.
+        size_t size = 0;
         for (vector< pair<char *, int> >::const_iterator i = data.begin(); 
              i != data.end(); 
              ++i) {
-            char * data = i->first;
-            int len = i->second;
-            send( data, len, context );
+            size += i->second;
         }
+
+        boost::scoped_array<char> joined( new char[size] );
+        char* pos = joined.get();
+        for (vector< pair<char *, int> >::const_iterator i = data.begin(); 
+             i != data.end(); 
+             ++i) {
+            memcpy( pos, i->first, i->second );
+            pos += i->second;
+        }
+        send( joined.get(), static_cast<int>( size ), context );
     }
 
     /** sends all data or throws an exception
@@ -618,28 +645,35 @@ namespace mongo {
         }
 #endif
 
+        if (MONGO_FAIL_POINT(joinSendBuffers)) {
+            _send( data , context );
+            return;
+        }
+
 #if defined(_WIN32)
         // TODO use scatter/gather api
         _send( data , context );
 #else
         vector<struct iovec> d( data.size() );
-        int i = 0;
+        size_t remaining = 0;
         for (vector< pair<char *, int> >::const_iterator j = data.begin(); 
              j != data.end(); 
              ++j) {
             if ( j->second > 0 ) {
-                d[ i ].iov_base = j->first;
-                d[ i ].iov_len = j->second;
-                ++i;
+                d[ remaining ].iov_base = j->first;
+                d[ remaining ].iov_len = j->second;
+                ++remaining;
                 _bytesOut += j->second;
             }
         }
         struct msghdr meta;
         memset( &meta, 0, sizeof( meta ) );
         meta.msg_iov = &d[ 0 ];
-        meta.msg_iovlen = d.size();
 
-        while( meta.msg_iovlen > 0 ) {
+        while( remaining > 0 ) {
+            // sendmsg() fails outright when given more than IOV_MAX buffers
+            meta.msg_iovlen = std::min( remaining, kMaxIovecsPerSend );
+
             int ret = -1;
             if (MONGO_FAIL_POINT(throwSockExcep)) {
 #if defined(_WIN32)
@@ -675,7 +709,7 @@ namespace mongo {
                     else {
                         ret -= i->iov_len;
                         ++i;
-                        --(meta.msg_iovlen);
+                        --remaining;
                     }
                 }
             }
@@ -707,6 +741,15 @@ namespace mongo {
         }
     }
 
+    int Socket::pendingRecvBytes() const {
+#ifdef MONGO_SSL
+        if ( _sslConnection.get() ) {
+            return _sslManager->SSL_pending( _sslConnection.get() );
+        }
+#endif
+        return 0;
+    }
+
     int Socket::unsafe_recv( char *buf, int max ) {
         int x = _recv( buf , max );
         _bytesIn += x;
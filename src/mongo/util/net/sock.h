@@ -229,6 +229,12 @@ namespace mongo {
         long long getBytesOut() const { return _bytesOut; }
         int rawFD() const { return _fd; }
 
+        /**
+         * Number of bytes that recv() can return without reading from the socket: data SSL has
+         * already decrypted, which poll() does not report as readable.
+         */
+        int pendingRecvBytes() const;
+
         void setTimeout( double secs );
         bool isStillConnected();
 
@@ -276,7 +282,7 @@ namespace mongo {
     private:
         void _init();
 
-        /** sends dumbly, just each buffer at a time */
+        /** sends a joined copy of the buffers, for when there is no gathering send */
         void _send( const std::vector< std::pair< char *, int > > &data, const char *context );
 
         /** raw send, same semantics as ::send with an additional context parameter */
@@ -331,5 +331,38 @@ namespace {
         ASSERT_TRUE(tryRecv());
     }
 
+    // Sends 'numBuffers' one byte buffers as one vector and checks they arrive in order.
+    void checkSendVector(int numBuffers) {
+        const SocketPair sockets = socketPair(SOCK_STREAM);
+        ASSERT_TRUE(sockets.first.get());
+
+        std::vector<char> bytes(numBuffers);
+        std::vector<std::pair<char*, int> > data;
+        for (int i = 0; i < numBuffers; ++i) {
+            bytes[i] = static_cast<char>(i % 128);
+            data.push_back(std::make_pair(&bytes[i], 1));
+        }
+        sockets.first->send(data, "SocketSendVector");
+        ASSERT_EQUALS(static_cast<long long>(numBuffers), sockets.first->getBytesOut());
+
+        std::vector<char> received(numBuffers);
+        sockets.second->recv(&received[0], numBuffers);
+        ASSERT(bytes == received);
+    }
+
+    // More buffers than a single sendmsg() call accepts must still all be sent, in order.
+    TEST(SocketSendVector, ManyBuffers) {
+        checkSendVector(4000);
+    }
+
+    // Without a gathering send (SSL, Windows) the buffers are joined and sent at once.
+    TEST(SocketSendVector, JoinedBuffers) {
+        FailPoint* const joinBuffers =
+            getGlobalFailPointRegistry()->getFailPoint("joinSendBuffers");
+        ASSERT_TRUE(joinBuffers != NULL);
+        const ScopedFailPointEnabler enabled(*joinBuffers);
+        checkSendVector(4000);
+        checkSendVector(1);
+    }
 
 } // namespace
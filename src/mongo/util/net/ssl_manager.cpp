@@ -203,6 +203,8 @@ namespace mongo {
 
             virtual int SSL_get_error(const SSLConnection* conn, int ret);
 
+            virtual int SSL_pending(const SSLConnection* conn);
+
             virtual int SSL_shutdown(SSLConnection* conn);
 
             virtual void SSL_free(SSLConnection* conn);
@@ -501,6 +503,10 @@ namespace mongo {
         return ::SSL_get_error(conn->ssl, ret);
     }
 
+    int SSLManager::SSL_pending(const SSLConnection* conn) {
+        return ::SSL_pending(conn->ssl);
+    }
+
     int SSLManager::SSL_shutdown(SSLConnection* conn) {
         int status;
         do {
@@ -114,6 +114,8 @@ namespace mongo {
 
         virtual int SSL_get_error(const SSLConnection* conn, int ret) = 0;
 
+        virtual int SSL_pending(const SSLConnection* conn) = 0;
+
         virtual int SSL_shutdown(SSLConnection* conn) = 0;
 
         virtual void SSL_free(SSLConnection* conn) = 0;
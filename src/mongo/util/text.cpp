@@ -19,9 +19,14 @@
 
 #include <boost/integer_traits.hpp>
 #include <boost/smart_ptr/scoped_array.hpp>
+#include <cstring>
 #include <errno.h>
 #include <sstream>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #ifdef _WIN32
 #include <io.h>
 #endif
@@ -104,13 +109,47 @@ namespace mongo {
     }
 
     bool isValidUTF8(const std::string& s) { 
-        return isValidUTF8(s.c_str()); 
+        return isValidUTF8(StringData(s)); 
     }
 
     bool isValidUTF8(const char *s) {
+        return isValidUTF8(StringData(s));
+    }
+
+    namespace {
+        // Skips the ASCII bytes at the start of [s, end), a block at a time. SSE2 is part of
+        // x86-64, so needs no runtime check; elsewhere whole words are tested instead.
+        inline const unsigned char* skipASCII(const unsigned char* s, const unsigned char* end) {
+#if defined(__SSE2__)
+            while (end - s >= 16) {
+                const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+                if (_mm_movemask_epi8(block))
+                    break;
+                s += 16;
+            }
+#endif
+            while (end - s >= 8) {
+                unsigned long long word;
+                memcpy(&word, s, sizeof(word));
+                if (word & 0x8080808080808080ULL)
+                    break;
+                s += 8;
+            }
+            return s;
+        }
+    }
+
+    bool isValidUTF8(const StringData& str) {
+        const unsigned char* s = reinterpret_cast<const unsigned char*>(str.rawData());
+        const unsigned char* const end = s + str.size();
         int left = 0; // how many bytes are left in the current codepoint
-        while (*s) {
-            const unsigned char c = (unsigned char) *(s++);
+        while (s != end) {
+            if (!left) {
+                s = skipASCII(s, end);
+                if (s == end)
+                    break;
+            }
+            const unsigned char c = *(s++);
             const int ones = leadingOnes(c);
             if (left) {
                 if (ones != 1) return false; // should be a continuation byte
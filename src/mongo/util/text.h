@@ -22,6 +22,7 @@
 #include <string>
 
 #include "mongo/base/disallow_copying.h"
+#include "mongo/base/string_data.h"
 
 namespace mongo {
 
@@ -60,6 +61,11 @@ namespace mongo {
     bool isValidUTF8(const char *s);
     bool isValidUTF8(const std::string& s);
 
+    /* Like the above, for 's.size()' bytes that may include NULs (U+0000). Runs of ASCII are
+     * checked 16 or 8 bytes at a time, so mostly-ASCII text costs little more than a memchr.
+     */
+    bool isValidUTF8(const StringData& s);
+
     // expect that n contains a base ten number and nothing else after it
     // NOTE win version hasn't been tested directly
     long long parseLL( const char *n );
@@ -229,6 +229,14 @@ namespace {
 
     }
 
+    int outputDateAsISOStringLocal(char* buf, Date_t date) {
+        BOOST_STATIC_ASSERT(DateStringBuffer::dataCapacity <= kISODateStringMaxSize);
+        DateStringBuffer result;
+        _dateToISOString(date, true, &result);
+        memcpy(buf, result.data, result.size);
+        return result.size;
+    }
+
     void outputDateAsCtime(std::ostream& os, Date_t date) {
         DateStringBuffer buf;
         _dateToCtimeString(date, &buf);
@@ -107,6 +107,16 @@ namespace mongo {
      */
     MONGO_CLIENT_API void MONGO_CLIENT_FUNC outputDateAsISOStringLocal(std::ostream& os, Date_t date);
 
+    /** Room enough for any string written by outputDateAsISOStringLocal(char*, Date_t). */
+    const int kISODateStringMaxSize = 64;
+
+    /**
+     * Like dateToISOStringLocal, except writes to 'buf', which must have room for
+     * kISODateStringMaxSize characters, and returns the length. The string is not NUL
+     * terminated.
+     */
+    MONGO_CLIENT_API int MONGO_CLIENT_FUNC outputDateAsISOStringLocal(char* buf, Date_t date);
+
     /**
      * Like dateToCtimeString, except outputs to a std::ostream.
      */